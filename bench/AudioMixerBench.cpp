@@ -0,0 +1,165 @@
+// AudioMixer check and benchmark.
+//
+//   audio_mixer_bench --check    accuracy only (ctest): exit code 1 on any mismatch
+//   audio_mixer_bench [blocks]   accuracy, then us/block per path for 10 ms stereo blocks
+//
+// Three native-rate sources (no resampling) are mixed through the public API with the
+// kernels capped at each instruction set. Gains push the sum over the limiter ceiling
+// for the first blocks, then the signal drops so the gain ramps back up; a spike on the
+// last sample of a block has to be found by the peak tail. Block lengths and channel
+// counts make the sample totals odd, so every vector loop ends in a scalar tail.
+// The SSE2 and AVX2 output and limiter gain must equal the scalar path exactly; source
+// levels are sums of squares added in a different order, so they only have to agree to
+// kMaxLevelError.
+
+#include "AudioMixer.h"
+#include <QElapsedTimer>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const int kRate = 48000;
+const int kSources = 3;
+const double kGains[kSources] = { 1.0, 0.7, 1.9 };
+const int kBlocks = 8;
+const double kMaxLevelError = 1e-4; // Relative
+
+// Noise at an amplitude that falls after the first blocks; source s differs by seed
+void fillSignal(std::vector<float> &buf, int channels, int samples, int s) {
+    uint32_t rng = 12345u + (uint32_t)s * 7919u;
+    buf.resize((size_t)kBlocks * samples * channels);
+    for (int b = 0; b < kBlocks; b++) {
+        float amp = b < 2 ? 0.9f : (b == 3 ? 0.05f : 0.3f);
+        float *block = buf.data() + (size_t)b * samples * channels;
+        for (int i = 0; i < samples * channels; i++) {
+            rng = rng * 1664525u + 1013904223u;
+            block[i] = amp * ((int32_t)rng / 2147483648.0f);
+        }
+        if (b == 4 && s == 0) block[samples * channels - 1] = 1.0f; // Peak in the tail
+    }
+}
+
+struct Result {
+    std::vector<float> out;     // Planar output of every block, back to back
+    std::vector<float> limiter; // Limiter gain after every block
+    std::vector<double> levels; // Source levels after every block
+};
+
+bool runMixer(ColorConverter::Isa isa, int channels, int samples, Result &r) {
+    AudioMixer mixer(isa);
+    mixer.init(nullptr, channels, 1);
+    std::vector<AudioMixer::Source *> sources;
+    for (int s = 0; s < kSources; s++)
+        sources.push_back(mixer.addSource(QString("src%1").arg(s), AudioMixer::Microphone, kRate, channels,
+                                          AV_SAMPLE_FMT_FLT, kGains[s]));
+    if (mixer.lockSampleRate() != kRate) return false;
+    std::vector<float> signal;
+    for (int s = 0; s < kSources; s++) {
+        fillSignal(signal, channels, samples, s);
+        sources[s]->writeInterleaved((const uint8_t *)signal.data(), (int)(signal.size() * sizeof(float)), 0);
+    }
+
+    std::vector<std::vector<float>> planes(channels, std::vector<float>(samples));
+    std::vector<float *> dst(channels);
+    for (int c = 0; c < channels; c++) dst[c] = planes[c].data();
+    for (int b = 0; b < kBlocks; b++) {
+        if (!mixer.mix(dst.data(), samples, (int64_t)b * samples * 1000000000LL / kRate)) return false;
+        for (int c = 0; c < channels; c++) r.out.insert(r.out.end(), planes[c].begin(), planes[c].end());
+        r.limiter.push_back((float)mixer.limiterGain());
+        for (AudioMixer::Source *src : sources) r.levels.push_back(src->level());
+    }
+    return true;
+}
+
+bool checkAccuracy() {
+    const int channelCounts[] = { 1, 2, 6 };
+    const int blockSamples[] = { 1, 3, 5, 64, 333, 480, 1021 };
+    ColorConverter::Isa best = ColorConverter::detectIsa();
+    bool ok = true;
+
+    printf("Accuracy (this CPU: %s)\n", ColorConverter::isaName(best));
+    for (int channels : channelCounts) {
+        for (int samples : blockSamples) {
+            Result scalar;
+            if (!runMixer(ColorConverter::Scalar, channels, samples, scalar)) {
+                printf("  %d ch x %4d: scalar mix produced no audio FAIL\n", channels, samples);
+                ok = false;
+                continue;
+            }
+            bool limited = false;
+            for (float g : scalar.limiter) limited = limited || g < 1.0f;
+            for (int isa = ColorConverter::Sse2; isa <= best; isa++) {
+                Result simd;
+                bool ran = runMixer((ColorConverter::Isa)isa, channels, samples, simd);
+                int64_t outDiff = 0;
+                for (size_t i = 0; ran && i < scalar.out.size(); i++)
+                    outDiff += memcmp(&scalar.out[i], &simd.out[i], sizeof(float)) != 0;
+                bool limiterSame = ran && memcmp(scalar.limiter.data(), simd.limiter.data(),
+                                                 scalar.limiter.size() * sizeof(float)) == 0;
+                double levelErr = 0.0;
+                for (size_t i = 0; ran && i < scalar.levels.size(); i++) {
+                    double ref = qMax(scalar.levels[i], 1e-12);
+                    levelErr = qMax(levelErr, std::fabs(simd.levels[i] - scalar.levels[i]) / ref);
+                }
+                bool caseOk = ran && outDiff == 0 && limiterSame && levelErr <= kMaxLevelError;
+                printf("  %d ch x %4d (%5d floats, limiter %s): %s vs scalar: %lld samples differ, limiter gain %s, "
+                       "level error %.1e %s\n", channels, samples, channels * samples, limited ? "on" : "off",
+                       ColorConverter::isaName((ColorConverter::Isa)isa), (long long)outDiff,
+                       limiterSame ? "same" : "differs", levelErr, caseOk ? "ok" : "FAIL");
+                ok = ok && caseOk;
+            }
+        }
+    }
+    return ok;
+}
+
+void benchmark(int blocks) {
+    const int samples = kRate / 100;
+    ColorConverter::Isa best = ColorConverter::detectIsa();
+
+    printf("\nus/block, %d sources, stereo, %d-sample blocks, %d blocks each\n", kSources, samples, blocks);
+    printf("| C | SSE2 | AVX2 |\n");
+    printf("|---|---|---|\n");
+    double isaUs[3] = { -1, -1, -1 };
+    std::vector<float> signal;
+    std::vector<float> planes[2] = { std::vector<float>(samples), std::vector<float>(samples) };
+    float *dst[2] = { planes[0].data(), planes[1].data() };
+    for (int isa = ColorConverter::Scalar; isa <= best; isa++) {
+        AudioMixer mixer((ColorConverter::Isa)isa);
+        mixer.init(nullptr, 2, 1);
+        std::vector<AudioMixer::Source *> sources;
+        for (int s = 0; s < kSources; s++)
+            sources.push_back(mixer.addSource(QString("src%1").arg(s), AudioMixer::Microphone, kRate, 2,
+                                              AV_SAMPLE_FMT_FLT, kGains[s]));
+        mixer.lockSampleRate();
+        fillSignal(signal, 2, samples, 0);
+        int blockBytes = samples * 2 * (int)sizeof(float);
+        QElapsedTimer timer;
+        qint64 elapsed = 0;
+        for (int b = 0; b < blocks; b++) {
+            // Fill the rings with the block outside the timed part
+            int64_t ts = (int64_t)b * samples * 1000000000LL / kRate;
+            for (AudioMixer::Source *src : sources)
+                src->writeInterleaved((const uint8_t *)(signal.data() + (size_t)(b % kBlocks) * samples * 2), blockBytes, ts);
+            timer.start();
+            mixer.mix(dst, samples, ts);
+            elapsed += timer.nsecsElapsed();
+        }
+        isaUs[isa] = elapsed / 1e3 / blocks;
+    }
+    for (double us : isaUs) us < 0 ? printf("| n/a ") : printf("| %.2f ", us);
+    printf("|\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    bool checkOnly = argc > 1 && strcmp(argv[1], "--check") == 0;
+    bool ok = checkAccuracy();
+    printf("%s\n", ok ? "Accuracy: PASS" : "Accuracy: FAIL");
+    if (!checkOnly) benchmark(argc > 1 ? qMax(1, atoi(argv[1])) : 10000);
+    return ok ? 0 : 1;
+}
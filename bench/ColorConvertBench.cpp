@@ -0,0 +1,239 @@
+// ColorConverter check and benchmark.
+//
+//   color_convert_bench --check   bit-accuracy only (ctest): exit code 1 on any mismatch
+//   color_convert_bench [frames]  accuracy, then ms/frame per path at 1080p and 4K
+//
+// Accuracy: the SSE2 and AVX2 paths must produce the same bytes as the scalar path, and
+// the scalar path must stay within one code value of swscale (BT.709, full-range RGB in,
+// limited-range YUV out, the recorder's settings). For 4:2:0 the reference is swscale's
+// 4:4:4 output box-filtered 2x2, the same chroma siting the kernel uses; that average is
+// rounded twice, so chroma may differ by two there.
+
+#include "ColorConverter.h"
+#include <QElapsedTimer>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+const int kMaxLumaDiff = 1; // scalar vs swscale
+const int kMaxChromaDiff444 = 1;
+const int kMaxChromaDiff420 = 2;
+
+// Deterministic screen-like content: flat UI areas, text strokes, a gradient, a photo-like
+// noisy region. Widths that are not a multiple of 32 exercise the scalar tails.
+void fillScreen(AVFrame *f, uint32_t seed) {
+    uint32_t rng = seed;
+    auto next = [&rng]() { rng = rng * 1664525u + 1013904223u; return rng >> 8; };
+    for (int y = 0; y < f->height; y++) {
+        uint8_t *row = f->data[0] + (int64_t)y * f->linesize[0];
+        for (int x = 0; x < f->width; x++) {
+            uint8_t *p = row + x * 4;
+            uint8_t r, g, b;
+            if (y < f->height / 12) {                        // Title bar
+                r = 32; g = 96; b = 200;
+            } else if (x < f->width / 5) {                   // Sidebar gradient
+                r = (uint8_t)(x * 255 / qMax(1, f->width / 5)); g = (uint8_t)(y * 255 / f->height); b = 128;
+            } else if (y > f->height * 3 / 4) {              // Photo-like noise
+                r = (uint8_t)next(); g = (uint8_t)next(); b = (uint8_t)next();
+            } else {                                         // Text on white
+                bool ink = ((x / 3) * 7 + (y / 4) * 13) % 11 < 3 && (y % 18) < 12;
+                r = g = b = ink ? 20 : 250;
+                if (ink && (x / 40) % 3 == 0) { r = 200; g = 30; b = 30; } // Coloured link text
+            }
+            p[0] = b; p[1] = g; p[2] = r; p[3] = 255;        // BGRA; RGB-order formats swap below
+            if (f->format == AV_PIX_FMT_RGBA || f->format == AV_PIX_FMT_RGB0) std::swap(p[0], p[2]);
+        }
+    }
+}
+
+AVFrame *allocFrame(int w, int h, AVPixelFormat fmt) {
+    AVFrame *f = av_frame_alloc();
+    f->width = w;
+    f->height = h;
+    f->format = fmt;
+    av_frame_get_buffer(f, 32);
+    return f;
+}
+
+SwsContext *bt709Context(int w, int h, AVPixelFormat src, AVPixelFormat dst, int flags) {
+    SwsContext *ctx = sws_getContext(w, h, src, w, h, dst, flags, nullptr, nullptr, nullptr);
+    if (ctx) {
+        sws_setColorspaceDetails(ctx, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                 sws_getCoefficients(SWS_CS_ITU709), 0, 0, 1 << 16, 1 << 16);
+    }
+    return ctx;
+}
+
+struct Diff {
+    int maxY = 0;
+    int maxC = 0;
+};
+
+// Exact comparison of two planar YUV frames of the same layout
+int64_t countMismatches(const AVFrame *a, const AVFrame *b) {
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get((AVPixelFormat)a->format);
+    int64_t n = 0;
+    for (int p = 0; p < 3; p++) {
+        int w = p ? AV_CEIL_RSHIFT(a->width, d->log2_chroma_w) : a->width;
+        int h = p ? AV_CEIL_RSHIFT(a->height, d->log2_chroma_h) : a->height;
+        for (int y = 0; y < h; y++) {
+            const uint8_t *ra = a->data[p] + (int64_t)y * a->linesize[p];
+            const uint8_t *rb = b->data[p] + (int64_t)y * b->linesize[p];
+            for (int x = 0; x < w; x++) n += ra[x] != rb[x];
+        }
+    }
+    return n;
+}
+
+// out against swscale's 4:4:4 reference (box-filtered when out is 4:2:0)
+Diff compareToReference(const AVFrame *out, const AVFrame *ref444) {
+    Diff diff;
+    bool sub = out->format == AV_PIX_FMT_YUV420P;
+    for (int y = 0; y < out->height; y++) {
+        for (int x = 0; x < out->width; x++) {
+            int e = abs(out->data[0][(int64_t)y * out->linesize[0] + x] - ref444->data[0][(int64_t)y * ref444->linesize[0] + x]);
+            diff.maxY = qMax(diff.maxY, e);
+        }
+    }
+    int cw = sub ? out->width / 2 : out->width, ch = sub ? out->height / 2 : out->height;
+    for (int p = 1; p < 3; p++) {
+        for (int y = 0; y < ch; y++) {
+            for (int x = 0; x < cw; x++) {
+                int ref;
+                if (sub) {
+                    const uint8_t *r0 = ref444->data[p] + (int64_t)(y * 2) * ref444->linesize[p] + x * 2;
+                    const uint8_t *r1 = r0 + ref444->linesize[p];
+                    ref = (r0[0] + r0[1] + r1[0] + r1[1] + 2) >> 2;
+                } else {
+                    ref = ref444->data[p][(int64_t)y * ref444->linesize[p] + x];
+                }
+                int e = abs(out->data[p][(int64_t)y * out->linesize[p] + x] - ref);
+                diff.maxC = qMax(diff.maxC, e);
+            }
+        }
+    }
+    return diff;
+}
+
+bool checkAccuracy() {
+    const int sizes[][2] = { { 1920, 1080 }, { 1366, 768 }, { 130, 66 }, { 2, 2 } };
+    const AVPixelFormat srcFmts[] = { AV_PIX_FMT_BGRA, AV_PIX_FMT_BGR0, AV_PIX_FMT_RGBA, AV_PIX_FMT_RGB0 };
+    const AVPixelFormat dstFmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P };
+    ColorConverter::Isa best = ColorConverter::detectIsa();
+    bool ok = true;
+
+    printf("Accuracy (this CPU: %s)\n", ColorConverter::isaName(best));
+    for (const auto &size : sizes) {
+        int w = size[0], h = size[1];
+        for (AVPixelFormat srcFmt : srcFmts) {
+            AVFrame *src = allocFrame(w, h, srcFmt);
+            fillScreen(src, (uint32_t)(w * 31 + h));
+            AVFrame *ref = allocFrame(w, h, AV_PIX_FMT_YUV444P);
+            SwsContext *sws = bt709Context(w, h, srcFmt, AV_PIX_FMT_YUV444P,
+                                           SWS_POINT | SWS_ACCURATE_RND | SWS_BITEXACT);
+            sws_scale(sws, src->data, src->linesize, 0, h, ref->data, ref->linesize);
+            sws_freeContext(sws);
+
+            for (AVPixelFormat dstFmt : dstFmts) {
+                ColorConverter conv;
+                AVFrame *scalar = allocFrame(w, h, dstFmt);
+                conv.init(w, h, srcFmt, dstFmt, 1, ColorConverter::Scalar);
+                conv.convert(src, scalar);
+                Diff d = compareToReference(scalar, ref);
+                int maxC = dstFmt == AV_PIX_FMT_YUV420P ? kMaxChromaDiff420 : kMaxChromaDiff444;
+                bool refOk = d.maxY <= kMaxLumaDiff && d.maxC <= maxC;
+                printf("  %4dx%-4d %-5s -> %-8s scalar vs swscale: max dY %d, max dC %d %s\n", w, h,
+                       av_get_pix_fmt_name(srcFmt), av_get_pix_fmt_name(dstFmt), d.maxY, d.maxC, refOk ? "ok" : "FAIL");
+                ok = ok && refOk;
+
+                for (int isa = ColorConverter::Sse2; isa <= best; isa++) {
+                    AVFrame *simd = allocFrame(w, h, dstFmt);
+                    // Several bands so the band split is covered too
+                    conv.init(w, h, srcFmt, dstFmt, 3, (ColorConverter::Isa)isa);
+                    conv.convert(src, simd);
+                    int64_t n = countMismatches(scalar, simd);
+                    printf("  %4dx%-4d %-5s -> %-8s %s vs scalar: %lld bytes differ %s\n", w, h,
+                           av_get_pix_fmt_name(srcFmt), av_get_pix_fmt_name(dstFmt),
+                           ColorConverter::isaName((ColorConverter::Isa)isa), (long long)n, n == 0 ? "ok" : "FAIL");
+                    ok = ok && n == 0;
+                    av_frame_free(&simd);
+                }
+                av_frame_free(&scalar);
+            }
+            av_frame_free(&ref);
+            av_frame_free(&src);
+        }
+    }
+    return ok;
+}
+
+double msPerFrame(const QElapsedTimer &timer, int frames) {
+    return timer.nsecsElapsed() / 1e6 / frames;
+}
+
+void benchmark(int frames) {
+    const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    const AVPixelFormat dstFmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P };
+    ColorConverter::Isa best = ColorConverter::detectIsa();
+
+    printf("\nms/frame, BGRA input, %d frames each\n", frames);
+    printf("| size | output | swscale | C | SSE2 | AVX2 | best, auto bands |\n");
+    printf("|---|---|---|---|---|---|---|\n");
+    for (const auto &size : sizes) {
+        int w = size[0], h = size[1];
+        AVFrame *src = allocFrame(w, h, AV_PIX_FMT_BGRA);
+        fillScreen(src, 1);
+        for (AVPixelFormat dstFmt : dstFmts) {
+            AVFrame *dst = allocFrame(w, h, dstFmt);
+            QElapsedTimer timer;
+
+            // The recorder's fallback: swscale with the same flags as RecorderController
+            SwsContext *sws = bt709Context(w, h, AV_PIX_FMT_BGRA, dstFmt, SWS_BICUBIC);
+            timer.start();
+            for (int i = 0; i < frames; i++) sws_scale(sws, src->data, src->linesize, 0, h, dst->data, dst->linesize);
+            double swsMs = msPerFrame(timer, frames);
+            sws_freeContext(sws);
+
+            double isaMs[3] = { -1, -1, -1 };
+            ColorConverter conv;
+            for (int isa = ColorConverter::Scalar; isa <= best; isa++) {
+                conv.init(w, h, AV_PIX_FMT_BGRA, dstFmt, 1, (ColorConverter::Isa)isa);
+                conv.convert(src, dst); // Warm-up
+                timer.start();
+                for (int i = 0; i < frames; i++) conv.convert(src, dst);
+                isaMs[isa] = msPerFrame(timer, frames);
+            }
+            conv.init(w, h, AV_PIX_FMT_BGRA, dstFmt);
+            conv.convert(src, dst);
+            timer.start();
+            for (int i = 0; i < frames; i++) conv.convert(src, dst);
+            double bandedMs = msPerFrame(timer, frames);
+
+            auto cell = [](double ms) { static char buf[4][16]; static int n = 0; char *b = buf[n++ % 4];
+                                        if (ms < 0) snprintf(b, 16, "n/a"); else snprintf(b, 16, "%.2f", ms); return b; };
+            printf("| %dx%d | %s | %.2f | %s | %s | %s | %.2f (%d bands) |\n", w, h, av_get_pix_fmt_name(dstFmt), swsMs,
+                   cell(isaMs[0]), cell(isaMs[1]), cell(isaMs[2]), bandedMs, conv.bandCount());
+            av_frame_free(&dst);
+        }
+        av_frame_free(&src);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    bool checkOnly = argc > 1 && strcmp(argv[1], "--check") == 0;
+    bool ok = checkAccuracy();
+    printf("%s\n", ok ? "Accuracy: PASS" : "Accuracy: FAIL");
+    if (!checkOnly) benchmark(argc > 1 ? qMax(1, atoi(argv[1])) : 200);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+// Encoder preset benchmark: CPU per frame and bytes per minute for each codec the
+// recorder can archive with, using the recorder's own settings (VideoEncoderPreset::apply,
+// default bit rate, one-second GOP, BT.709 limited range from ColorConverter).
+//
+//   encoder_preset_bench [seconds] [--444] [--scenecut]
+//
+// The input is a synthetic 1080p30 desktop: a static wallpaper and taskbar, a document
+// window that scrolls for five seconds and then sits still with a blinking caret, a slide
+// switch every ten seconds, a moving cursor and a small playing video. The same frames are
+// generated for every codec; the CPU time of generating and converting them (measured in a
+// pass without an encoder) is subtracted, so the figures are the encoder's alone, including
+// its own worker threads.
+
+#include "ColorConverter.h"
+#include "VideoEncoderPreset.h"
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+
+const int kWidth = 1920;
+const int kHeight = 1080;
+const int kFps = 30;
+
+// CPU time of the whole process (all threads), in ms
+double processCpuMs() {
+#ifdef Q_OS_WIN
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    auto ms = [](const FILETIME &t) { return (((quint64)t.dwHighDateTime << 32) | t.dwLowDateTime) / 10000.0; };
+    return ms(kernel) + ms(user);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+void fillRect(AVFrame *f, int x0, int y0, int w, int h, uint32_t bgra) {
+    x0 = qMax(0, x0); y0 = qMax(0, y0);
+    int x1 = qMin(f->width, x0 + w), y1 = qMin(f->height, y0 + h);
+    for (int y = y0; y < y1; y++) {
+        uint32_t *row = (uint32_t*)(f->data[0] + (int64_t)y * f->linesize[0]);
+        for (int x = x0; x < x1; x++) row[x] = bgra;
+    }
+}
+
+uint32_t hash(uint32_t v) {
+    v ^= v >> 16; v *= 0x7feb352d; v ^= v >> 15; v *= 0x846ca68b; v ^= v >> 16;
+    return v;
+}
+
+// Frame n of the synthetic desktop, BGRA
+void renderDesktop(AVFrame *f, int n) {
+    int sec = n / kFps;
+    int slide = sec / 10;                 // Slide switch every ten seconds
+    bool scrolling = sec % 10 < 5;        // Scroll, then read
+    int scroll = scrolling ? (n % (10 * kFps)) * 2 : 5 * kFps * 2;
+
+    // Wallpaper: vertical gradient
+    for (int y = 0; y < f->height; y++) {
+        uint8_t c = (uint8_t)(40 + y * 60 / f->height);
+        fillRect(f, 0, y, f->width, 1, 0xff000000u | (c << 16) | ((c / 2) << 8) | (c / 3));
+    }
+    fillRect(f, 0, f->height - 40, f->width, 40, 0xff202020u); // Taskbar
+    for (int i = 0; i < 8; i++) fillRect(f, 12 + i * 52, f->height - 34, 40, 28, 0xff3070c0u + i * 0x080808u);
+
+    // Document window; its background and text change with the slide
+    const int wx = 160, wy = 80, ww = 1280, wh = 860;
+    uint32_t paper = (slide % 3 == 0) ? 0xfffafafau : (slide % 3 == 1) ? 0xff1e1e1eu : 0xfff3ead8u;
+    uint32_t ink = (slide % 3 == 1) ? 0xffd4d4d4u : 0xff202020u;
+    fillRect(f, wx, wy, ww, 32, 0xff2d5fa0u); // Title bar
+    fillRect(f, wx, wy + 32, ww, wh - 32, paper);
+    const int lineH = 22, glyphW = 9;
+    for (int y = wy + 40; y < wy + wh - 8; y++) {
+        int docY = y - (wy + 40) + scroll;
+        int line = docY / lineH, inLine = docY % lineH;
+        if (inLine < 4 || inLine > 17) continue;
+        uint32_t *row = (uint32_t*)(f->data[0] + (int64_t)y * f->linesize[0]);
+        int lineLen = 40 + hash(line * 131 + slide) % 90;
+        for (int c = 0; c < lineLen; c++) {
+            uint32_t g = hash((line * 257 + c) * 31 + slide);
+            if ((g & 7) == 0) continue; // Space
+            int x = wx + 16 + c * glyphW;
+            for (int dx = 1; dx < glyphW - 1; dx++) {
+                if ((g >> ((inLine + dx) % 24)) & 1) row[x + dx] = ink;
+            }
+        }
+    }
+    if (!scrolling && (n / (kFps / 2)) % 2) fillRect(f, wx + 400, wy + 300, 2, 18, ink); // Caret
+
+    // Playing video in the corner: a moving gradient with grain
+    const int vx = 1480, vy = 600, vw = 320, vh = 180;
+    for (int y = 0; y < vh; y++) {
+        uint32_t *row = (uint32_t*)(f->data[0] + (int64_t)(vy + y) * f->linesize[0]) + vx;
+        for (int x = 0; x < vw; x++) {
+            int grain = (int)(hash((uint32_t)(n * 65536 + y * vw + x)) & 15);
+            uint8_t r = (uint8_t)((x + n * 3) & 255), g = (uint8_t)((y * 2 + n) & 255), b = (uint8_t)qMin(255, 96 + grain * 4);
+            row[x] = 0xff000000u | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    // Cursor bouncing across the screen
+    auto bounce = [](int v, int range) { int p = v % (2 * range); return p < range ? p : 2 * range - p; };
+    int cx = 200 + bounce(n * 7, 1500), cy = 100 + bounce(n * 5, 850);
+    for (int y = 0; y < 19; y++) fillRect(f, cx, cy + y, qMax(1, 12 - qAbs(y - 9) / 2), 1, y ? 0xffffffffu : 0xff000000u);
+}
+
+struct Result {
+    const char *encoder = nullptr;
+    double cpuMs = 0.0;   // Process CPU for the whole run
+    double wallMs = 0.0;
+    int64_t bytes = 0;
+    int keyframes = 0;
+};
+
+// Encodes `frames` synthetic frames; codecIndex < 0 only renders and converts (baseline)
+bool run(int codecIndex, int frames, AVPixelFormat fmt, bool sceneCut, Result &result) {
+    AVFrame *rgb = av_frame_alloc();
+    rgb->format = AV_PIX_FMT_BGRA; rgb->width = kWidth; rgb->height = kHeight;
+    AVFrame *yuv = av_frame_alloc();
+    yuv->format = fmt; yuv->width = kWidth; yuv->height = kHeight;
+    yuv->color_range = AVCOL_RANGE_MPEG; yuv->colorspace = AVCOL_SPC_BT709;
+    if (av_frame_get_buffer(rgb, 32) < 0 || av_frame_get_buffer(yuv, 32) < 0) return false;
+    ColorConverter conv;
+    conv.init(kWidth, kHeight, AV_PIX_FMT_BGRA, fmt);
+
+    AVCodecContext *ctx = nullptr;
+    if (codecIndex >= 0) {
+        VideoEncoderPreset::Codec codec = (VideoEncoderPreset::Codec)codecIndex;
+        const AVCodec *enc = VideoEncoderPreset::findEncoder(codec);
+        if (!enc || (fmt != AV_PIX_FMT_YUV420P && !VideoEncoderPreset::supportsFormat(enc, fmt))) {
+            av_frame_free(&rgb); av_frame_free(&yuv);
+            return false;
+        }
+        // The recorder's settings (RecorderController::recordThreadFunc)
+        ctx = avcodec_alloc_context3(enc);
+        ctx->width = kWidth;
+        ctx->height = kHeight;
+        ctx->pix_fmt = fmt;
+        ctx->time_base = {1, 90000};
+        ctx->framerate = {kFps, 1};
+        ctx->color_range = AVCOL_RANGE_MPEG;
+        ctx->colorspace = AVCOL_SPC_BT709;
+        ctx->color_primaries = AVCOL_PRI_BT709;
+        ctx->color_trc = AVCOL_TRC_BT709;
+        ctx->bit_rate = VideoEncoderPreset::defaultBitRate(codec);
+        ctx->gop_size = kFps;
+        ctx->thread_count = 1;
+        if (sceneCut) ctx->keyint_min = qMax(1, kFps / 10);
+        VideoEncoderPreset::apply(ctx, enc, sceneCut);
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // As for MP4
+        if (avcodec_open2(ctx, enc, nullptr) < 0) {
+            fprintf(stderr, "%s: avcodec_open2 failed\n", enc->name);
+            avcodec_free_context(&ctx);
+            av_frame_free(&rgb); av_frame_free(&yuv);
+            return false;
+        }
+        result.encoder = enc->name;
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    auto drain = [&]() {
+        while (avcodec_receive_packet(ctx, pkt) == 0) {
+            result.bytes += pkt->size;
+            if (pkt->flags & AV_PKT_FLAG_KEY) result.keyframes++;
+            av_packet_unref(pkt);
+        }
+    };
+    QElapsedTimer wall;
+    wall.start();
+    double cpuStart = processCpuMs();
+    for (int n = 0; n < frames; n++) {
+        renderDesktop(rgb, n);
+        av_frame_make_writable(yuv); // Copies only if the encoder still holds the last picture
+        conv.convert(rgb, yuv);
+        if (!ctx) continue;
+        yuv->pts = (int64_t)n * 90000 / kFps;
+        avcodec_send_frame(ctx, yuv);
+        drain();
+    }
+    if (ctx) {
+        avcodec_send_frame(ctx, nullptr);
+        drain();
+    }
+    result.cpuMs = processCpuMs() - cpuStart;
+    result.wallMs = wall.nsecsElapsed() / 1e6;
+
+    av_packet_free(&pkt);
+    avcodec_free_context(&ctx);
+    av_frame_free(&rgb);
+    av_frame_free(&yuv);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    int seconds = 60;
+    bool use444 = false, sceneCut = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--444") == 0) use444 = true;
+        else if (strcmp(argv[i], "--scenecut") == 0) sceneCut = true;
+        else seconds = qMax(1, atoi(argv[i]));
+    }
+    int frames = seconds * kFps;
+    AVPixelFormat fmt = use444 ? AV_PIX_FMT_YUV444P : AV_PIX_FMT_YUV420P;
+
+    Result baseline;
+    run(-1, frames, fmt, false, baseline);
+    printf("%dx%d@%d, %d s, %s, scene-cut keyframes %s; render + convert: %.2f ms/frame CPU (subtracted)\n\n",
+           kWidth, kHeight, kFps, seconds, av_get_pix_fmt_name(fmt), sceneCut ? "on" : "off", baseline.cpuMs / frames);
+    printf("| codec | encoder | CPU ms/frame | wall ms/frame | realtime CPU share | MB/minute | keyframes |\n");
+    printf("|---|---|---|---|---|---|---|\n");
+    const VideoEncoderPreset::Codec codecs[] = { VideoEncoderPreset::H264, VideoEncoderPreset::HEVC, VideoEncoderPreset::AV1 };
+    for (VideoEncoderPreset::Codec codec : codecs) {
+        Result r;
+        QString name = VideoEncoderPreset::codecName(codec);
+        if (!run(codec, frames, fmt, sceneCut, r)) {
+            printf("| %s | not available | | | | | |\n", qPrintable(name));
+            continue;
+        }
+        double cpuPerFrame = qMax(0.0, r.cpuMs - baseline.cpuMs) / frames;
+        double wallPerFrame = qMax(0.0, r.wallMs - baseline.wallMs) / frames;
+        // Share of one core the encoder needs to keep up with a live capture
+        double share = cpuPerFrame * kFps / 1000.0;
+        printf("| %s | %s | %.2f | %.2f | %.0f%% of one core | %.2f | %d |\n", qPrintable(name), r.encoder, cpuPerFrame,
+               wallPerFrame, share * 100, r.bytes * 60.0 / seconds / (1024 * 1024), r.keyframes);
+        fflush(stdout);
+    }
+    return 0;
+}
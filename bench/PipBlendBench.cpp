@@ -0,0 +1,173 @@
+// PipCompositor check and benchmark.
+//
+//   pip_blend_bench --check    bit-accuracy only (ctest): exit code 1 on any mismatch
+//   pip_blend_bench [frames]   accuracy, then ms/frame per path for a 1080p recording
+//
+// The inset source is a lavfi testsrc2 pattern cut to a single frame, so every compositor
+// blends the same picture (the last one stays up after the source ends). For each frame
+// size, format, corner and opacity the SSE2 and AVX2 paths must leave exactly the same
+// bytes in the whole frame as the scalar path. Inset widths are chosen so the rows end in
+// vector tails, and the 4:2:0 chroma rows have odd widths.
+
+#include "PipCompositor.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <libavdevice/avdevice.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+
+const char *kSource = "lavfi:testsrc2=size=320x240:rate=25,trim=end_frame=1";
+
+AVFrame *allocFrame(int w, int h, AVPixelFormat fmt) {
+    AVFrame *f = av_frame_alloc();
+    f->width = w;
+    f->height = h;
+    f->format = fmt;
+    av_frame_get_buffer(f, 32);
+    return f;
+}
+
+// Noise the inset is blended over; the same seed gives the same frame
+void fillNoise(AVFrame *f, uint32_t seed) {
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get((AVPixelFormat)f->format);
+    uint32_t rng = seed;
+    for (int p = 0; p < 3; p++) {
+        int w = p ? AV_CEIL_RSHIFT(f->width, d->log2_chroma_w) : f->width;
+        int h = p ? AV_CEIL_RSHIFT(f->height, d->log2_chroma_h) : f->height;
+        for (int y = 0; y < h; y++) {
+            uint8_t *row = f->data[p] + (int64_t)y * f->linesize[p];
+            for (int x = 0; x < w; x++) {
+                rng = rng * 1664525u + 1013904223u;
+                row[x] = (uint8_t)(rng >> 24);
+            }
+        }
+    }
+}
+
+int64_t countMismatches(const AVFrame *a, const AVFrame *b) {
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get((AVPixelFormat)a->format);
+    int64_t n = 0;
+    for (int p = 0; p < 3; p++) {
+        int w = p ? AV_CEIL_RSHIFT(a->width, d->log2_chroma_w) : a->width;
+        int h = p ? AV_CEIL_RSHIFT(a->height, d->log2_chroma_h) : a->height;
+        for (int y = 0; y < h; y++) {
+            const uint8_t *ra = a->data[p] + (int64_t)y * a->linesize[p];
+            const uint8_t *rb = b->data[p] + (int64_t)y * b->linesize[p];
+            for (int x = 0; x < w; x++) n += ra[x] != rb[x];
+        }
+    }
+    return n;
+}
+
+// Opens the test source and waits for its picture (the side thread decodes it)
+bool openPip(PipCompositor &pip, int w, int h, AVPixelFormat fmt, int corner, int scale, int opacity,
+             ColorConverter::Isa isa) {
+    if (!pip.open(kSource, QString(), w, h, fmt, (PipCompositor::Corner)corner, scale, opacity, isa)) {
+        printf("  cannot open %s: %s\n", kSource, qPrintable(pip.errorString()));
+        return false;
+    }
+    QElapsedTimer wait;
+    wait.start();
+    while (pip.sourceFrames() == 0 && wait.elapsed() < 5000) QThread::msleep(5);
+    if (pip.sourceFrames() == 0) {
+        printf("  no picture from %s\n", kSource);
+        return false;
+    }
+    return true;
+}
+
+bool checkAccuracy() {
+    struct Case { int w, h, scale; };
+    // Inset widths 480, 232, 70, 34, 230: full vectors, SSE2 tails after AVX2, and odd
+    // chroma widths (35, 17, 115) in 4:2:0
+    const Case cases[] = { { 1920, 1080, 25 }, { 1366, 768, 17 }, { 700, 500, 10 }, { 262, 200, 13 }, { 1001, 601, 23 } };
+    const AVPixelFormat fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P };
+    const int opacities[] = { 100, 61, 0 };
+    ColorConverter::Isa best = ColorConverter::detectIsa();
+    bool ok = true;
+
+    printf("Accuracy (this CPU: %s, source %s)\n", ColorConverter::isaName(best), kSource);
+    int caseIndex = 0;
+    for (const Case &c : cases) {
+        for (AVPixelFormat fmt : fmts) {
+            for (int opacity : opacities) {
+                int corner = caseIndex++ % 4;
+                AVFrame *scalar = allocFrame(c.w, c.h, fmt);
+                fillNoise(scalar, (uint32_t)caseIndex);
+                PipCompositor pip;
+                if (!openPip(pip, c.w, c.h, fmt, corner, c.scale, opacity, ColorConverter::Scalar)) {
+                    av_frame_free(&scalar);
+                    return false;
+                }
+                pip.blend(scalar);
+                QRect inset = pip.rect();
+                pip.close();
+
+                for (int isa = ColorConverter::Sse2; isa <= best; isa++) {
+                    AVFrame *simd = allocFrame(c.w, c.h, fmt);
+                    fillNoise(simd, (uint32_t)caseIndex);
+                    if (!openPip(pip, c.w, c.h, fmt, corner, c.scale, opacity, (ColorConverter::Isa)isa)) {
+                        av_frame_free(&simd);
+                        av_frame_free(&scalar);
+                        return false;
+                    }
+                    pip.blend(simd);
+                    pip.close();
+                    int64_t n = countMismatches(scalar, simd);
+                    printf("  %4dx%-4d %-8s inset %3dx%-3d corner %d opacity %3d%%: %s vs scalar %lld bytes differ %s\n",
+                           c.w, c.h, av_get_pix_fmt_name(fmt), inset.width(), inset.height(), corner, opacity,
+                           ColorConverter::isaName((ColorConverter::Isa)isa), (long long)n, n == 0 ? "ok" : "FAIL");
+                    ok = ok && n == 0;
+                    av_frame_free(&simd);
+                }
+                av_frame_free(&scalar);
+            }
+        }
+    }
+    return ok;
+}
+
+void benchmark(int frames) {
+    const AVPixelFormat fmts[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P };
+    ColorConverter::Isa best = ColorConverter::detectIsa();
+
+    printf("\nms/frame, 1920x1080 recording, 25%% inset at 80%% opacity, %d frames each\n", frames);
+    printf("| format | C | SSE2 | AVX2 |\n");
+    printf("|---|---|---|---|\n");
+    for (AVPixelFormat fmt : fmts) {
+        double isaMs[3] = { -1, -1, -1 };
+        AVFrame *frame = allocFrame(1920, 1080, fmt);
+        fillNoise(frame, 1);
+        for (int isa = ColorConverter::Scalar; isa <= best; isa++) {
+            PipCompositor pip;
+            if (!openPip(pip, 1920, 1080, fmt, PipCompositor::BottomRight, 25, 80, (ColorConverter::Isa)isa)) break;
+            pip.blend(frame); // Warm-up
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < frames; i++) pip.blend(frame);
+            isaMs[isa] = timer.nsecsElapsed() / 1e6 / frames;
+        }
+        printf("| %s |", av_get_pix_fmt_name(fmt));
+        for (double ms : isaMs) ms < 0 ? printf(" n/a |") : printf(" %.3f |", ms);
+        printf("\n");
+        av_frame_free(&frame);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    avdevice_register_all(); // lavfi input
+    bool checkOnly = argc > 1 && strcmp(argv[1], "--check") == 0;
+    bool ok = checkAccuracy();
+    printf("%s\n", ok ? "Accuracy: PASS" : "Accuracy: FAIL");
+    if (!checkOnly) benchmark(argc > 1 ? qMax(1, atoi(argv[1])) : 1000);
+    return ok ? 0 : 1;
+}
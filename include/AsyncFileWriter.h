@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QString>
+#include <QFile>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// Write-behind file sink for the muxer.
+// The muxer writes into a custom AVIOContext; bytes are gathered into large
+// aligned blocks and handed to a dedicated writer thread, so a slow disk or an
+// antivirus scan no longer stalls the capture loop. The producer only blocks
+// when the in-memory budget is exhausted.
+class AsyncFileWriter {
+public:
+    struct Stats {
+        qint64 bytesWritten = 0;   // Bytes committed to disk
+        qint64 bytesQueued = 0;    // Bytes waiting in memory
+        double writeMBps = 0.0;    // Disk throughput over the last sample window
+        qint64 stallCount = 0;     // Times the producer waited on the budget
+        qint64 stallMs = 0;        // Total time the producer waited
+        qint64 maxWriteMs = 0;     // Slowest single block write
+        qint64 preallocatedBytes = 0; // Space reserved at open (0 = none)
+    };
+
+    AsyncFileWriter();
+    ~AsyncFileWriter();
+
+    // memoryBudget: max bytes buffered before the producer blocks.
+    // preallocateBytes: disk space reserved up-front (0 = off), file size is not changed.
+    bool open(const QString &path, qint64 memoryBudget, qint64 preallocateBytes = 0);
+    // Flushes all pending blocks, trims the file to its logical size and joins the writer.
+    bool close();
+
+    AVIOContext *ioContext() const { return m_avio; }
+    bool isOpen() const { return m_avio != nullptr; }
+    bool hasError() const { return m_failed.load(); }
+    QString errorString() const;
+    Stats stats() const;
+
+private:
+    struct Block {
+        uint8_t *data = nullptr;
+        int size = 0;
+        int64_t offset = 0;
+    };
+
+    static int writePacket(void *opaque, uint8_t *buf, int size);
+    static int64_t seekPacket(void *opaque, int64_t offset, int whence);
+
+    int write(const uint8_t *buf, int size);
+    int64_t seek(int64_t offset, int whence);
+    void submitCurrent();
+    Block takeFreeBlock();
+    bool preallocate(qint64 bytes);
+    void writerThreadFunc();
+
+    static const int BLOCK_SIZE = 4 * 1024 * 1024;
+    static const int AVIO_BUFFER_SIZE = 256 * 1024;
+
+    QFile m_file;
+    AVIOContext *m_avio = nullptr;
+    QThread *m_thread = nullptr;
+
+    // Producer side (muxer thread)
+    Block m_current;
+    int64_t m_pos = 0;       // Logical write position
+    int64_t m_logicalSize = 0;
+
+    // Shared with writer thread
+    mutable QMutex m_mutex;
+    QWaitCondition m_condData;
+    QWaitCondition m_condSpace;
+    std::deque<Block> m_queue;
+    std::vector<uint8_t*> m_freeBlocks;
+    qint64 m_budget = 0;
+    qint64 m_queuedBytes = 0;
+    bool m_stop = false;
+    std::atomic<bool> m_failed {false};
+    QString m_error;
+
+    // Metrics (guarded by m_mutex)
+    Stats m_stats;
+    QElapsedTimer m_rateTimer;
+    qint64 m_rateBytes = 0;
+};
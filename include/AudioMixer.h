@@ -0,0 +1,256 @@
+#pragma once
+
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include "MediaClock.h"
+#include "ColorConverter.h"
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/samplefmt.h>
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+}
+
+// Simple Ring Buffer for Audio
+// Data is stamped with the recording's MediaClock so readers can align sources by time.
+struct AudioBuffer {
+    uint8_t *data = nullptr;
+    int size = 0;
+    int writePos = 0;
+    int readPos = 0;
+    int capacity = 0;
+    int bytesPerSec = 0;        // For timestamp math (0 = unstamped)
+    int blockAlign = 4;         // Bytes per sample frame
+    int64_t endTsNs = -1;       // Clock time just past the last byte written
+    const MediaClock *clock = nullptr;
+    QMutex mutex;
+
+    void init(int cap, const MediaClock *mediaClock = nullptr, int rate = 44100, int frameBytes = 4) {
+        capacity = cap;
+        data = (uint8_t*)av_malloc(capacity);
+        size = 0; writePos = 0; readPos = 0;
+        clock = mediaClock;
+        bytesPerSec = rate * frameBytes;
+        blockAlign = frameBytes;
+        endTsNs = -1;
+    }
+    void free() { if(data) av_free(data); data = nullptr; }
+
+    int64_t bytesToNs(int64_t bytes) const { return bytesPerSec > 0 ? bytes * 1000000000LL / bytesPerSec : 0; }
+    int nsToBytes(int64_t ns) const {
+        if (bytesPerSec <= 0 || ns <= 0) return 0;
+        int64_t b = ns * bytesPerSec / 1000000000LL;
+        return (int)(b - b % blockAlign);
+    }
+
+    // tsNs: clock time of src[0]; -1 = captured just now (ends at the current clock time)
+    void write(const uint8_t* src, int len, int64_t tsNs = -1) {
+        QMutexLocker lock(&mutex);
+        if (!data || len <= 0) return;
+        if (tsNs < 0 && clock && clock->isStarted()) tsNs = clock->nowNs() - bytesToNs(len);
+        // If overflow, drop oldest data to keep latest audio
+        if (size + len > capacity) {
+            int drop = (size + len) - capacity;
+            readPos = (readPos + drop) % capacity;
+            size -= drop;
+            if (size < 0) size = 0;
+        }
+        for (int i=0; i<len; i++) {
+            data[writePos] = src[i];
+            writePos = (writePos + 1) % capacity;
+        }
+        size += len;
+        // Stamps jitter with thread scheduling; follow the sample count and slew gently
+        // towards the measured time, snapping only on real discontinuities.
+        if (tsNs >= 0) {
+            int64_t measuredEnd = tsNs + bytesToNs(len);
+            if (endTsNs < 0) {
+                endTsNs = measuredEnd;
+            } else {
+                int64_t expectedEnd = endTsNs + bytesToNs(len);
+                int64_t err = measuredEnd - expectedEnd;
+                endTsNs = (err > 100000000LL || err < -100000000LL) ? measuredEnd : expectedEnd + err / 32;
+            }
+        } else if (endTsNs >= 0) {
+            endTsNs += bytesToNs(len);
+        }
+    }
+
+    // Clock time just past the newest buffered byte (-1 = nothing stamped yet)
+    int64_t endTimestamp() { QMutexLocker lock(&mutex); return endTsNs; }
+
+    // Reads len bytes that start at clock time targetNs: stale data before the target is
+    // dropped, a gap before the first buffered byte is filled with silence.
+    // Returns the number of real (non-silent) bytes copied.
+    int readAt(uint8_t* dst, int len, int64_t targetNs, int64_t toleranceNs = 10000000LL) {
+        QMutexLocker lock(&mutex);
+        if (!data || len <= 0) return 0;
+        int padded = 0;
+        if (size > 0 && endTsNs >= 0 && bytesPerSec > 0) {
+            int64_t diff = (endTsNs - bytesToNs(size)) - targetNs;
+            if (diff < -toleranceNs) {
+                int drop = qMin(nsToBytes(-diff), size);
+                readPos = (readPos + drop) % capacity;
+                size -= drop;
+            } else if (diff > toleranceNs) {
+                padded = qMin(nsToBytes(diff), len);
+                memset(dst, 0, padded);
+            }
+        }
+        int n = qMin(len - padded, size);
+        for (int i=0; i<n; i++) {
+            dst[padded + i] = data[readPos];
+            readPos = (readPos + 1) % capacity;
+        }
+        size -= n;
+        if (padded + n < len) memset(dst + padded + n, 0, len - padded - n);
+        return n;
+    }
+
+    int read(uint8_t* dst, int len) {
+        QMutexLocker lock(&mutex);
+        if (!data || size <= 0 || len <= 0) return 0; // Check data validity
+        if (len > size) len = size; // allow partial read
+        for (int i=0; i<len; i++) {
+            dst[i] = data[readPos];
+            readPos = (readPos + 1) % capacity;
+        }
+        size -= len;
+        return len;
+    }
+
+    int available() { QMutexLocker lock(&mutex); return size; }
+    void clear() { QMutexLocker lock(&mutex); size = 0; writePos = 0; readPos = 0; endTsNs = -1; }
+};
+
+// Mixes any number of capture sources (microphones, loopback devices) into one
+// float stream on the recording's MediaClock.
+// Each source owns a ring in the mixer format (interleaved float at the mixer rate);
+// its resampler converts whatever the device delivers exactly once, on the capture
+// thread, and is skipped when the device already runs at the mixer rate. Writes are
+// stamped with the clock and shifted back by the source's latency offset (device
+// buffering the stamp can't see), so mix() can read every source at the same clock
+// time. Accumulation is SSE/AVX; a peak limiter with a slow release keeps the sum
+// below full scale instead of hard-clipping it.
+//
+// The mixer rate follows the devices: sources report their native format once their
+// device is open and lockSampleRate() picks the rate most of them share. Writes
+// before that are dropped.
+class AudioMixer {
+public:
+    enum Kind {
+        Loopback,   // System / application audio
+        Microphone
+    };
+
+    class Source {
+    public:
+        ~Source();
+
+        QString name() const { return m_name; }
+        Kind kind() const { return m_kind; }
+
+        // Format the device delivers (channelLayout 0 = default for the channel count).
+        // Called once, before the first write, by whoever opened the device.
+        bool setInputFormat(int sampleRate, int channels, AVSampleFormat fmt, uint64_t channelLayout = 0);
+        bool hasInputFormat() const;
+        int inputSampleRate() const;
+        // True when samples pass through without resampling
+        bool isNativeRate() const;
+        // One writer thread per source. tsNs: clock time of the first sample as the
+        // device stamped it (-1 = the block ends now).
+        void write(const uint8_t *const *data, int samples, int64_t tsNs = -1);
+        void writeInterleaved(const uint8_t *data, int bytes, int64_t tsNs = -1);
+
+        void setGain(double gain) { m_gain = (float)gain; }
+        double gain() const { return m_gain.load(); }
+        // Capture latency subtracted from every stamp
+        void setLatencyNs(int64_t ns) { m_latencyNs = ns; }
+        int64_t latencyNs() const { return m_latencyNs.load(); }
+        // Inactive sources are neither mixed nor waited for (device failed / closed)
+        void setActive(bool active) { m_active = active; }
+        bool isActive() const { return m_active.load(); }
+        // RMS of the last mixed block after gain, 0.0 - 1.0
+        double level() const { return m_level.load(); }
+
+    private:
+        friend class AudioMixer;
+        Source(AudioMixer *mixer, const QString &name, Kind kind);
+        // Sets up ring and resampler once both formats are known (m_formatMutex held)
+        bool configure();
+
+        AudioMixer *m_mixer;
+        QString m_name;
+        Kind m_kind;
+        AudioBuffer m_ring;          // Mixer format
+        mutable QMutex m_formatMutex; // Input format vs. lockSampleRate()
+        int m_inRate = 0;
+        int m_inChannels = 0;
+        AVSampleFormat m_inFmt = AV_SAMPLE_FMT_NONE;
+        uint64_t m_inLayout = 0;
+        int m_inFrameBytes = 0;      // Packed input: bytes per sample frame
+        std::atomic<bool> m_ready {false}; // Ring and resampler set up, writes accepted
+        // Capture thread only (after m_ready)
+        SwrContext *m_swr = nullptr; // nullptr = input already in the mixer format
+        std::vector<uint8_t> m_conv;
+        // Shared with the mixing thread
+        std::atomic<float> m_gain {1.0f};
+        std::atomic<int64_t> m_latencyNs {0};
+        std::atomic<bool> m_active {true};
+        std::atomic<float> m_level {0.0f};
+    };
+
+    // maxIsa caps the detected instruction set (audio_mixer_accuracy compares all paths)
+    explicit AudioMixer(ColorConverter::Isa maxIsa = ColorConverter::Avx2);
+    ~AudioMixer();
+
+    // Output channel count; ringSeconds of audio are kept per source
+    void init(const MediaClock *clock, int channels = 2, int ringSeconds = 30);
+    // Removes all sources (capture must have stopped)
+    void release();
+
+    // True once every active source knows its input format
+    bool formatsKnown() const;
+    // Fixes the output rate: the native rate shared by most active sources (ties: the
+    // higher one), 48 kHz when none has reported yet. allowedRates (0-terminated, like
+    // AVCodec::supported_samplerates) restricts the choice. Sources that report later
+    // resample to it.
+    int lockSampleRate(const int *allowedRates = nullptr);
+    int sampleRate() const { return m_sampleRate.load(); } // 0 until locked
+    int channels() const { return m_channels; }
+
+    // The returned source stays valid until release(). sampleRate 0 = format set later.
+    Source *addSource(const QString &name, Kind kind, int sampleRate, int channels, AVSampleFormat fmt,
+                      double gain = 1.0, int64_t latencyNs = 0);
+    int sourceCount() const;
+    Source *source(int index) const;
+    int activeSourceCount() const;
+
+    // Clock time up to which every active source has data (-1 = some source has none yet,
+    // INT64_MAX = no active source)
+    int64_t endTimestamp() const;
+    // Mixes the interval starting at clock time startNs into planar float channels.
+    // Returns false when no source contributed real samples (dst is silence).
+    bool mix(float *const *dst, int samples, int64_t startNs);
+    // Loudest source of a kind (metering)
+    double level(Kind kind) const;
+    // Current limiter gain (1.0 = not limiting)
+    double limiterGain() const { return m_limGain; }
+
+private:
+    const MediaClock *m_clock = nullptr;
+    std::atomic<int> m_sampleRate {0};
+    int m_channels = 2;
+    int m_ringSeconds = 30;
+    ColorConverter::Isa m_isa = ColorConverter::Scalar; // Kernel selection (shared CPU detection)
+    float m_limGain = 1.0f;
+    std::vector<float> m_acc;
+    std::vector<float> m_scratch;
+    std::vector<std::unique_ptr<Source>> m_sources;
+    mutable QMutex m_mutex;
+};
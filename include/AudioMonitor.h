@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QString>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#define SDL_MAIN_HANDLED // Prevent SDL from hijacking main
+#include <SDL.h>
+}
+
+// Plays a microphone back to the presenter while recording.
+// The capture callback pushes the raw device samples into a lock-free single-producer /
+// single-consumer ring and the SDL playback callback pulls them in the same format, so
+// nothing is converted or locked on the way. The ring is held to one capture block plus
+// one playback block: when it runs fuller (the two device clocks drift) the playback
+// side skips the oldest samples instead of letting the delay grow.
+class AudioMonitor {
+public:
+    struct Stats {
+        double queueMs = 0.0;     // Average time samples wait in the ring
+        // Estimate, not a measurement: one capture block + average queue wait + one playback
+        // buffer. Device, driver and mixer latency on either side is not included.
+        double bufferDelayMs = 0.0;
+        qint64 underruns = 0;     // Playback callbacks that ran out of samples
+        qint64 droppedMs = 0;     // Audio skipped to keep the delay bounded
+    };
+
+    AudioMonitor();
+    ~AudioMonitor();
+
+    // capture: the spec the microphone was opened with (obtained). deviceName: playback
+    // device keyword, empty = default output. The output opens paused; start() plays it.
+    bool open(const SDL_AudioSpec &capture, const QString &deviceName = QString());
+    void start();
+    void close();
+    bool isOpen() const { return m_dev > 0; }
+    QString errorString() const { return m_error; }
+
+    // Capture callback side: never blocks or allocates
+    void push(const uint8_t *data, int bytes);
+
+    Stats stats() const;
+    // Delay the monitor adds on paper (ring bound + playback buffer)
+    double maxAddedMs() const;
+
+private:
+    static void playbackCallback(void *userdata, Uint8 *stream, int len);
+    void pull(uint8_t *out, int bytes);
+
+    SDL_AudioDeviceID m_dev = 0;
+    std::vector<uint8_t> m_ring;   // Power-of-two size
+    uint64_t m_mask = 0;
+    int m_frameBytes = 0;
+    int m_bytesPerSec = 0;
+    int m_maxFillBytes = 0;        // Bound on queued audio
+    uint8_t m_silence = 0;
+    int64_t m_capturePeriodNs = 0;
+    int64_t m_playbackPeriodNs = 0;
+    QString m_error;
+
+    std::atomic<uint64_t> m_writePos {0};
+    std::atomic<uint64_t> m_readPos {0};
+    std::atomic<int64_t> m_lastPushNs {-1};  // Arrival of the newest block
+    std::atomic<int64_t> m_queueNs {0};      // Smoothed by the playback callback
+    std::atomic<qint64> m_underruns {0};
+    std::atomic<qint64> m_droppedBytes {0};
+};
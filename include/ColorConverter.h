@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+// Packed 32-bit RGB (gdigrab BGRA, x11grab BGR0, ...) -> planar YUV, BT.709 limited range.
+// Targets YUV420P (2x2 chroma average) and YUV444P (no chroma subsampling).
+// Replaces the generic sws_scale path for same-size screen frames. The kernel uses
+// 14-bit fixed point; the SSE2/AVX2 paths compute exactly the same integers as the
+// scalar reference, so the output does not depend on the CPU. Large frames are split
+// into row bands converted in parallel.
+//
+// When the capture backend reports which rows changed (X11 damage capture), only those
+// rows are converted; the destination frame must then still hold the previous output.
+struct RowSpan {
+    int first; // First changed row
+    int last;  // One past the last changed row
+};
+
+class ColorConverter {
+public:
+    enum Isa { Scalar, Sse2, Avx2 };
+
+    ColorConverter();
+    ~ColorConverter();
+
+    // True when src -> dst can be handled without swscale (same size, even dimensions)
+    static bool supports(AVPixelFormat srcFmt, int srcW, int srcH, AVPixelFormat dstFmt, int dstW, int dstH);
+    static Isa detectIsa();
+    static const char *isaName(Isa isa);
+
+    // (Re)configures for a geometry; threads = 0 picks a band count from the frame size.
+    // maxIsa caps the detected instruction set (the bench compares all paths on one CPU).
+    // Returns false when the conversion is not supported (caller falls back to swscale).
+    bool init(int width, int height, AVPixelFormat srcFmt, AVPixelFormat dstFmt, int threads = 0,
+              Isa maxIsa = Avx2);
+    // dirtyRows: rows of src that changed since the previous call into the same dst
+    // (nullptr = convert everything).
+    void convert(const AVFrame *src, AVFrame *dst, const std::vector<RowSpan> *dirtyRows = nullptr);
+
+    Isa isa() const { return m_isa; }
+    int bandCount() const { return m_bands; }
+
+private:
+    struct Job {
+        const uint8_t *src = nullptr;
+        int srcStride = 0;
+        uint8_t *dst[3] = { nullptr, nullptr, nullptr };
+        int dstStride[3] = { 0, 0, 0 };
+        const uint8_t *rowMask = nullptr; // Per source row, 0 = unchanged (nullptr = all rows)
+    };
+
+    void convertBand(const Job &job, int band) const;
+    void convertBand444(const Job &job, int band) const;
+    void workerFunc(int band);
+    void stopWorkers();
+
+    int m_width = 0;
+    int m_height = 0;
+    bool m_rgbOrder = false; // Byte 0 is R (RGBA/RGB0) instead of B
+    bool m_444 = false;      // Full-resolution chroma
+    Isa m_isa = Scalar;
+    int m_bands = 1;
+    std::vector<uint8_t> m_rowMask;
+
+    // Band workers: band 0 runs on the caller's thread
+    std::vector<QThread*> m_workers;
+    QMutex m_mutex;
+    QWaitCondition m_condStart;
+    QWaitCondition m_condDone;
+    Job m_job;
+    quint64 m_generation = 0;
+    int m_pending = 0;
+    bool m_quit = false;
+};
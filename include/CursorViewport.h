@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QRect>
+#include <QPoint>
+#include <cstdint>
+
+// Fixed-size crop window that follows the mouse over a large capture area.
+// The cursor moves freely inside a centred dead zone; once it leaves, the viewport
+// eases towards it with a short time constant, so small movements don't shake the
+// picture and large ones don't jump. The rect always stays inside the frame and on
+// even coordinates so 4:2:0 chroma siting doesn't shift between frames.
+class CursorViewport {
+public:
+    // viewW/viewH are clamped to the frame and rounded down to even
+    void reset(int frameW, int frameH, int viewW, int viewH);
+    // cursor: position in frame coordinates; nowNs: MediaClock time of the frame
+    QRect update(const QPoint &cursor, int64_t nowNs);
+
+    QRect rect() const { return m_rect; }
+    int frameWidth() const { return m_frameW; }
+    int frameHeight() const { return m_frameH; }
+
+private:
+    int m_frameW = 0;
+    int m_frameH = 0;
+    int m_viewW = 0;
+    int m_viewH = 0;
+    double m_cx = 0.0;      // Current viewport centre
+    double m_cy = 0.0;
+    int64_t m_lastNs = -1;  // -1 = first frame jumps straight to the cursor
+    QRect m_rect;
+};
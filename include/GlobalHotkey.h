@@ -14,7 +14,8 @@ class GlobalHotkey : public QObject, public QAbstractNativeEventFilter {
 public:
     enum HotkeyId {
         ShowMainWindow = 1,
-        StartStopRecording = 2
+        StartStopRecording = 2,
+        AddMarker = 3           // Registered only while recording
     };
     
     static GlobalHotkey* instance();
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+
+class QTcpSocket;
+
+// Minimal HTTP/1.0 file server for the live HLS preview.
+// Serves the playlist and fMP4 segments the "hls" MuxerSink writes into one directory,
+// nothing else: flat file names only, GET and HEAD, one request per connection.
+// Runs on the thread that starts it (the UI thread); files are small and read whole.
+class HlsServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit HlsServer(QObject *parent = nullptr);
+    ~HlsServer();
+
+    // lan: listen on all interfaces instead of localhost only
+    bool start(const QString &dir, quint16 port, bool lan);
+    void stop();
+    bool isRunning() const { return m_server.isListening(); }
+    QString errorString() const { return m_server.errorString(); }
+    // Playlist URL for players on this machine
+    QString playlistUrl() const;
+
+    static const char *kPlaylistName; // "live.m3u8"
+
+private slots:
+    void onNewConnection();
+
+private:
+    void handleRequest(QTcpSocket *socket);
+    void reply(QTcpSocket *socket, int status, const QByteArray &reason, const QByteArray &contentType,
+               const QByteArray &body, bool headOnly);
+
+    QTcpServer m_server;
+    QString m_dir;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QObject>
+#include <QMutex>
+#include <atomic>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// One-slot mailbox between the record loop and a live monitor.
+// offer() takes a reference to the converted picture (no pixel copy) at most once per
+// display interval, and only when the previous one has been taken: the monitor never
+// holds up the encoder, it just sees fewer frames. frameAvailable() is emitted from the
+// record thread; connect it queued and call take() on the receiving side.
+class LiveFrameTap : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LiveFrameTap(QObject *parent = nullptr);
+    ~LiveFrameTap();
+
+    // intervalMs: minimum spacing between offered frames (the display's refresh period)
+    void setActive(bool active, int intervalMs = 16);
+    bool isActive() const { return m_active.load(); }
+
+    // Record loop side; timeNs on any monotonic clock
+    void offer(const AVFrame *frame, int64_t timeNs);
+    // Monitor side: the pending frame (caller frees it), or nullptr
+    AVFrame *take();
+
+    qint64 skippedFrames() const { return m_skipped.load(); }
+
+signals:
+    void frameAvailable();
+
+private:
+    QMutex m_mutex;
+    AVFrame *m_pending = nullptr;
+    std::atomic<bool> m_active {false};
+    std::atomic<int64_t> m_intervalNs {16000000};
+    int64_t m_lastOfferNs = INT64_MIN; // Record thread only
+    std::atomic<qint64> m_skipped {0};
+};
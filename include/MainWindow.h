@@ -26,6 +26,7 @@
 #include "SelectionOverlay.h"
 #include "CountdownOverlay.h"
 #include "VideoUtils.h"
+#include "RecordingIndex.h"
 #include "FloatingBall.h"
 #include "RangeSlider.h" 
 #include "NativePlayerWidget.h"
@@ -98,6 +99,7 @@ private slots:
     void updateAudioLevels(double sys, double mic);
     void onHotkeyTriggered(int id);
     void registerHotkeys(); 
+    void registerMarkerHotkey(bool enable);
 
 public slots:
     void loadVideo(const QString &path, qint64 durationMs = 0);
@@ -121,6 +123,7 @@ private:
     void loadSettings();
     void saveSettings();
     void startRecordingInternal(); // Internal function to start recording after countdown
+    void configureRecorder();      // Push region/audio/fps to the recorder
     void updateMaximizeButton(); 
     
     // Helpers
@@ -191,6 +194,7 @@ private:
     qint64 m_currentDuration; 
     qint64 m_currentPosition; 
     qint64 m_totalDuration;
+    RecordingIndex m_index; // Sidecar of the loaded file, if it has one
     
     bool m_isPlaying;
 };
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/rational.h>
+#include <libavutil/mathematics.h>
+}
+
+// Shared monotonic nanosecond clock for one recording.
+// Every source stamps its data with this clock at acquisition; conversion to
+// stream time bases happens only through toStreamTs()/fromStreamTs().
+class MediaClock {
+public:
+    // Maps a device's own timestamps (e.g. gdigrab/dshow packet pts) onto the clock.
+    // The first timestamp is anchored to its acquisition time; later ones follow the
+    // device clock, which is steadier than our wake-up time. A jump larger than
+    // maxSkewNs (device clock reset, wall clock change) re-anchors.
+    struct DeviceAnchor {
+        int64_t offsetNs = INT64_MIN;
+        void reset() { offsetNs = INT64_MIN; }
+    };
+
+    static int64_t monotonicNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void start() { m_startNs = monotonicNs(); }
+    void reset() { m_startNs = -1; }
+    bool isStarted() const { return m_startNs.load() >= 0; }
+    // Nanoseconds since start()
+    int64_t nowNs() const { return isStarted() ? monotonicNs() - m_startNs.load() : 0; }
+
+    int64_t mapDeviceTs(DeviceAnchor &anchor, int64_t ts, AVRational tb, int64_t acquiredNs,
+                        int64_t maxSkewNs = 200000000LL) const {
+        if (ts == AV_NOPTS_VALUE) return acquiredNs;
+        int64_t devNs = av_rescale_q(ts, tb, AVRational{1, 1000000000});
+        if (anchor.offsetNs == INT64_MIN) anchor.offsetNs = acquiredNs - devNs;
+        int64_t mapped = devNs + anchor.offsetNs;
+        int64_t skew = mapped - acquiredNs;
+        if (skew > maxSkewNs || skew < -maxSkewNs) {
+            anchor.offsetNs = acquiredNs - devNs;
+            mapped = acquiredNs;
+        }
+        return mapped;
+    }
+
+    // Clock (ns) -> stream timestamp, rounded to nearest
+    static int64_t toStreamTs(int64_t clockNs, AVRational tb) {
+        return av_rescale_q_rnd(clockNs, AVRational{1, 1000000000}, tb,
+                                (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
+    }
+    static int64_t fromStreamTs(int64_t ts, AVRational tb) {
+        return av_rescale_q(ts, tb, AVRational{1, 1000000000});
+    }
+
+private:
+    std::atomic<int64_t> m_startNs {-1};
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QString>
+#include <QMap>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <atomic>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+// Extra output for the packets the recorder already encodes (tee-style).
+// The record loop hands every packet to push(), which only takes a reference and never
+// blocks; a writer thread owns the muxer, connects, writes and closes. Each sink has its
+// own bounded queue: when a slow or stalled network lets it overflow, the queued packets
+// are dropped and the sink resumes at the next video keyframe. The file output and any
+// other sink keep going at full speed.
+class MuxerSink {
+public:
+    enum StreamKind { Video = 0, Audio = 1 };
+
+    struct Stats {
+        qint64 packets = 0;     // Packets written to the muxer
+        qint64 dropped = 0;     // Packets discarded by backpressure
+        qint64 bytes = 0;       // Payload bytes written
+        qint64 queuedBytes = 0; // Payload waiting for the writer thread
+    };
+
+    MuxerSink();
+    ~MuxerSink();
+
+    // Starts the writer thread, which opens url and writes the header; returns at once.
+    // format: muxer name (empty = formatFor(url)); options: muxer and protocol options.
+    // video/audio: the encoders whose packets push() receives (audio may be nullptr).
+    bool open(const QString &url, const QString &format, const QMap<QString, QString> &options,
+              const AVCodecContext *video, const AVCodecContext *audio);
+    // Sends what is queued and writes the trailer; gives up on the network after timeoutMs
+    void close(int timeoutMs = kCloseTimeoutMs);
+    bool isOpen() const { return m_thread != nullptr; }
+    bool hasFailed() const { return m_failed.load(); }
+    QString errorString() const;
+    QString url() const { return m_url; }
+    Stats stats() const;
+
+    // Record loop side; pkt timestamps in tb
+    void push(const AVPacket *pkt, AVRational tb, StreamKind kind);
+
+    // Muxer for a live URL: FLV for RTMP, MPEG-TS for SRT / UDP / TCP
+    static QString formatFor(const QString &url);
+    // FFmpeg URL for a local consumer: "-" / "stdout", "unix:/path" (we listen, the
+    // consumer connects), a FIFO or a Windows named pipe (\\.\pipe\name) that a reader
+    // already has open. Fills options for the protocol; empty on error.
+    static QString pipeUrlFor(const QString &target, QMap<QString, QString> *options, QString *error);
+
+    static const qint64 kMaxQueuedBytes = 8 * 1024 * 1024; // A few seconds at the recording bitrate
+    static const int kCloseTimeoutMs = 3000;
+
+private:
+    struct Item {
+        AVPacket *pkt;
+        AVRational tb;
+        StreamKind kind;
+    };
+
+    void threadFunc();
+    bool openOutput();
+    void setError(const QString &msg);
+    void clearQueue(); // Caller holds m_mutex
+    static int interruptCallback(void *opaque);
+
+    QString m_url;
+    QString m_format;
+    QMap<QString, QString> m_options;
+    AVCodecParameters *m_videoPar = nullptr;
+    AVCodecParameters *m_audioPar = nullptr;
+    AVRational m_videoTb = {1, 90000};
+    AVRational m_audioTb = {1, 48000};
+
+    AVFormatContext *m_fmtCtx = nullptr; // Writer thread only
+    int m_streamIndex[2] = { -1, -1 };
+
+    QThread *m_thread = nullptr;
+    mutable QMutex m_mutex;       // Queue, flags and m_error
+    QWaitCondition m_cond;
+    std::deque<Item> m_queue;
+    qint64 m_queuedBytes = 0;
+    bool m_waitKeyframe = true;   // Start, and restart after a drop, on a video keyframe
+    bool m_stop = false;
+    QString m_error;
+    std::atomic<bool> m_failed {false};
+    std::atomic<bool> m_abort {false}; // Interrupts blocking network I/O
+    std::atomic<qint64> m_packets {0};
+    std::atomic<qint64> m_dropped {0};
+    std::atomic<qint64> m_bytes {0};
+};
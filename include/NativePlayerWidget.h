@@ -8,8 +8,11 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QSemaphore> // Added
+#include <QPointer>
 #include <deque>
 #include <atomic>
+#include "RecordingIndex.h"
+#include "LiveFrameTap.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -22,6 +25,18 @@ extern "C" {
 #include <SDL.h>
 }
 
+// Decoded picture handed from the decode threads to the GL thread.
+// Planes are tightly packed: Y, then U, then V.
+struct PlayerFrame {
+    QByteArray data;
+    int width = 0;
+    int height = 0;
+    bool chroma444 = false; // U/V at full resolution (otherwise 2x2 subsampled)
+    bool bt709 = false;     // Otherwise BT.601 (untagged files from older versions)
+    bool fullRange = false;
+};
+Q_DECLARE_METATYPE(PlayerFrame)
+
 struct PacketQueue {
     std::deque<AVPacket> queue;
     int size = 0;
@@ -47,11 +62,15 @@ public:
     void seek(const QString &filePath, qint64 ms); // Seek and show single frame
     void stopPlay();
     bool isPlaying() const { return m_isRunning; }
+    // Live monitor: shows frames from tap at display rate until stopLive() or startPlay()
+    void startLive(LiveFrameTap *tap);
+    void stopLive();
+    bool isLive() const { return !m_liveTap.isNull(); }
 
 signals:
     void playbackFinished();
     void positionChanged(qint64 ms);
-    void frameReady(const QByteArray &data, int width, int height);
+    void frameReady(const PlayerFrame &frame);
     void previewImageReady(const QImage &img);
     void logMessage(const QString &msg);
     void errorOccurred(const QString &err);
@@ -62,13 +81,15 @@ protected:
     void resizeGL(int w, int h) override;
 
 private slots:
-    void onFrameReady(const QByteArray &data, int width, int height);
+    void onFrameReady(const PlayerFrame &frame);
+    void onLiveFrame();
 
 private:
     void readThreadFunc();
     void videoThreadFunc();
     static void sdlAudioCallback(void *opaque, Uint8 *stream, int len); // New
     void freeResources();
+    void uploadPlane(QOpenGLTexture *tex, int unit, int w, int h, const uint8_t *data, int stride);
     void freePreviewResources();
     double getAudioClock();
 
@@ -83,6 +104,7 @@ private:
     AVCodecContext *m_previewCodecCtx = nullptr;
     SwsContext *m_previewSwsCtx = nullptr;
     int m_previewStreamIdx = -1;
+    RecordingIndex m_previewIndex; // Sidecar of m_currentOpenPath (invalid for proxies / other files)
     
     // Preview Threading
     QThread *m_previewThread = nullptr;
@@ -129,13 +151,13 @@ private:
     GLuint m_texYLoc = 0;
     GLuint m_texULoc = 0;
     GLuint m_texVLoc = 0;
+    GLuint m_colorMatrixLoc = 0;
+    GLuint m_colorOffsetLoc = 0;
 
-    QByteArray m_currentYUV;
-    int m_videoW = 0;
-    int m_videoH = 0;
+    PlayerFrame m_currentFrame;
+    QPointer<LiveFrameTap> m_liveTap; // Owned by the recorder
+    bool m_liveUploaded = false; // Textures hold a live frame; m_currentFrame has its size only
 
-    // CPU preview conversion (YUV420P -> BGRA), for reliable scrubbing display via QLabel
+    // CPU preview conversion (YUV -> BGRA), for reliable scrubbing display via QLabel
     SwsContext *m_rgbSwsCtx = nullptr;
-    int m_rgbW = 0;
-    int m_rgbH = 0;
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QString>
+#include <QRect>
+#include <QThread>
+#include <QMutex>
+#include <atomic>
+#include <vector>
+#include "ColorConverter.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// Picture-in-picture: a second video source (camera, another screen region, a lavfi
+// test pattern) blended into a corner of the recording before it is encoded.
+// A side thread reads and decodes the source at its own rate and scales each picture
+// straight to the inset size in the recording's YUV format; the record loop blends the
+// latest one into its converted frame, so there is still a single encode. Blending uses
+// a per-pixel alpha plane (rounded corners x opacity); the SSE2/AVX2 rows produce the
+// same bytes as the scalar reference.
+class PipCompositor {
+public:
+    enum Corner { BottomRight = 0, BottomLeft, TopRight, TopLeft };
+
+    PipCompositor();
+    ~PipCompositor();
+
+    // source: "format:device" (dshow:video=..., v4l2:/dev/video0, lavfi:testsrc2=...) or a
+    // URL / file; options: "key=value,..." input options (video_size, framerate, ...).
+    // frameW/frameH/fmt: the converted frames blend() receives (YUV420P or YUV444P).
+    // maxIsa caps the detected instruction set (pip_blend_accuracy compares all paths).
+    bool open(const QString &source, const QString &options, int frameW, int frameH, AVPixelFormat fmt,
+              Corner corner, int scalePercent, int opacityPercent,
+              ColorConverter::Isa maxIsa = ColorConverter::Avx2);
+    void close();
+    bool isOpen() const { return m_thread != nullptr; }
+    QString errorString() const { return m_error; }
+    QRect rect() const { return m_rect; } // Inset position in the frame (even-aligned)
+    ColorConverter::Isa isa() const { return m_isa; }
+    qint64 sourceFrames() const { return m_sourceFrames.load(); }
+
+    // Record loop: blends the latest source picture into frame (nothing until the first arrives)
+    void blend(AVFrame *frame);
+
+    static const int kMargin = 16; // Distance from the frame edges
+
+private:
+    void threadFunc();
+    void buildAlpha(int opacityPercent);
+    void freeAll();
+
+    AVFormatContext *m_fmtCtx = nullptr;
+    AVCodecContext *m_decCtx = nullptr;
+    SwsContext *m_swsCtx = nullptr;
+    int m_streamIdx = -1;
+    AVPixelFormat m_fmt = AV_PIX_FMT_YUV420P;
+    QRect m_rect;
+    int m_chromaShift = 1;            // 0 for 4:4:4
+    std::vector<uint8_t> m_alphaY;    // m_rect.width() x m_rect.height()
+    std::vector<uint8_t> m_alphaC;    // Chroma-sized
+    ColorConverter::Isa m_isa = ColorConverter::Scalar;
+    QString m_error;
+
+    QThread *m_thread = nullptr;
+    std::atomic<bool> m_stop {false};
+    QMutex m_mutex;                   // m_latest
+    AVFrame *m_latest = nullptr;      // Scaled, ready to blend
+    std::atomic<qint64> m_sourceFrames {0};
+};
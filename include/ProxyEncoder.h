@@ -0,0 +1,79 @@
+#pragma once
+
+#include "RecordingIndex.h"
+#include <QString>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <atomic>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// Low-resolution companion file written next to the recording (see VideoUtils::proxyPathFor).
+// The record loop hands every encoded-size frame over by reference; a side thread scales
+// it down and encodes it with a short GOP, so the player can seek and scrub a 4K
+// recording by decoding a few small frames. The master's AAC packets are muxed in as
+// they are, which keeps playback of the proxy in sync without a second audio encode.
+// When the side thread falls behind, proxy frames are dropped, never capture frames.
+// The proxy gets its own .msrindex: the player opens the proxy, and its keyframes are not
+// the master's.
+class ProxyEncoder {
+public:
+    struct Stats {
+        qint64 frames = 0;   // Frames encoded into the proxy
+        qint64 dropped = 0;  // Frames skipped because the side thread was busy
+    };
+
+    ProxyEncoder();
+    ~ProxyEncoder();
+
+    // srcW/srcH/srcFmt: the frames pushVideo() receives, PTS in timeBase.
+    // audio: the master's audio encoder (nullptr = no audio track).
+    bool open(const QString &path, int srcW, int srcH, AVPixelFormat srcFmt, AVRational timeBase,
+              AVRational frameRate, const AVCodecContext *audio);
+    // Flushes the encoder and writes the trailer
+    void close();
+    bool isOpen() const { return m_fmtCtx != nullptr; }
+    QString errorString() const { return m_error; }
+    Stats stats() const;
+
+    // Record loop side: takes a reference, never copies or blocks
+    void pushVideo(const AVFrame *frame);
+    // Encoded master audio, timestamps in tb
+    void writeAudio(const AVPacket *pkt, AVRational tb);
+
+    static const int kHeight = 480;
+    static const int kGopFrames = 10; // Worst case seek: decode 9 small frames
+
+private:
+    void threadFunc();
+    void encode(AVFrame *frame); // nullptr = flush
+    void freeAll();
+
+    AVFormatContext *m_fmtCtx = nullptr;
+    AVCodecContext *m_encCtx = nullptr;
+    SwsContext *m_swsCtx = nullptr;
+    AVFrame *m_scaled = nullptr;
+    RecordingIndex m_index;     // Filled by the side thread, saved by close()
+    AVStream *m_vStream = nullptr;
+    AVStream *m_aStream = nullptr;
+    AVRational m_srcTimeBase = {1, 90000};
+    QString m_path;             // Final name; written as m_path + ".part"
+    QString m_error;
+
+    QThread *m_thread = nullptr;
+    QMutex m_mutex;             // Queue and m_stop
+    QWaitCondition m_cond;
+    std::deque<AVFrame*> m_queue;
+    bool m_stop = false;
+    QMutex m_muxMutex;          // The muxer is fed from both threads
+    std::atomic<qint64> m_frames {0};
+    std::atomic<qint64> m_dropped {0};
+
+    static const int kMaxQueued = 2;
+};
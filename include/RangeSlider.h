@@ -3,6 +3,7 @@
 #include <QWidget>
 #include <QPainter>
 #include <QMouseEvent>
+#include <QVector>
 
 class RangeSlider : public QWidget {
     Q_OBJECT
@@ -14,6 +15,10 @@ public:
     void setValues(int lower, int upper);
     void setPlaybackValue(int value); // -1 to disable
     int playbackValue() const { return m_playbackVal; }
+    // Recording markers: drawn as ticks, handles snap to them
+    void setMarkers(const QList<int> &values);
+    // Audio peaks (0..255) spread evenly from minimum() to endValue, drawn behind the groove
+    void setWaveform(const QVector<quint8> &peaks, int endValue);
     
     int minimum() const { return m_min; }
     int maximum() const { return m_max; }
@@ -35,12 +40,16 @@ private:
     int valToPos(int val) const;
     int posToVal(int pos) const;
     void drawHandle(QPainter &p, int val, bool highlight);
+    int snapToMarker(int val) const;
 
     int m_min = 0;
     int m_max = 100;
     int m_pos1 = 0;
     int m_pos2 = 100;
     int m_playbackVal = -1; // Added
+    QList<int> m_markers;
+    QVector<quint8> m_peaks;
+    int m_peaksEnd = 0;
     
     int m_handleWidth = 16;
     int m_margin = 10;
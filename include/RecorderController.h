@@ -7,9 +7,25 @@
 #include <QThread>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QTimer>
 #include <atomic>
 #include <QAudioInput>
 #include <QIODevice>
+#include "AsyncFileWriter.h"
+#include "StorageMonitor.h"
+#include "MediaClock.h"
+#include "ColorConverter.h"
+#include "CursorViewport.h"
+#include "AudioMixer.h"
+#include "AudioMonitor.h"
+#include "ProxyEncoder.h"
+#include "RecordingIndex.h"
+#include "MuxerSink.h"
+#include "HlsServer.h"
+#include "LiveFrameTap.h"
+#include "PipCompositor.h"
+#include "VideoFilterGraph.h"
+#include "VideoEncoderPreset.h"
 
 extern "C" {
 #include <libavdevice/avdevice.h>
@@ -19,71 +35,30 @@ extern "C" {
 #include <libswresample/swresample.h>
 #include <libavutil/time.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/opt.h>
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 }
 
-// Simple Ring Buffer for Audio
-struct AudioBuffer {
-    uint8_t *data = nullptr;
-    int size = 0;
-    int writePos = 0;
-    int readPos = 0;
-    int capacity = 0;
-    QMutex mutex;
-
-    void init(int cap) {
-        capacity = cap;
-        data = (uint8_t*)av_malloc(capacity);
-        size = 0; writePos = 0; readPos = 0;
-    }
-    void free() { if(data) av_free(data); data = nullptr; }
-    
-    void write(const uint8_t* src, int len) {
-        QMutexLocker lock(&mutex);
-        if (!data || len <= 0) return;
-        // If overflow, drop oldest data to keep latest audio
-        if (size + len > capacity) {
-            int drop = (size + len) - capacity;
-            readPos = (readPos + drop) % capacity;
-            size -= drop;
-            if (size < 0) size = 0;
-        }
-        for (int i=0; i<len; i++) {
-            data[writePos] = src[i];
-            writePos = (writePos + 1) % capacity;
-        }
-        size += len;
-    }
-    
-    int read(uint8_t* dst, int len) {
-        QMutexLocker lock(&mutex);
-        if (!data || size <= 0 || len <= 0) return 0; // Check data validity
-        if (len > size) len = size; // allow partial read
-        for (int i=0; i<len; i++) {
-            dst[i] = data[readPos];
-            readPos = (readPos + 1) % capacity;
-        }
-        size -= len;
-        return len;
-    }
-    
-    int available() { QMutexLocker lock(&mutex); return size; }
-    void clear() { QMutexLocker lock(&mutex); size = 0; writePos = 0; readPos = 0; }
+// SDL capture callback context: mixer source plus optional monitor tap
+struct MicCapture {
+    AudioMixer::Source *source = nullptr;
+    std::atomic<AudioMonitor*> monitor {nullptr}; // Attached by startRecording(), detached by disarm()
 };
 
 // Adapter for QAudioInput
 class AudioWrapper : public QIODevice {
     Q_OBJECT
 public:
-    AudioWrapper(AudioBuffer *buf, QObject *parent) : QIODevice(parent), m_buf(buf) {}
+    AudioWrapper(AudioMixer::Source *source, QObject *parent) : QIODevice(parent), m_source(source) {}
     qint64 readData(char *, qint64) override { return 0; }
     qint64 writeData(const char *data, qint64 len) override {
-        if (m_buf) m_buf->write((const uint8_t*)data, (int)len);
+        if (m_source) m_source->writeInterleaved((const uint8_t*)data, (int)len);
         return len;
     }
 private:
-    AudioBuffer *m_buf;
+    AudioMixer::Source *m_source;
 };
 
 class RecorderController : public QObject {
@@ -93,7 +68,9 @@ public:
     enum State {
         Stopped,
         Recording,
-        Paused
+        Paused,
+        Armed,      // Devices and encoders open, waiting for the start trigger
+        Finalizing  // Stopped; encoders flushing and trailer being written in the background
     };
 
     explicit RecorderController(QObject *parent = nullptr);
@@ -102,15 +79,28 @@ public:
     State state() const { return m_state; }
     
     void setRegion(const QRect &rect);
+    void setWindow(quintptr window); // Window the region snapped to (0 = none)
     void setAudioConfig(bool recordSys, double sysVol, bool recordMic, double micVol);
     void setFps(int fps); // Set recording frame rate
+    // A/V sync harness: synthetic flash / beep sources replace the screen and audio
+    // devices (see SyncAnalyzer). Applies from the next armRecording().
+    void setSyncTest(bool enabled) { m_syncTest = enabled; }
     bool checkSystemAudioAvailable(); // Pre-check and register if needed
 
     qint64 getDuration() const;
+    AsyncFileWriter::Stats writerStats() const { return m_fileWriter.stats(); } // Output I/O metrics
+    LiveFrameTap *liveTap() { return &m_liveTap; } // Converted frames for a live monitor
 
 public slots:
-    void startRecording();
-    void stopRecording();
+    void armRecording();    // Pre-open capture, audio and encoders so start is instant
+    void startRecording();  // Starts on this call; arms first if not armed
+    void stopRecording();   // Also disarms. Returns at once, recordingFinished follows
+    void disarm();          // Cancels an armed recording and waits for the devices to close
+    void waitForFinalize(); // Blocks until a pending stop has completed
+    void addMarker();       // Keyframe + MP4 chapter at the current time (while recording)
+
+private slots:
+    void onFinalized(bool started);
 
 signals:
     void stateChanged(State newState);
@@ -119,8 +109,12 @@ signals:
     void logMessage(const QString &msg);
     void audioLevelsCalculated(double sysLevel, double micLevel); // 0.0 - 1.0 (RMS)
     void systemAudioMissing(); // New Signal
+    void storageWarning(const QString &msg); // Low disk space / slow volume
+    void markerAdded(qint64 ms); // Marker placed at ms into the recording (worker thread)
 
 private:
+    QString makeOutputPath();
+    QString makeSyncTestPath(); // Temp directory, not savePath
     QString getFFmpegPath(); 
     bool probeAudioDevice(const QString& deviceName); 
     
@@ -128,30 +122,43 @@ private:
 
     // Native FFmpeg Members
     void recordThreadFunc();
-    void sysAudioThreadFunc();
-    std::atomic<bool> m_isRecording;
+    void sysAudioThreadFunc(AudioMixer::Source *source, const QString &device);
+    std::atomic<bool> m_isRecording;       // Worker alive (armed or recording)
+    std::atomic<bool> m_startTriggered {false};
+    std::atomic<int64_t> m_startRequestNs {-1}; // Clock time of the start trigger
+    std::atomic<quint64> m_cursorPos {0};  // GUI thread's cursor sample for the worker (x << 32 | y)
+    QTimer *m_cursorTimer = nullptr;       // Refreshes m_cursorPos in viewport mode (not on Windows)
     std::atomic<bool> m_isSysAudioRunning;
     QThread *m_recordThread = nullptr;
-    QThread *m_sysAudioThread = nullptr;
+    std::vector<QThread*> m_sysAudioThreads; // One per loopback source
+    QThread *m_finalizeThread = nullptr; // Joins the workers after stop
     
     // FFmpeg Contexts
     AVFormatContext *m_outFmtCtx = nullptr;
+    AsyncFileWriter m_fileWriter; // Write-behind AVIO for m_outFmtCtx
+    ProxyEncoder m_proxy;         // Low-resolution copy for scrubbing, fed from the record loop
+    PipCompositor m_pip;          // Second source blended into the converted frames
+    VideoFilterGraph m_videoGraph; // Optional libavfilter chain between conversion and encoder
+    RecordingIndex m_index;       // Sidecar written next to the file (keyframes, frame times, peaks)
+    std::vector<std::unique_ptr<MuxerSink>> m_sinks; // Live outputs fed the same encoded packets
+    LiveFrameTap m_liveTap;       // References to converted frames for the in-app monitor
+    HlsServer m_hlsServer;        // Serves the HLS preview sink's directory (UI thread)
+    StorageMonitor m_storage;     // Free space / throughput watchdog for m_fileWriter
     AVFormatContext *m_vInFmtCtx = nullptr;
-    AVFormatContext *m_aSysInFmtCtx = nullptr;
     
     AVCodecContext *m_vEncCtx = nullptr;
     AVCodecContext *m_aEncCtx = nullptr;
-    AVCodecContext *m_aSysDecCtx = nullptr;
     
-    SwsContext *m_swsCtx = nullptr;
-    SwrContext *m_swrMicCtx = nullptr;
-    SwrContext *m_swrSysCtx = nullptr;
+    SwsContext *m_swsCtx = nullptr;   // Fallback for formats/sizes ColorConverter can't handle
+    ColorConverter m_colorConv;       // Fast BGRA -> YUV path for screen frames
     
     // Audio Capture Members
     SDL_AudioDeviceID m_devSys = 0;
-    SDL_AudioDeviceID m_devMic = 0;
-    AudioBuffer m_bufSys;
-    AudioBuffer m_bufMic;
+    std::vector<SDL_AudioDeviceID> m_devMics;
+    std::vector<std::unique_ptr<MicCapture>> m_micCaptures; // Callback contexts for m_devMics
+    AudioMonitor m_micMonitor; // Plays the first microphone back while recording
+    MicCapture *m_monitorCapture = nullptr; // The microphone m_micMonitor plays, once open
+    AudioMixer m_mixer; // Every capture source feeds one ring here
     
     // Qt Audio Fallback
     QAudioInput *m_qtAudioSys = nullptr;
@@ -161,12 +168,42 @@ private:
 
     // Config
     QRect m_recordRegion;
+    quintptr m_recordWindow = 0; // HWND / X11 window id to follow instead of the region
+    bool m_followWindow = true;
+    bool m_viewportMode = false;     // Encode only a window that follows the cursor
+    QSize m_viewportSize;
+    bool m_timelapse = false;        // Low capture rate, normal playback rate, no audio
+    int m_timelapseIntervalSec = 2;
     bool m_recordMic;
     double m_micVolume;
     bool m_recordSys;
     double m_sysVolume;
     int m_fps; // Recording frame rate (from settings)
+    qint64 m_preallocateBytes = 0; // Disk space reserved for the output file
+    bool m_screenContent444 = false; // Keep full chroma (YUV444P, x264 High 4:4:4)
+    int m_videoCodec = VideoEncoderPreset::H264;
+    bool m_monitorMic = false;       // Route the microphone to the speakers / headphones
+    bool m_syncTest = false;         // Record the SyncAnalyzer test pattern
+    bool m_proxyFile = true;         // Also write a 480p proxy (recordings taller than that)
+    
+    bool m_sceneCutKeyframes = false; // Let the encoder add keyframes at scene changes
+    QString m_streamUrl;             // Live output (RTMP / SRT / ...), empty = file only
+    QString m_videoFilter;           // libavfilter description ("hqdn3d,scale=1280:-2"), empty = none
+    int m_videoFilterThreads = 0;    // 0 = one per core
+    QString m_pipSource;             // Picture-in-picture source ("dshow:video=...", "lavfi:..."), empty = off
+    QString m_pipOptions;            // Its input options, "key=value,..."
+    int m_pipCorner = PipCompositor::BottomRight;
+    int m_pipScale = 25;             // Inset width, percent of the recording width
+    int m_pipOpacity = 100;
+    QString m_pipeOutput;            // stdout / Unix socket / FIFO for downstream tools, empty = off
+    QString m_pipeFormat;            // mpegts or nut
+    bool m_hlsPreview = false;       // Rolling fMP4 HLS of the recording on a local HTTP port
+    int m_hlsSegmentSec = 2;
+    QString m_hlsDir;
+
+    QMutex m_markerMutex;
+    std::vector<int64_t> m_pendingMarkers; // Clock times of marker requests not yet encoded
     
-    QElapsedTimer m_timer;
-    QString m_currentFile;
+    MediaClock m_clock; // Shared timeline for video and audio sources
+    QString m_currentFile; // Named by startRecording(), read by the worker after m_startTriggered
 };
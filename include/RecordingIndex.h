@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Sidecar written next to each recording (<file>.msrindex) when the recorder finishes.
+// It holds what the player, the preview thread and VideoUtils would otherwise learn by
+// probing and seeking through the MP4: the keyframe table with byte offsets, the PTS
+// of every frame, a coarse audio peak envelope for the waveform, the chapter markers
+// and the encoder settings. The recorder fills it while encoding; readers load() it and
+// fall back to the file itself when it is missing or belongs to another file version.
+class RecordingIndex {
+public:
+    struct Keyframe {
+        int64_t pts = 0;      // Video time base
+        int64_t offset = -1;  // Byte position of the sample in the file (-1 = unknown)
+    };
+
+    struct EncoderParams {
+        QString videoCodec;
+        int width = 0;
+        int height = 0;
+        QString pixFmt;
+        AVRational frameRate = {0, 1};
+        int gopSize = 0;
+        int64_t bitRate = 0;
+        bool sceneCut = false;
+        QString audioCodec;   // Empty = no audio track
+        int sampleRate = 0;
+        int channels = 0;
+        int64_t audioBitRate = 0;
+    };
+
+    // One peak per kPeakSamples audio samples, scaled to 0..255
+    static const int kPeakSamples = 1024;
+
+    static QString pathFor(const QString &mediaFile);
+
+    void clear();
+    bool isValid() const { return m_valid; }
+
+    // Recorder side, called from the record loop
+    void setEncoder(const AVCodecContext *video, const AVCodecContext *audio, bool sceneCut);
+    void addFrame(int64_t pts);              // Every encoded frame, presentation order
+    void addPacket(const AVPacket *pkt);     // Encoded video, timestamps in timeBase()
+    void addAudio(const float *const *planes, int channels, int samples);
+    void setMarkers(const std::vector<int64_t> &pts);
+    // Once the file is closed: reads the sample offsets back from the MP4 header and
+    // writes the sidecar. The header parse is the only read of the media file.
+    bool save(const QString &mediaFile);
+
+    // Reader side. Fails when the sidecar is missing, damaged or older than the file.
+    bool load(const QString &mediaFile);
+
+    AVRational timeBase() const { return m_timeBase; }
+    const EncoderParams &encoder() const { return m_encoder; }
+    const QVector<Keyframe> &keyframes() const { return m_keyframes; }
+    const QVector<int64_t> &framePts() const { return m_framePts; }
+    const QVector<quint8> &peaks() const { return m_peaks; }
+    double peakIntervalMs() const;
+    qint64 durationMs() const;
+    QList<qint64> markersMs() const;
+
+    // Keyframe lookups in ms (-1 = none): where a seek to ms lands, and where a stream
+    // copy starting at ms can begin
+    qint64 keyframeAtOrBefore(qint64 ms) const;
+    qint64 keyframeAtOrAfter(qint64 ms) const;
+    // Same, in timeBase() units
+    int64_t keyframePtsAtOrBefore(qint64 ms) const;
+    int64_t keyframePtsAtOrAfter(qint64 ms) const;
+
+private:
+    qint64 toMs(int64_t pts) const;
+    bool resolveOffsets(const QString &mediaFile);
+
+    bool m_valid = false;
+    AVRational m_timeBase = {1, 90000};
+    EncoderParams m_encoder;
+    QVector<Keyframe> m_keyframes;
+    QVector<int64_t> m_framePts;
+    QVector<int64_t> m_markers;
+    QVector<quint8> m_peaks;
+    float m_peakMax = 0.0f;   // Peak of the samples not yet in m_peaks
+    int m_peakFill = 0;
+};
@@ -46,6 +46,8 @@ public:
     explicit SelectionOverlay(QWidget *parent = nullptr);
     ~SelectionOverlay();
     QRect getSelection() const;
+    // Native handle of the window the selection snapped to (HWND / X11 window id), 0 = plain region
+    quintptr selectedWindow() const { return m_selectedWindow; }
     
     void startRecording();
     void stopRecording();
@@ -86,6 +88,7 @@ private:
     QRect m_selection;
     QRect m_hoveredWindow;
     QList<WindowInfo> m_windows;
+    quintptr m_selectedWindow;
     
     // Toolbar state
     bool m_showToolbar;
@@ -111,6 +114,7 @@ private:
     
     void detectWindows();
     QRect getWindowAtPoint(const QPoint &pos);
+    quintptr getWindowIdAtPoint(const QPoint &pos) const;
     void startCountdown();
     void onCountdownTick();
     void animateCountdownNumber();
@@ -23,6 +23,7 @@ public:
     // 获取快捷键设置
     static QKeySequence getShowWindowHotkey();
     static QKeySequence getStartRecordHotkey();
+    static QKeySequence getAddMarkerHotkey();
 
 signals:
     void hotkeyChanged();
@@ -38,6 +39,7 @@ private slots:
     void onSaveClicked();
     void onShowWindowHotkeyChanged(const QKeySequence &seq);
     void onStartRecordHotkeyChanged(const QKeySequence &seq);
+    void onAddMarkerHotkeyChanged(const QKeySequence &seq);
 
 private:
     void loadSettings();
@@ -51,6 +53,23 @@ private:
     QLineEdit *m_editPath;
     QSpinBox *m_spinFps;
     QComboBox *m_comboBitrate;
+    QCheckBox *m_chkScreenContent;
+    QComboBox *m_comboVideoCodec;
+    QCheckBox *m_chkFollowWindow;
+    QCheckBox *m_chkViewport;
+    QComboBox *m_comboViewport;
+    QCheckBox *m_chkTimelapse;
+    QCheckBox *m_chkMicMonitor;
+    QCheckBox *m_chkProxyFile;
+    QCheckBox *m_chkSceneCut;
+    QLineEdit *m_editStreamUrl;
+    QCheckBox *m_chkPip;
+    QLineEdit *m_editPipSource;
+    QComboBox *m_comboPipCorner;
+    QLineEdit *m_editVideoFilter;
+    QCheckBox *m_chkHlsPreview;
+    QSpinBox *m_spinHlsSegmentSec;
+    QSpinBox *m_spinTimelapseSecs;
     QCheckBox *m_chkMinimizeToTray;
     QCheckBox *m_chkCountdown;
     QSpinBox *m_spinCountdownSecs;
@@ -60,4 +79,5 @@ private:
     // 快捷键
     HotkeyEdit *m_hotkeyShowWindow;
     HotkeyEdit *m_hotkeyStartRecord;
+    HotkeyEdit *m_hotkeyAddMarker;
 };
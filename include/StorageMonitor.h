@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QString>
+#include <QElapsedTimer>
+#include "AsyncFileWriter.h"
+
+// Watches the volume a recording is written to.
+// Fed from the record loop, it samples free space and the sustained write rate,
+// estimates the remaining record time from the live output bitrate and tells the
+// recorder when to drop to a lower bitrate or finalize before the disk fills up.
+class StorageMonitor {
+public:
+    enum Action {
+        None,
+        Warn,           // Running low, let the user know
+        ReduceBitrate,  // Disk filling up or too slow for the current bitrate
+        Finalize        // Stop now so the trailer still fits on disk
+    };
+
+    struct Sample {
+        qint64 freeBytes = -1;      // Free space on the output volume (-1 = unknown)
+        double outputMBps = 0.0;    // Live bitrate of the recording
+        double writeMBps = 0.0;     // Sustained disk write rate
+        qint64 remainingSec = -1;   // Estimated record time left (-1 = unknown)
+    };
+
+    void start(const QString &outputPath);
+    // Call regularly with the writer metrics; samples at most once per interval.
+    Action update(const AsyncFileWriter::Stats &io);
+    Sample lastSample() const { return m_last; }
+    // Space that must stay free for queued data plus the moov box written at finalize
+    qint64 reserveBytes() const;
+
+private:
+    QString m_path;
+    QElapsedTimer m_clock;
+    qint64 m_lastSampleMs = -1;
+    qint64 m_lastProduced = 0;
+    qint64 m_lastQueued = 0;
+    int m_queueGrowth = 0;      // Consecutive samples with a growing write queue
+    qint64 m_lastReduceMs = -1;
+    bool m_warned = false;
+    Sample m_last;
+
+    static const int SAMPLE_INTERVAL_MS = 1000;
+    static const int REDUCE_COOLDOWN_MS = 15000;
+    static const qint64 WARN_REMAINING_SEC = 600;
+    static const qint64 REDUCE_REMAINING_SEC = 180;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <cstdint>
+
+// A/V sync harness.
+// In sync-test mode the recorder captures two lavfi sources instead of the screen and
+// the audio devices: a black picture that flashes white and a 1 kHz tone that beeps,
+// both once a second on the recording's MediaClock. analyze() decodes the finished
+// MP4, finds every flash (luma edge) and beep (first loud sample), pairs them and
+// reports the offset of audio against video over the whole file, so a long run shows
+// drift as well as the constant offset.
+class SyncAnalyzer {
+public:
+    static const int kMarkerPeriodMs = 1000;
+    static const int kMarkerWidthMs = 100;
+    // Acceptance window (ITU-R BT.1359): audio at most 45 ms early, 125 ms late
+    static const int kMaxLeadMs = 45;
+    static const int kMaxLagMs = 125;
+
+    struct Marker {
+        double timeSec = 0.0;   // Flash time in the file
+        double offsetMs = 0.0;  // Beep - flash (positive = audio late)
+    };
+
+    struct Report {
+        bool ok = false;        // File decoded and at least two markers paired
+        QString error;
+        int flashes = 0;
+        int beeps = 0;
+        int paired = 0;
+        double durationSec = 0.0;
+        double meanOffsetMs = 0.0;
+        double minOffsetMs = 0.0;
+        double maxOffsetMs = 0.0;
+        double stdDevMs = 0.0;
+        double driftMsPerMin = 0.0; // Slope of the offset over time
+        QVector<Marker> markers;
+
+        // Every marker paired and inside the acceptance window
+        bool passed() const;
+        QString summary() const;
+    };
+
+    // lavfi graphs for the synthetic inputs. phaseSec: clock time of the source's t = 0
+    // modulo the marker period, so both sources flash/beep at the same clock times.
+    static QString videoGraph(int width, int height, int fps, double phaseSec);
+    static QString audioGraph(int sampleRate, double phaseSec);
+    static double markerPhase(int64_t clockNs);
+
+    static Report analyze(const QString &file);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QString>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+// Software encoders the recording can be archived with, and their real-time settings for
+// screen content. H.264 (libx264) stays the default; HEVC (libx265) and AV1 (SVT-AV1,
+// else libaom) trade CPU for smaller files. Everything encoder-specific is set here so the
+// record loop only deals with a generic AVCodecContext.
+class VideoEncoderPreset {
+public:
+    enum Codec { H264 = 0, HEVC, AV1 };
+
+    static Codec codecFromName(const QString &name); // "h264" / "hevc" / "av1", anything else = H264
+    static QString codecName(Codec codec);
+
+    // The library for codec (libx264; libx265; libsvtav1, then libaom-av1); nullptr when
+    // FFmpeg was built without one
+    static const AVCodec *findEncoder(Codec codec);
+    static bool supportsFormat(const AVCodec *enc, AVPixelFormat fmt);
+
+    // ABR target for the first rung of the storage ladder, roughly equal quality across codecs
+    static int64_t defaultBitRate(Codec codec);
+    // Whether a bit_rate change after avcodec_open2 takes effect (only libx264 reconfigures)
+    static bool canChangeBitRate(const AVCodec *enc);
+
+    // Preset, tune and library parameters; call after size, format, GOP and thread_count are
+    // set and before avcodec_open2. sceneCut: extra keyframes at slide / window switches.
+    static void apply(AVCodecContext *ctx, const AVCodec *enc, bool sceneCut);
+
+    // 'hvc1' for HEVC in MP4 / MOV / fMP4 HLS (what Apple players and browsers accept);
+    // 0 = let the muxer pick
+    static unsigned int codecTagFor(const AVOutputFormat *fmt, AVCodecID id);
+};
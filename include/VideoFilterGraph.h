@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+// User-configured libavfilter chain between colour conversion and the encoder
+// ("hqdn3d", "crop=1280:720:0:0,scale=960:-2", "pad=...", ...).
+// Frames go in as the converter produced them and come out in one of the encoder's
+// pixel formats; the encoder is opened with the graph's output size and format.
+// Slice threading is enabled for filters that support it, and output frames come from
+// the graph's own frame pools, handed over by reference.
+class VideoFilterGraph {
+public:
+    VideoFilterGraph();
+    ~VideoFilterGraph();
+
+    // outFormats: pixel formats the encoder accepts (the sink picks the first the graph can give).
+    // threads: 0 = one per core.
+    bool init(const QString &filters, int width, int height, AVPixelFormat fmt, AVRational timeBase,
+              AVRational frameRate, const std::vector<AVPixelFormat> &outFormats, int threads = 0);
+    void close();
+    bool isOpen() const { return m_graph != nullptr; }
+    QString errorString() const { return m_error; }
+
+    int outWidth() const;
+    int outHeight() const;
+    AVPixelFormat outFormat() const;
+    AVRational outFrameRate() const; // {0, 1} when the graph does not set one
+    QString description() const { return m_filters; }
+
+    // Takes a reference to frame (nullptr = end of stream, flushes buffered frames)
+    bool push(const AVFrame *frame);
+    // Next filtered frame, PTS in the input time base and strictly increasing; nullptr when
+    // the graph needs more input. Caller frees.
+    AVFrame *pull();
+
+private:
+    AVFilterGraph *m_graph = nullptr;
+    AVFilterContext *m_src = nullptr;
+    AVFilterContext *m_sink = nullptr;
+    AVRational m_timeBase = {1, 90000};
+    int64_t m_lastPts = INT64_MIN;
+    QString m_filters;
+    QString m_error;
+};
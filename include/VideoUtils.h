@@ -2,6 +2,7 @@
 
 #include <QString>
 #include <QRect>
+#include <QList>
 #include <QObject>
 
 class VideoUtils : public QObject {
@@ -19,6 +20,13 @@ public:
     // Trim (Native Implementation) - Milliseconds
     void trimVideoMs(const QString &inputFile, const QString &outputFile, qint64 startMs, qint64 endMs);
 
+    // Low-resolution proxy of a recording (app cache, keyed by the recording's path)
+    static QString proxyPathFor(const QString &file);
+    // What the player should decode for previews: the proxy when one exists, else the file
+    static QString previewPathFor(const QString &file);
+    // Start times (ms) of the chapters recording markers left in the file
+    static QList<qint64> readMarkers(const QString &file);
+
 signals:
     void processingFinished(bool success, const QString &outputFile);
     void processingError(const QString &error);
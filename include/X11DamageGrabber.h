@@ -0,0 +1,81 @@
+#pragma once
+
+#include <QRect>
+#include <QString>
+#include <memory>
+#include <vector>
+#include "ColorConverter.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Damage-driven X11 screen grabber (Linux).
+// The captured area lives in one persistent BGR0 image in an XShm segment. XDamage
+// reports which parts of the root window changed; each grab re-reads only the
+// full-width row bands covering those rectangles (XShmGetImage into the matching
+// offset of the segment) and returns the changed rows, so conversion can skip the
+// rest. A static desktop costs almost nothing per frame.
+// In window mode the area follows a top-level window: moves shift the area, resizes
+// reallocate the image and the frame size changes with the window.
+// Xlib types stay in the .cpp: its macros (None, Bool, Status) clash with Qt.
+class X11DamageGrabber {
+public:
+    struct Stats {
+        qint64 frames = 0;
+        qint64 rowsGrabbed = 0; // Rows re-read from the server
+        qint64 rowsTotal = 0;   // Rows a full-frame grabber would have read
+        qint64 requests = 0;    // XShmGetImage round trips
+    };
+
+    struct WindowEntry {
+        quintptr id = 0;
+        QRect rect;     // Client area in root coordinates
+        QString title;
+    };
+
+    X11DamageGrabber();
+    ~X11DamageGrabber();
+
+    // region: root window coordinates (null = whole screen), clipped to the screen and
+    // rounded down to even dimensions. Fails if XShm/XDamage/XFixes are missing or the
+    // visual is not 32 bpp; the caller then falls back to x11grab.
+    bool open(const QRect &region, int fps, bool drawCursor);
+    // Follows a top-level window (X11 window id). An area that hangs off the screen edge
+    // is slid back inside; an unmapped window keeps the last area.
+    bool openWindow(quintptr window, int fps, bool drawCursor);
+    void close();
+    bool isOpen() const;
+    QString errorString() const { return m_error; }
+
+    int width() const;
+    int height() const;
+    QRect region() const;
+    // Pointer in root coordinates, from this grabber's display connection (grab thread only)
+    QPoint cursorPos() const;
+
+    // Paces to the configured frame rate, refreshes changed rows and points frame at the
+    // persistent image (no copy, valid until the next grab). The first grab is a full frame.
+    bool grab(AVFrame *frame, std::vector<RowSpan> &dirtyRows);
+
+    Stats stats() const { return m_stats; }
+
+    // Managed, viewable top-level windows, topmost first (_NET_CLIENT_LIST_STACKING)
+    static std::vector<WindowEntry> listWindows();
+
+private:
+    struct X11State;
+
+    bool openDisplay(int fps, bool drawCursor);
+    bool allocImage(const QRect &area);
+    void freeImage();
+    bool windowArea(QRect &area) const;
+    bool followWindow();
+    void markRows(int first, int last);
+    bool grabRows(int first, int last);
+    void drawCursor();
+
+    std::unique_ptr<X11State> d;
+    QString m_error;
+    Stats m_stats;
+};
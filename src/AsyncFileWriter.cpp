@@ -0,0 +1,260 @@
+#include "AsyncFileWriter.h"
+#include <cstring>
+#include <cstdio>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#elif defined(Q_OS_MAC)
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#endif
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/error.h>
+}
+
+AsyncFileWriter::AsyncFileWriter() {}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    close();
+}
+
+bool AsyncFileWriter::open(const QString &path, qint64 memoryBudget, qint64 preallocateBytes) {
+    close();
+
+    m_current = Block();
+    m_pos = 0;
+    m_logicalSize = 0;
+    m_queue.clear();
+    m_queuedBytes = 0;
+    m_stop = false;
+    m_failed = false;
+    m_error.clear();
+    m_stats = Stats();
+    m_rateBytes = 0;
+    // Keep at least two blocks in flight so the writer never idles behind the producer
+    m_budget = qMax(memoryBudget, (qint64)BLOCK_SIZE * 2);
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+    if (preallocateBytes > 0 && preallocate(preallocateBytes)) {
+        m_stats.preallocatedBytes = preallocateBytes;
+    }
+
+    uint8_t *ioBuf = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+    m_avio = avio_alloc_context(ioBuf, AVIO_BUFFER_SIZE, 1, this, nullptr, &AsyncFileWriter::writePacket, &AsyncFileWriter::seekPacket);
+    if (!m_avio) {
+        av_free(ioBuf);
+        m_file.close();
+        m_error = "avio_alloc_context failed";
+        return false;
+    }
+
+    m_rateTimer.start();
+    m_thread = QThread::create([this](){ writerThreadFunc(); });
+    m_thread->start();
+    return true;
+}
+
+bool AsyncFileWriter::close() {
+    if (!m_avio) return !m_failed;
+
+    // Push whatever the AVIO buffer still holds, then hand over the last partial block
+    avio_flush(m_avio);
+    submitCurrent();
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_condData.wakeAll();
+    }
+    if (m_thread) {
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+
+    for (uint8_t *p : m_freeBlocks) av_free(p);
+    m_freeBlocks.clear();
+
+    // Trim to the logical size. A preallocation lies past EOF (no platform changes the file
+    // size for it), so the sizes match and the reservation has to be truncated explicitly
+    if (m_stats.preallocatedBytes > 0) m_file.resize(m_failed ? m_file.size() : m_logicalSize);
+    else if (!m_failed && m_file.size() != m_logicalSize) m_file.resize(m_logicalSize);
+    m_file.close();
+
+    av_freep(&m_avio->buffer);
+    avio_context_free(&m_avio);
+    m_avio = nullptr;
+    return !m_failed;
+}
+
+QString AsyncFileWriter::errorString() const {
+    QMutexLocker lock(&m_mutex);
+    return m_error;
+}
+
+AsyncFileWriter::Stats AsyncFileWriter::stats() const {
+    QMutexLocker lock(&m_mutex);
+    Stats s = m_stats;
+    s.bytesQueued = m_queuedBytes;
+    return s;
+}
+
+int AsyncFileWriter::writePacket(void *opaque, uint8_t *buf, int size) {
+    return static_cast<AsyncFileWriter*>(opaque)->write(buf, size);
+}
+
+int64_t AsyncFileWriter::seekPacket(void *opaque, int64_t offset, int whence) {
+    return static_cast<AsyncFileWriter*>(opaque)->seek(offset, whence);
+}
+
+int AsyncFileWriter::write(const uint8_t *buf, int size) {
+    if (m_failed) return AVERROR(EIO);
+
+    int done = 0;
+    while (done < size) {
+        // A block holds one contiguous byte range; a seek or a full block starts a new one
+        if (m_current.data && (m_current.offset + m_current.size != m_pos || m_current.size == BLOCK_SIZE)) {
+            submitCurrent();
+        }
+        if (!m_current.data) {
+            m_current = takeFreeBlock();
+            m_current.offset = m_pos;
+        }
+        int n = qMin(size - done, BLOCK_SIZE - m_current.size);
+        memcpy(m_current.data + m_current.size, buf + done, n);
+        m_current.size += n;
+        m_pos += n;
+        done += n;
+    }
+    if (m_pos > m_logicalSize) m_logicalSize = m_pos;
+    return m_failed ? AVERROR(EIO) : size;
+}
+
+int64_t AsyncFileWriter::seek(int64_t offset, int whence) {
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) return m_logicalSize;
+
+    int64_t target = -1;
+    switch (whence) {
+        case SEEK_SET: target = offset; break;
+        case SEEK_CUR: target = m_pos + offset; break;
+        case SEEK_END: target = m_logicalSize + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+    if (target < 0) return AVERROR(EINVAL);
+    m_pos = target;
+    return target;
+}
+
+AsyncFileWriter::Block AsyncFileWriter::takeFreeBlock() {
+    Block b;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!m_freeBlocks.empty()) {
+            b.data = m_freeBlocks.back();
+            m_freeBlocks.pop_back();
+        }
+    }
+    if (!b.data) b.data = (uint8_t*)av_malloc(BLOCK_SIZE);
+    return b;
+}
+
+void AsyncFileWriter::submitCurrent() {
+    if (!m_current.data) return;
+
+    QMutexLocker lock(&m_mutex);
+    if (m_current.size == 0) {
+        m_freeBlocks.push_back(m_current.data);
+        m_current = Block();
+        return;
+    }
+
+    // Backpressure only when the in-memory budget is exhausted
+    if (m_queuedBytes + m_current.size > m_budget && !m_queue.empty() && !m_failed) {
+        QElapsedTimer waitTimer;
+        waitTimer.start();
+        m_stats.stallCount++;
+        while (m_queuedBytes + m_current.size > m_budget && !m_queue.empty() && !m_failed) {
+            m_condSpace.wait(&m_mutex);
+        }
+        m_stats.stallMs += waitTimer.elapsed();
+    }
+
+    m_queuedBytes += m_current.size;
+    m_queue.push_back(m_current);
+    m_current = Block();
+    m_condData.wakeOne();
+}
+
+bool AsyncFileWriter::preallocate(qint64 bytes) {
+    // Reserve space without changing the file size; close() truncates to release what is left
+#ifdef Q_OS_WIN
+    HANDLE h = (HANDLE)_get_osfhandle(m_file.handle());
+    if (h == INVALID_HANDLE_VALUE) return false;
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = bytes;
+    return SetFileInformationByHandle(h, FileAllocationInfo, &info, sizeof(info)) != 0;
+#elif defined(Q_OS_MAC)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, bytes, 0 };
+    if (fcntl(m_file.handle(), F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(m_file.handle(), F_PREALLOCATE, &store) == -1) return false;
+    }
+    return true;
+#elif defined(Q_OS_LINUX)
+    return fallocate(m_file.handle(), FALLOC_FL_KEEP_SIZE, 0, bytes) == 0;
+#else
+    Q_UNUSED(bytes);
+    return false;
+#endif
+}
+
+void AsyncFileWriter::writerThreadFunc() {
+    while (true) {
+        Block b;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.empty() && !m_stop) m_condData.wait(&m_mutex);
+            if (m_queue.empty()) break;
+            b = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        bool ok = true;
+        QElapsedTimer writeTimer;
+        writeTimer.start();
+        if (!m_failed) {
+            if (m_file.pos() != b.offset && !m_file.seek(b.offset)) ok = false;
+            else if (m_file.write((const char*)b.data, b.size) != b.size) ok = false;
+        }
+        qint64 writeMs = writeTimer.elapsed();
+
+        QMutexLocker lock(&m_mutex);
+        m_queuedBytes -= b.size;
+        m_freeBlocks.push_back(b.data);
+        if (!ok && !m_failed) {
+            m_error = m_file.errorString();
+            m_failed = true;
+        }
+        if (ok) {
+            m_stats.bytesWritten += b.size;
+            m_rateBytes += b.size;
+            if (writeMs > m_stats.maxWriteMs) m_stats.maxWriteMs = writeMs;
+            qint64 windowMs = m_rateTimer.elapsed();
+            if (windowMs >= 1000) {
+                m_stats.writeMBps = (m_rateBytes / (1024.0 * 1024.0)) / (windowMs / 1000.0);
+                m_rateBytes = 0;
+                m_rateTimer.restart();
+            }
+        }
+        m_condSpace.wakeAll();
+    }
+}
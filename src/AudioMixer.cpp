@@ -0,0 +1,402 @@
+#include "AudioMixer.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AM_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(AM_X86) && defined(__GNUC__)
+#define AM_TARGET_SSE2 __attribute__((target("sse2")))
+#define AM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define AM_TARGET_SSE2
+#define AM_TARGET_AVX2
+#endif
+
+namespace {
+
+const float kLimiterCeiling = 0.98f;     // About -0.2 dBFS
+const double kLimiterReleaseSec = 0.2;   // Time constant for the gain to recover
+
+// acc += src * gain over n floats; returns the sum of squares of src * gain (metering)
+float mixAddScalar(float *acc, const float *src, float gain, int n) {
+    float sumSq = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float v = src[i] * gain;
+        acc[i] += v;
+        sumSq += v * v;
+    }
+    return sumSq;
+}
+
+float peakAbsScalar(const float *acc, int n) {
+    float peak = 0.0f;
+    for (int i = 0; i < n; i++) peak = std::max(peak, std::fabs(acc[i]));
+    return peak;
+}
+
+// Applies the limiter gain (linear ramp g0 + step * frame), clamps to full scale and
+// splits interleaved channels into planes, for frames from..samples-1
+void outputScalar(float *const *dst, const float *acc, int from, int samples, int channels, float g0, float step) {
+    for (int i = from; i < samples; i++) {
+        float g = g0 + step * i;
+        for (int c = 0; c < channels; c++) {
+            float v = acc[i * channels + c] * g;
+            dst[c][i] = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+        }
+    }
+}
+
+#ifdef AM_X86
+AM_TARGET_SSE2 float hsumSse(__m128 v) {
+    __m128 hi = _mm_movehl_ps(v, v);
+    v = _mm_add_ps(v, hi);
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+AM_TARGET_SSE2 float hmaxSse(__m128 v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+AM_TARGET_SSE2 float mixAddSse2(float *acc, const float *src, float gain, int n) {
+    __m128 g = _mm_set1_ps(gain);
+    __m128 sum = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), v));
+        sum = _mm_add_ps(sum, _mm_mul_ps(v, v));
+    }
+    return hsumSse(sum) + mixAddScalar(acc + i, src + i, gain, n - i);
+}
+
+AM_TARGET_SSE2 float peakAbsSse2(const float *acc, int n) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) peak = _mm_max_ps(peak, _mm_and_ps(_mm_loadu_ps(acc + i), absMask));
+    return std::max(hmaxSse(peak), peakAbsScalar(acc + i, n - i));
+}
+
+// Stereo: de-interleaves four frames per step (L0 R0 L1 R1 | L2 R2 L3 R3). The gain is
+// g0 + step * frame with the same float operations as the scalar path, so both give the
+// same bytes.
+AM_TARGET_SSE2 void outputStereoSse2(float *const *dst, const float *acc, int samples, float g0, float step) {
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 base = _mm_set1_ps(g0);
+    const __m128 steps = _mm_set1_ps(step);
+    const __m128i offsets = _mm_setr_epi32(0, 1, 2, 3);
+    int i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        __m128 a = _mm_loadu_ps(acc + 2 * i);
+        __m128 b = _mm_loadu_ps(acc + 2 * i + 4);
+        __m128 frame = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), offsets));
+        __m128 g = _mm_add_ps(base, _mm_mul_ps(steps, frame));
+        __m128 l = _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), g);
+        __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), g);
+        _mm_storeu_ps(dst[0] + i, _mm_min_ps(_mm_max_ps(l, lo), hi));
+        _mm_storeu_ps(dst[1] + i, _mm_min_ps(_mm_max_ps(r, lo), hi));
+    }
+    outputScalar(dst, acc, i, samples, 2, g0, step);
+}
+
+AM_TARGET_AVX2 float mixAddAvx2(float *acc, const float *src, float gain, int n) {
+    __m256 g = _mm256_set1_ps(gain);
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), v));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(v, v));
+    }
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    return hsumSse(s) + mixAddScalar(acc + i, src + i, gain, n - i);
+}
+
+AM_TARGET_AVX2 float peakAbsAvx2(const float *acc, int n) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 peak = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) peak = _mm256_max_ps(peak, _mm256_and_ps(_mm256_loadu_ps(acc + i), absMask));
+    __m128 p = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    return std::max(hmaxSse(p), peakAbsScalar(acc + i, n - i));
+}
+#endif
+
+float mixAdd(ColorConverter::Isa isa, float *acc, const float *src, float gain, int n) {
+#ifdef AM_X86
+    if (isa == ColorConverter::Avx2) return mixAddAvx2(acc, src, gain, n);
+    if (isa == ColorConverter::Sse2) return mixAddSse2(acc, src, gain, n);
+#endif
+    Q_UNUSED(isa);
+    return mixAddScalar(acc, src, gain, n);
+}
+
+float peakAbs(ColorConverter::Isa isa, const float *acc, int n) {
+#ifdef AM_X86
+    if (isa == ColorConverter::Avx2) return peakAbsAvx2(acc, n);
+    if (isa == ColorConverter::Sse2) return peakAbsSse2(acc, n);
+#endif
+    Q_UNUSED(isa);
+    return peakAbsScalar(acc, n);
+}
+
+void output(ColorConverter::Isa isa, float *const *dst, const float *acc, int samples, int channels, float g0, float step) {
+#ifdef AM_X86
+    if (channels == 2 && isa != ColorConverter::Scalar) { outputStereoSse2(dst, acc, samples, g0, step); return; }
+#endif
+    Q_UNUSED(isa);
+    outputScalar(dst, acc, 0, samples, channels, g0, step);
+}
+
+} // namespace
+
+// --- Source ---
+
+AudioMixer::Source::Source(AudioMixer *mixer, const QString &name, Kind kind)
+    : m_mixer(mixer), m_name(name), m_kind(kind) {
+}
+
+AudioMixer::Source::~Source() {
+    if (m_swr) swr_free(&m_swr);
+    m_ring.free();
+}
+
+bool AudioMixer::Source::setInputFormat(int sampleRate, int channels, AVSampleFormat fmt, uint64_t channelLayout) {
+    QMutexLocker lock(&m_formatMutex);
+    if (m_ready || sampleRate <= 0 || channels <= 0 || fmt == AV_SAMPLE_FMT_NONE) return false;
+    m_inRate = sampleRate;
+    m_inChannels = channels;
+    m_inFmt = fmt;
+    m_inLayout = channelLayout ? channelLayout : av_get_default_channel_layout(channels);
+    m_inFrameBytes = av_sample_fmt_is_planar(fmt) ? 0 : av_get_bytes_per_sample(fmt) * channels;
+    return m_mixer->sampleRate() > 0 ? configure() : true;
+}
+
+bool AudioMixer::Source::hasInputFormat() const {
+    QMutexLocker lock(&m_formatMutex);
+    return m_inRate > 0;
+}
+
+int AudioMixer::Source::inputSampleRate() const {
+    QMutexLocker lock(&m_formatMutex);
+    return m_inRate;
+}
+
+bool AudioMixer::Source::isNativeRate() const {
+    QMutexLocker lock(&m_formatMutex);
+    return m_inRate > 0 && m_inRate == m_mixer->sampleRate();
+}
+
+bool AudioMixer::Source::configure() {
+    int rate = m_mixer->sampleRate();
+    if (m_ready || m_inRate <= 0 || rate <= 0) return m_ready;
+    int outChannels = m_mixer->m_channels;
+    int frameBytes = outChannels * (int)sizeof(float);
+    m_ring.init(rate * frameBytes * m_mixer->m_ringSeconds, m_mixer->m_clock, rate, frameBytes);
+
+    // Same rate and layout: only the sample format may differ, which swr converts
+    // without filtering; identical formats are copied straight into the ring
+    if (m_inRate != rate || m_inChannels != outChannels || m_inFmt != AV_SAMPLE_FMT_FLT) {
+        m_swr = swr_alloc_set_opts(nullptr,
+            av_get_default_channel_layout(outChannels), AV_SAMPLE_FMT_FLT, rate,
+            m_inLayout, m_inFmt, m_inRate, 0, nullptr);
+        if (!m_swr || swr_init(m_swr) < 0) {
+            swr_free(&m_swr);
+            m_active = false;
+            return false;
+        }
+    }
+    m_ready.store(true, std::memory_order_release);
+    return true;
+}
+
+void AudioMixer::Source::write(const uint8_t *const *data, int samples, int64_t tsNs) {
+    if (samples <= 0 || !m_ready.load(std::memory_order_acquire)) return;
+    const MediaClock *clock = m_mixer->m_clock;
+    if (tsNs < 0 && clock && clock->isStarted())
+        tsNs = clock->nowNs() - MediaClock::fromStreamTs(samples, AVRational{1, m_inRate});
+    if (tsNs >= 0) tsNs = qMax<int64_t>(tsNs - m_latencyNs.load(), 0);
+
+    if (!m_swr) {
+        m_ring.write(data[0], samples * m_ring.blockAlign, tsNs);
+        return;
+    }
+    // The first output sample is what the resampler still held from the previous block
+    if (tsNs >= 0) tsNs = qMax<int64_t>(tsNs - swr_get_delay(m_swr, 1000000000LL), 0);
+    int outSamples = swr_get_out_samples(m_swr, samples);
+    if (outSamples <= 0) return;
+    size_t need = (size_t)outSamples * m_ring.blockAlign;
+    if (m_conv.size() < need) m_conv.resize(need);
+    uint8_t *out[1] = { m_conv.data() };
+    int n = swr_convert(m_swr, out, outSamples, (const uint8_t**)data, samples);
+    if (n > 0) m_ring.write(m_conv.data(), n * m_ring.blockAlign, tsNs);
+}
+
+void AudioMixer::Source::writeInterleaved(const uint8_t *data, int bytes, int64_t tsNs) {
+    if (!m_ready.load(std::memory_order_acquire) || m_inFrameBytes <= 0) return; // Planar input needs write()
+    const uint8_t *planes[1] = { data };
+    write(planes, bytes / m_inFrameBytes, tsNs);
+}
+
+// --- Mixer ---
+
+AudioMixer::AudioMixer(ColorConverter::Isa maxIsa) {
+    m_isa = qMin(ColorConverter::detectIsa(), maxIsa);
+}
+
+AudioMixer::~AudioMixer() {
+    release();
+}
+
+void AudioMixer::init(const MediaClock *clock, int channels, int ringSeconds) {
+    release();
+    QMutexLocker lock(&m_mutex);
+    m_clock = clock;
+    m_sampleRate = 0;
+    m_channels = channels;
+    m_ringSeconds = ringSeconds;
+    m_limGain = 1.0f;
+}
+
+void AudioMixer::release() {
+    QMutexLocker lock(&m_mutex);
+    m_sources.clear();
+    m_acc.clear();
+    m_scratch.clear();
+}
+
+AudioMixer::Source *AudioMixer::addSource(const QString &name, Kind kind, int sampleRate, int channels,
+                                          AVSampleFormat fmt, double gain, int64_t latencyNs) {
+    QMutexLocker lock(&m_mutex);
+    std::unique_ptr<Source> src(new Source(this, name, kind));
+    if (sampleRate > 0) src->setInputFormat(sampleRate, channels, fmt);
+    src->setGain(gain);
+    src->setLatencyNs(latencyNs);
+    m_sources.push_back(std::move(src));
+    return m_sources.back().get();
+}
+
+bool AudioMixer::formatsKnown() const {
+    QMutexLocker lock(&m_mutex);
+    for (const auto &src : m_sources) {
+        if (src->isActive() && !src->hasInputFormat()) return false;
+    }
+    return true;
+}
+
+int AudioMixer::lockSampleRate(const int *allowedRates) {
+    QMutexLocker lock(&m_mutex);
+    if (m_sampleRate > 0) return m_sampleRate;
+
+    auto allowed = [allowedRates](int rate) {
+        if (!allowedRates) return rate >= 8000 && rate <= 192000;
+        for (const int *r = allowedRates; *r; r++) if (*r == rate) return true;
+        return false;
+    };
+    // Vote by native rate; every source at the winning rate skips resampling
+    int best = 0, bestVotes = 0;
+    for (const auto &src : m_sources) {
+        if (!src->isActive()) continue;
+        int rate = src->inputSampleRate();
+        if (rate <= 0 || !allowed(rate)) continue;
+        int votes = 0;
+        for (const auto &other : m_sources) {
+            if (other->isActive() && other->inputSampleRate() == rate) votes++;
+        }
+        if (votes > bestVotes || (votes == bestVotes && rate > best)) {
+            best = rate;
+            bestVotes = votes;
+        }
+    }
+    if (!best) best = (allowed(48000) || !allowedRates || !*allowedRates) ? 48000 : allowedRates[0];
+    m_sampleRate = best;
+
+    for (const auto &src : m_sources) {
+        QMutexLocker formatLock(&src->m_formatMutex);
+        src->configure();
+    }
+    return best;
+}
+
+int AudioMixer::sourceCount() const {
+    QMutexLocker lock(&m_mutex);
+    return (int)m_sources.size();
+}
+
+AudioMixer::Source *AudioMixer::source(int index) const {
+    QMutexLocker lock(&m_mutex);
+    return (index >= 0 && index < (int)m_sources.size()) ? m_sources[index].get() : nullptr;
+}
+
+int AudioMixer::activeSourceCount() const {
+    QMutexLocker lock(&m_mutex);
+    int n = 0;
+    for (const auto &src : m_sources) if (src->isActive()) n++;
+    return n;
+}
+
+int64_t AudioMixer::endTimestamp() const {
+    QMutexLocker lock(&m_mutex);
+    int64_t end = INT64_MAX;
+    for (const auto &src : m_sources) {
+        if (!src->isActive()) continue;
+        if (!src->m_ready.load(std::memory_order_acquire)) return -1;
+        int64_t srcEnd = src->m_ring.endTimestamp();
+        if (srcEnd < 0) return -1;
+        end = qMin(end, srcEnd);
+    }
+    return end;
+}
+
+bool AudioMixer::mix(float *const *dst, int samples, int64_t startNs) {
+    QMutexLocker lock(&m_mutex);
+    int total = samples * m_channels;
+    if ((int)m_acc.size() < total) {
+        m_acc.resize(total);
+        m_scratch.resize(total);
+    }
+    float *acc = m_acc.data();
+    memset(acc, 0, total * sizeof(float));
+
+    bool contributed = false;
+    for (const auto &src : m_sources) {
+        if (!src->isActive() || !src->m_ready.load(std::memory_order_acquire)) { src->m_level = 0.0f; continue; }
+        int real = src->m_ring.readAt((uint8_t*)m_scratch.data(), total * (int)sizeof(float), startNs);
+        if (real <= 0) { src->m_level = 0.0f; continue; }
+        float sumSq = mixAdd(m_isa, acc, m_scratch.data(), src->m_gain.load(), total);
+        src->m_level = qMin(1.0f, std::sqrt(sumSq / total));
+        contributed = true;
+    }
+
+    // Limiter: drop the gain at once when the block would exceed the ceiling, recover
+    // exponentially, ramping across the block so gain changes don't click
+    float peak = peakAbs(m_isa, acc, total);
+    float target = peak > kLimiterCeiling ? kLimiterCeiling / peak : 1.0f;
+    float g0 = m_limGain;
+    float g1;
+    if (target < g0) {
+        g0 = g1 = target;
+    } else {
+        float release = (float)(1.0 - std::exp(-samples / (m_sampleRate.load() * kLimiterReleaseSec)));
+        g1 = g0 + (target - g0) * release;
+    }
+    m_limGain = g1;
+    output(m_isa, dst, acc, samples, m_channels, g0, (g1 - g0) / samples);
+    return contributed;
+}
+
+double AudioMixer::level(Kind kind) const {
+    QMutexLocker lock(&m_mutex);
+    double level = 0.0;
+    for (const auto &src : m_sources) {
+        if (src->kind() == kind) level = qMax(level, src->level());
+    }
+    return level;
+}
@@ -0,0 +1,155 @@
+#include "AudioMonitor.h"
+#include "MediaClock.h"
+#include <cstring>
+
+AudioMonitor::AudioMonitor() {
+}
+
+AudioMonitor::~AudioMonitor() {
+    close();
+}
+
+bool AudioMonitor::open(const SDL_AudioSpec &capture, const QString &deviceName) {
+    close();
+    m_error.clear();
+    m_frameBytes = SDL_AUDIO_BITSIZE(capture.format) / 8 * capture.channels;
+    m_bytesPerSec = capture.freq * m_frameBytes;
+    if (m_frameBytes <= 0 || capture.freq <= 0) {
+        m_error = "invalid capture format";
+        return false;
+    }
+
+    // Same format as the microphone; about 5 ms per playback buffer
+    SDL_AudioSpec want;
+    memset(&want, 0, sizeof(want));
+    want.freq = capture.freq;
+    want.format = capture.format;
+    want.channels = capture.channels;
+    want.samples = 64;
+    while (want.samples < capture.freq / 200) want.samples *= 2;
+    want.callback = playbackCallback;
+    want.userdata = this;
+
+    const char *name = nullptr;
+    QByteArray nameUtf8;
+    if (!deviceName.isEmpty()) {
+        int count = SDL_GetNumAudioDevices(0);
+        for (int i = 0; i < count; ++i) {
+            QString candidate = QString::fromUtf8(SDL_GetAudioDeviceName(i, 0));
+            if (candidate.contains(deviceName, Qt::CaseInsensitive)) {
+                nameUtf8 = candidate.toUtf8();
+                name = nameUtf8.constData();
+                break;
+            }
+        }
+    }
+
+    SDL_AudioSpec have;
+    // No allowed changes: SDL converts internally if the output differs, our ring stays
+    // in the capture format
+    m_dev = SDL_OpenAudioDevice(name, 0, &want, &have, 0);
+    if (m_dev == 0) {
+        m_error = QString::fromUtf8(SDL_GetError());
+        return false;
+    }
+
+    m_capturePeriodNs = MediaClock::fromStreamTs(capture.samples, AVRational{1, capture.freq});
+    m_playbackPeriodNs = MediaClock::fromStreamTs(have.samples, AVRational{1, have.freq});
+    m_maxFillBytes = (capture.samples + have.samples) * m_frameBytes;
+    m_silence = have.silence;
+
+    // Room for a few hundred ms so a stalled playback device drops instead of overwriting
+    size_t size = 1;
+    while (size < (size_t)m_bytesPerSec / 4 || size < (size_t)m_maxFillBytes * 4) size <<= 1;
+    m_ring.assign(size, m_silence);
+    m_mask = size - 1;
+    m_writePos = 0;
+    m_readPos = 0;
+    m_lastPushNs = -1;
+    m_queueNs = 0;
+    m_underruns = 0;
+    m_droppedBytes = 0;
+    return true;
+}
+
+void AudioMonitor::start() {
+    if (m_dev > 0) SDL_PauseAudioDevice(m_dev, 0);
+}
+
+void AudioMonitor::close() {
+    if (m_dev > 0) {
+        SDL_PauseAudioDevice(m_dev, 1);
+        SDL_CloseAudioDevice(m_dev);
+        m_dev = 0;
+    }
+}
+
+void AudioMonitor::push(const uint8_t *data, int bytes) {
+    if (m_ring.empty() || bytes <= 0) return;
+    uint64_t w = m_writePos.load(std::memory_order_relaxed);
+    uint64_t r = m_readPos.load(std::memory_order_acquire);
+    if (w - r + (uint64_t)bytes > m_ring.size()) {
+        // Playback stopped pulling; never overwrite what it may be reading
+        m_droppedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        return;
+    }
+    size_t pos = (size_t)(w & m_mask);
+    size_t first = qMin((size_t)bytes, m_ring.size() - pos);
+    memcpy(m_ring.data() + pos, data, first);
+    if (first < (size_t)bytes) memcpy(m_ring.data(), data + first, bytes - first);
+    m_writePos.store(w + bytes, std::memory_order_release);
+    m_lastPushNs.store(MediaClock::monotonicNs(), std::memory_order_relaxed);
+}
+
+void AudioMonitor::playbackCallback(void *userdata, Uint8 *stream, int len) {
+    static_cast<AudioMonitor*>(userdata)->pull(stream, len);
+}
+
+void AudioMonitor::pull(uint8_t *out, int bytes) {
+    uint64_t r = m_readPos.load(std::memory_order_relaxed);
+    uint64_t w = m_writePos.load(std::memory_order_acquire);
+    int64_t avail = (int64_t)(w - r);
+
+    // Keep the delay bounded: skip what the capture clock got ahead by
+    if (avail > m_maxFillBytes) {
+        int64_t skip = avail - m_maxFillBytes;
+        skip -= skip % m_frameBytes;
+        r += skip;
+        avail -= skip;
+        m_droppedBytes.fetch_add(skip, std::memory_order_relaxed);
+    }
+
+    // The first sample played now was captured avail bytes before the newest one
+    int64_t lastPushNs = m_lastPushNs.load(std::memory_order_relaxed);
+    if (lastPushNs >= 0 && avail > 0) {
+        int64_t queueNs = MediaClock::monotonicNs() - lastPushNs + avail * 1000000000LL / m_bytesPerSec;
+        int64_t avg = m_queueNs.load(std::memory_order_relaxed);
+        m_queueNs.store(avg ? avg + (queueNs - avg) / 16 : queueNs, std::memory_order_relaxed);
+    }
+
+    int n = (int)qMin<int64_t>(avail, bytes);
+    n -= n % m_frameBytes;
+    size_t pos = (size_t)(r & m_mask);
+    size_t first = qMin((size_t)n, m_ring.size() - pos);
+    memcpy(out, m_ring.data() + pos, first);
+    if (first < (size_t)n) memcpy(out + first, m_ring.data(), n - first);
+    if (n < bytes) {
+        memset(out + n, m_silence, bytes - n);
+        if (lastPushNs >= 0) m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_readPos.store(r + n, std::memory_order_release);
+}
+
+AudioMonitor::Stats AudioMonitor::stats() const {
+    Stats s;
+    s.queueMs = m_queueNs.load() / 1000000.0;
+    s.bufferDelayMs = (m_capturePeriodNs + m_queueNs.load() + m_playbackPeriodNs) / 1000000.0;
+    s.underruns = m_underruns.load();
+    s.droppedMs = m_bytesPerSec > 0 ? m_droppedBytes.load() * 1000 / m_bytesPerSec : 0;
+    return s;
+}
+
+double AudioMonitor::maxAddedMs() const {
+    if (m_bytesPerSec <= 0) return 0.0;
+    return (m_maxFillBytes * 1000.0 / m_bytesPerSec) + m_playbackPeriodNs / 1000000.0;
+}
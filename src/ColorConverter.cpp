@@ -0,0 +1,421 @@
+#include "ColorConverter.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CC_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CC_X86) && defined(__GNUC__)
+#define CC_TARGET_SSE2 __attribute__((target("sse2")))
+#define CC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CC_TARGET_SSE2
+#define CC_TARGET_AVX2
+#endif
+
+namespace {
+
+// BT.709, limited range, 14-bit fixed point.
+// Y  =  0.18259 R + 0.61423 G + 0.06201 B + 16
+// Cb = -0.10064 R - 0.33857 G + 0.43922 B + 128
+// Cr =  0.43922 R - 0.39894 G - 0.04027 B + 128
+// Chroma is computed from the sum of a 2x2 block, hence the extra 2 bits of shift.
+const int kYR = 2992, kYG = 10063, kYB = 1016;
+const int kUR = -1649, kUG = -5547, kUB = 7196;
+const int kVR = 7196, kVG = -6536, kVB = -660;
+const int kYShift = 14;
+const int kCShift = 16;
+const int kYBias = (16 << kYShift) + (1 << (kYShift - 1));
+const int kCBias = (128 << kCShift) + (1 << (kCShift - 1));
+const int kC444Bias = (128 << kYShift) + (1 << (kYShift - 1)); // 4:4:4 chroma from a single pixel
+
+// Coefficients in source byte order: c0 for byte 0, c1 for byte 1, c2 for byte 2
+struct Coeffs {
+    int y0, y1, y2;
+    int u0, u1, u2;
+    int v0, v1, v2;
+};
+
+Coeffs makeCoeffs(bool rgbOrder) {
+    if (rgbOrder) return { kYR, kYG, kYB, kUR, kUG, kUB, kVR, kVG, kVB };
+    return { kYB, kYG, kYR, kUB, kUG, kUR, kVB, kVG, kVR };
+}
+
+// Converts two source rows into two luma rows and one chroma row, starting at pixel x
+void rowPairScalar(const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1,
+                   uint8_t *u, uint8_t *v, int x, int width, const Coeffs &c) {
+    for (; x < width; x += 2) {
+        const uint8_t *a = s0 + x * 4, *b = a + 4;
+        const uint8_t *d = s1 + x * 4, *e = d + 4;
+        y0[x]     = (uint8_t)((c.y0 * a[0] + c.y1 * a[1] + c.y2 * a[2] + kYBias) >> kYShift);
+        y0[x + 1] = (uint8_t)((c.y0 * b[0] + c.y1 * b[1] + c.y2 * b[2] + kYBias) >> kYShift);
+        y1[x]     = (uint8_t)((c.y0 * d[0] + c.y1 * d[1] + c.y2 * d[2] + kYBias) >> kYShift);
+        y1[x + 1] = (uint8_t)((c.y0 * e[0] + c.y1 * e[1] + c.y2 * e[2] + kYBias) >> kYShift);
+        int s0c = a[0] + b[0] + d[0] + e[0];
+        int s1c = a[1] + b[1] + d[1] + e[1];
+        int s2c = a[2] + b[2] + d[2] + e[2];
+        u[x / 2] = (uint8_t)((c.u0 * s0c + c.u1 * s1c + c.u2 * s2c + kCBias) >> kCShift);
+        v[x / 2] = (uint8_t)((c.v0 * s0c + c.v1 * s1c + c.v2 * s2c + kCBias) >> kCShift);
+    }
+}
+
+// One source row into full-resolution Y, U and V rows, starting at pixel x
+void row444Scalar(const uint8_t *s, uint8_t *y, uint8_t *u, uint8_t *v, int x, int width, const Coeffs &c) {
+    for (; x < width; x++) {
+        const uint8_t *p = s + x * 4;
+        y[x] = (uint8_t)((c.y0 * p[0] + c.y1 * p[1] + c.y2 * p[2] + kYBias) >> kYShift);
+        u[x] = (uint8_t)((c.u0 * p[0] + c.u1 * p[1] + c.u2 * p[2] + kC444Bias) >> kYShift);
+        v[x] = (uint8_t)((c.v0 * p[0] + c.v1 * p[1] + c.v2 * p[2] + kC444Bias) >> kYShift);
+    }
+}
+
+#ifdef CC_X86
+// Packs two int16 coefficients into one 32-bit lane for _mm_madd_epi16
+inline int pair16(int lo, int hi) {
+    return (int)((uint32_t)(uint16_t)lo | ((uint32_t)(uint16_t)hi << 16));
+}
+
+// Each 32-bit pixel is split into 16-bit pairs (byte0, byte2) and (byte1, byte3);
+// madd against (c0, c2) and (c1, 0) gives the exact scalar dot product.
+CC_TARGET_SSE2 inline __m128i dot4(__m128i lo, __m128i hi, __m128i cLo, __m128i cHi, __m128i bias, int shift) {
+    __m128i acc = _mm_add_epi32(_mm_madd_epi16(lo, cLo), _mm_madd_epi16(hi, cHi));
+    return _mm_srai_epi32(_mm_add_epi32(acc, bias), shift);
+}
+
+CC_TARGET_SSE2 int rowPairSse2(const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1,
+                               uint8_t *u, uint8_t *v, int width, const Coeffs &c) {
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i yLo = _mm_set1_epi32(pair16(c.y0, c.y2)), yHi = _mm_set1_epi32(pair16(c.y1, 0));
+    const __m128i uLo = _mm_set1_epi32(pair16(c.u0, c.u2)), uHi = _mm_set1_epi32(pair16(c.u1, 0));
+    const __m128i vLo = _mm_set1_epi32(pair16(c.v0, c.v2)), vHi = _mm_set1_epi32(pair16(c.v1, 0));
+    const __m128i yBias = _mm_set1_epi32(kYBias), cBias = _mm_set1_epi32(kCBias);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i ya[4], yb[4], cu[4], cv[4];
+        for (int i = 0; i < 4; i++) {
+            __m128i p0 = _mm_loadu_si128((const __m128i*)(s0 + (x + i * 4) * 4));
+            __m128i p1 = _mm_loadu_si128((const __m128i*)(s1 + (x + i * 4) * 4));
+            __m128i lo0 = _mm_and_si128(p0, mask), hi0 = _mm_and_si128(_mm_srli_epi32(p0, 8), mask);
+            __m128i lo1 = _mm_and_si128(p1, mask), hi1 = _mm_and_si128(_mm_srli_epi32(p1, 8), mask);
+            ya[i] = dot4(lo0, hi0, yLo, yHi, yBias, kYShift);
+            yb[i] = dot4(lo1, hi1, yLo, yHi, yBias, kYShift);
+            // 2x2 sums land in the even 32-bit lanes
+            __m128i lo = _mm_add_epi16(lo0, lo1), hi = _mm_add_epi16(hi0, hi1);
+            lo = _mm_add_epi16(lo, _mm_srli_epi64(lo, 32));
+            hi = _mm_add_epi16(hi, _mm_srli_epi64(hi, 32));
+            cu[i] = _mm_shuffle_epi32(dot4(lo, hi, uLo, uHi, cBias, kCShift), _MM_SHUFFLE(3, 1, 2, 0));
+            cv[i] = _mm_shuffle_epi32(dot4(lo, hi, vLo, vHi, cBias, kCShift), _MM_SHUFFLE(3, 1, 2, 0));
+        }
+        _mm_storeu_si128((__m128i*)(y0 + x), _mm_packus_epi16(_mm_packs_epi32(ya[0], ya[1]), _mm_packs_epi32(ya[2], ya[3])));
+        _mm_storeu_si128((__m128i*)(y1 + x), _mm_packus_epi16(_mm_packs_epi32(yb[0], yb[1]), _mm_packs_epi32(yb[2], yb[3])));
+        __m128i u16 = _mm_packs_epi32(_mm_unpacklo_epi64(cu[0], cu[1]), _mm_unpacklo_epi64(cu[2], cu[3]));
+        __m128i v16 = _mm_packs_epi32(_mm_unpacklo_epi64(cv[0], cv[1]), _mm_unpacklo_epi64(cv[2], cv[3]));
+        _mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(u16, u16));
+        _mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(v16, v16));
+    }
+    return x;
+}
+
+CC_TARGET_SSE2 int row444Sse2(const uint8_t *s, uint8_t *y, uint8_t *u, uint8_t *v, int width, const Coeffs &c) {
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i yLo = _mm_set1_epi32(pair16(c.y0, c.y2)), yHi = _mm_set1_epi32(pair16(c.y1, 0));
+    const __m128i uLo = _mm_set1_epi32(pair16(c.u0, c.u2)), uHi = _mm_set1_epi32(pair16(c.u1, 0));
+    const __m128i vLo = _mm_set1_epi32(pair16(c.v0, c.v2)), vHi = _mm_set1_epi32(pair16(c.v1, 0));
+    const __m128i yBias = _mm_set1_epi32(kYBias), cBias = _mm_set1_epi32(kC444Bias);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i ys[4], us[4], vs[4];
+        for (int i = 0; i < 4; i++) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(s + (x + i * 4) * 4));
+            __m128i lo = _mm_and_si128(p, mask), hi = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+            ys[i] = dot4(lo, hi, yLo, yHi, yBias, kYShift);
+            us[i] = dot4(lo, hi, uLo, uHi, cBias, kYShift);
+            vs[i] = dot4(lo, hi, vLo, vHi, cBias, kYShift);
+        }
+        _mm_storeu_si128((__m128i*)(y + x), _mm_packus_epi16(_mm_packs_epi32(ys[0], ys[1]), _mm_packs_epi32(ys[2], ys[3])));
+        _mm_storeu_si128((__m128i*)(u + x), _mm_packus_epi16(_mm_packs_epi32(us[0], us[1]), _mm_packs_epi32(us[2], us[3])));
+        _mm_storeu_si128((__m128i*)(v + x), _mm_packus_epi16(_mm_packs_epi32(vs[0], vs[1]), _mm_packs_epi32(vs[2], vs[3])));
+    }
+    return x;
+}
+
+CC_TARGET_AVX2 inline __m256i dot8(__m256i lo, __m256i hi, __m256i cLo, __m256i cHi, __m256i bias, int shift) {
+    __m256i acc = _mm256_add_epi32(_mm256_madd_epi16(lo, cLo), _mm256_madd_epi16(hi, cHi));
+    return _mm256_srai_epi32(_mm256_add_epi32(acc, bias), shift);
+}
+
+// 8 x int32 -> 8 x uint8 (saturated) in the low half of a 128-bit register
+CC_TARGET_AVX2 inline __m128i pack8(__m256i a, __m256i b) {
+    __m128i a16 = _mm_packs_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+    __m128i b16 = _mm_packs_epi32(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1));
+    return _mm_packus_epi16(a16, b16);
+}
+
+// Gathers the even 32-bit lanes of two registers into natural order
+CC_TARGET_AVX2 inline __m256i evenLanes(__m256i a, __m256i b) {
+    a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+    b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+CC_TARGET_AVX2 int rowPairAvx2(const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1,
+                               uint8_t *u, uint8_t *v, int width, const Coeffs &c) {
+    const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i yLo = _mm256_set1_epi32(pair16(c.y0, c.y2)), yHi = _mm256_set1_epi32(pair16(c.y1, 0));
+    const __m256i uLo = _mm256_set1_epi32(pair16(c.u0, c.u2)), uHi = _mm256_set1_epi32(pair16(c.u1, 0));
+    const __m256i vLo = _mm256_set1_epi32(pair16(c.v0, c.v2)), vHi = _mm256_set1_epi32(pair16(c.v1, 0));
+    const __m256i yBias = _mm256_set1_epi32(kYBias), cBias = _mm256_set1_epi32(kCBias);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i ya[4], yb[4], cu[4], cv[4];
+        for (int i = 0; i < 4; i++) {
+            __m256i p0 = _mm256_loadu_si256((const __m256i*)(s0 + (x + i * 8) * 4));
+            __m256i p1 = _mm256_loadu_si256((const __m256i*)(s1 + (x + i * 8) * 4));
+            __m256i lo0 = _mm256_and_si256(p0, mask), hi0 = _mm256_and_si256(_mm256_srli_epi32(p0, 8), mask);
+            __m256i lo1 = _mm256_and_si256(p1, mask), hi1 = _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask);
+            ya[i] = dot8(lo0, hi0, yLo, yHi, yBias, kYShift);
+            yb[i] = dot8(lo1, hi1, yLo, yHi, yBias, kYShift);
+            __m256i lo = _mm256_add_epi16(lo0, lo1), hi = _mm256_add_epi16(hi0, hi1);
+            lo = _mm256_add_epi16(lo, _mm256_srli_epi64(lo, 32));
+            hi = _mm256_add_epi16(hi, _mm256_srli_epi64(hi, 32));
+            cu[i] = dot8(lo, hi, uLo, uHi, cBias, kCShift);
+            cv[i] = dot8(lo, hi, vLo, vHi, cBias, kCShift);
+        }
+        _mm_storeu_si128((__m128i*)(y0 + x), pack8(ya[0], ya[1]));
+        _mm_storeu_si128((__m128i*)(y0 + x + 16), pack8(ya[2], ya[3]));
+        _mm_storeu_si128((__m128i*)(y1 + x), pack8(yb[0], yb[1]));
+        _mm_storeu_si128((__m128i*)(y1 + x + 16), pack8(yb[2], yb[3]));
+        _mm_storeu_si128((__m128i*)(u + x / 2), pack8(evenLanes(cu[0], cu[1]), evenLanes(cu[2], cu[3])));
+        _mm_storeu_si128((__m128i*)(v + x / 2), pack8(evenLanes(cv[0], cv[1]), evenLanes(cv[2], cv[3])));
+    }
+    return x;
+}
+
+CC_TARGET_AVX2 int row444Avx2(const uint8_t *s, uint8_t *y, uint8_t *u, uint8_t *v, int width, const Coeffs &c) {
+    const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i yLo = _mm256_set1_epi32(pair16(c.y0, c.y2)), yHi = _mm256_set1_epi32(pair16(c.y1, 0));
+    const __m256i uLo = _mm256_set1_epi32(pair16(c.u0, c.u2)), uHi = _mm256_set1_epi32(pair16(c.u1, 0));
+    const __m256i vLo = _mm256_set1_epi32(pair16(c.v0, c.v2)), vHi = _mm256_set1_epi32(pair16(c.v1, 0));
+    const __m256i yBias = _mm256_set1_epi32(kYBias), cBias = _mm256_set1_epi32(kC444Bias);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i ys[2], us[2], vs[2];
+        for (int i = 0; i < 2; i++) {
+            __m256i p = _mm256_loadu_si256((const __m256i*)(s + (x + i * 8) * 4));
+            __m256i lo = _mm256_and_si256(p, mask), hi = _mm256_and_si256(_mm256_srli_epi32(p, 8), mask);
+            ys[i] = dot8(lo, hi, yLo, yHi, yBias, kYShift);
+            us[i] = dot8(lo, hi, uLo, uHi, cBias, kYShift);
+            vs[i] = dot8(lo, hi, vLo, vHi, cBias, kYShift);
+        }
+        _mm_storeu_si128((__m128i*)(y + x), pack8(ys[0], ys[1]));
+        _mm_storeu_si128((__m128i*)(u + x), pack8(us[0], us[1]));
+        _mm_storeu_si128((__m128i*)(v + x), pack8(vs[0], vs[1]));
+    }
+    return x;
+}
+#endif
+
+} // namespace
+
+ColorConverter::ColorConverter() {}
+
+ColorConverter::~ColorConverter() {
+    stopWorkers();
+}
+
+bool ColorConverter::supports(AVPixelFormat srcFmt, int srcW, int srcH, AVPixelFormat dstFmt, int dstW, int dstH) {
+    bool packed32 = (srcFmt == AV_PIX_FMT_BGRA || srcFmt == AV_PIX_FMT_BGR0 ||
+                     srcFmt == AV_PIX_FMT_RGBA || srcFmt == AV_PIX_FMT_RGB0);
+    if (!packed32 || srcW != dstW || srcH != dstH || srcW < 2 || srcH < 2) return false;
+    if (dstFmt == AV_PIX_FMT_YUV444P) return true;
+    return dstFmt == AV_PIX_FMT_YUV420P && srcW % 2 == 0 && srcH % 2 == 0;
+}
+
+ColorConverter::Isa ColorConverter::detectIsa() {
+#ifdef CC_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) return Avx2;
+    }
+    return sse2 ? Sse2 : Scalar;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Avx2;
+    if (__builtin_cpu_supports("sse2")) return Sse2;
+    return Scalar;
+#endif
+#else
+    return Scalar;
+#endif
+}
+
+const char *ColorConverter::isaName(Isa isa) {
+    switch (isa) {
+        case Avx2: return "AVX2";
+        case Sse2: return "SSE2";
+        default: return "C";
+    }
+}
+
+bool ColorConverter::init(int width, int height, AVPixelFormat srcFmt, AVPixelFormat dstFmt, int threads,
+                          Isa maxIsa) {
+    stopWorkers();
+    if (!supports(srcFmt, width, height, dstFmt, width, height)) return false;
+
+    m_width = width;
+    m_height = height;
+    m_rgbOrder = (srcFmt == AV_PIX_FMT_RGBA || srcFmt == AV_PIX_FMT_RGB0);
+    m_444 = (dstFmt == AV_PIX_FMT_YUV444P);
+    m_isa = qMin(detectIsa(), maxIsa);
+
+    // Roughly one band per 512 rows (a 4K frame uses 4); never more than the cores
+    if (threads <= 0) threads = qBound(1, height / 512, QThread::idealThreadCount());
+    m_bands = qBound(1, threads, height / 2);
+
+    m_quit = false;
+    m_generation = 0;
+    m_pending = 0;
+    for (int b = 1; b < m_bands; b++) {
+        QThread *t = QThread::create([this, b](){ workerFunc(b); });
+        t->start();
+        m_workers.push_back(t);
+    }
+    return true;
+}
+
+void ColorConverter::stopWorkers() {
+    {
+        QMutexLocker lock(&m_mutex);
+        m_quit = true;
+        m_condStart.wakeAll();
+    }
+    for (QThread *t : m_workers) {
+        t->wait();
+        delete t;
+    }
+    m_workers.clear();
+    m_bands = 1;
+}
+
+void ColorConverter::convert(const AVFrame *src, AVFrame *dst, const std::vector<RowSpan> *dirtyRows) {
+    Job job;
+    job.src = src->data[0];
+    job.srcStride = src->linesize[0];
+    for (int i = 0; i < 3; i++) {
+        job.dst[i] = dst->data[i];
+        job.dstStride[i] = dst->linesize[i];
+    }
+
+    if (dirtyRows) {
+        m_rowMask.assign(m_height, 0);
+        int changed = 0;
+        for (const RowSpan &span : *dirtyRows) {
+            int first = qMax(span.first, 0), last = qMin(span.last, m_height);
+            for (int r = first; r < last; r++) {
+                if (!m_rowMask[r]) { m_rowMask[r] = 1; changed++; }
+            }
+        }
+        if (changed == 0) return;
+        job.rowMask = m_rowMask.data();
+        // A few changed rows (cursor, caret, a clock) aren't worth waking the band workers
+        if (changed < 256) {
+            for (int b = 0; b < m_bands; b++) m_444 ? convertBand444(job, b) : convertBand(job, b);
+            return;
+        }
+    }
+
+    if (m_bands <= 1) {
+        m_444 ? convertBand444(job, 0) : convertBand(job, 0);
+        return;
+    }
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_job = job;
+        m_pending = m_bands - 1;
+        m_generation++;
+        m_condStart.wakeAll();
+    }
+    m_444 ? convertBand444(job, 0) : convertBand(job, 0);
+
+    QMutexLocker lock(&m_mutex);
+    while (m_pending > 0) m_condDone.wait(&m_mutex);
+}
+
+void ColorConverter::workerFunc(int band) {
+    quint64 seen = 0;
+    while (true) {
+        Job job;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (!m_quit && m_generation == seen) m_condStart.wait(&m_mutex);
+            if (m_quit) break;
+            seen = m_generation;
+            job = m_job;
+        }
+        m_444 ? convertBand444(job, band) : convertBand(job, band);
+        QMutexLocker lock(&m_mutex);
+        if (--m_pending == 0) m_condDone.wakeOne();
+    }
+}
+
+void ColorConverter::convertBand(const Job &job, int band) const {
+    // Bands are whole row pairs so each one owns its chroma rows
+    int pairs = m_height / 2;
+    int firstPair = pairs * band / m_bands;
+    int lastPair = pairs * (band + 1) / m_bands;
+    Coeffs c = makeCoeffs(m_rgbOrder);
+
+    for (int p = firstPair; p < lastPair; p++) {
+        if (job.rowMask && !job.rowMask[p * 2] && !job.rowMask[p * 2 + 1]) continue;
+        const uint8_t *s0 = job.src + (int64_t)(p * 2) * job.srcStride;
+        const uint8_t *s1 = s0 + job.srcStride;
+        uint8_t *y0 = job.dst[0] + (int64_t)(p * 2) * job.dstStride[0];
+        uint8_t *y1 = y0 + job.dstStride[0];
+        uint8_t *u = job.dst[1] + (int64_t)p * job.dstStride[1];
+        uint8_t *v = job.dst[2] + (int64_t)p * job.dstStride[2];
+
+        int x = 0;
+#ifdef CC_X86
+        if (m_isa == Avx2) x = rowPairAvx2(s0, s1, y0, y1, u, v, m_width, c);
+        else if (m_isa == Sse2) x = rowPairSse2(s0, s1, y0, y1, u, v, m_width, c);
+#endif
+        rowPairScalar(s0, s1, y0, y1, u, v, x, m_width, c);
+    }
+}
+
+void ColorConverter::convertBand444(const Job &job, int band) const {
+    int firstRow = m_height * band / m_bands;
+    int lastRow = m_height * (band + 1) / m_bands;
+    Coeffs c = makeCoeffs(m_rgbOrder);
+
+    for (int r = firstRow; r < lastRow; r++) {
+        if (job.rowMask && !job.rowMask[r]) continue;
+        const uint8_t *s = job.src + (int64_t)r * job.srcStride;
+        uint8_t *y = job.dst[0] + (int64_t)r * job.dstStride[0];
+        uint8_t *u = job.dst[1] + (int64_t)r * job.dstStride[1];
+        uint8_t *v = job.dst[2] + (int64_t)r * job.dstStride[2];
+
+        int x = 0;
+#ifdef CC_X86
+        if (m_isa == Avx2) x = row444Avx2(s, y, u, v, m_width, c);
+        else if (m_isa == Sse2) x = row444Sse2(s, y, u, v, m_width, c);
+#endif
+        row444Scalar(s, y, u, v, x, m_width, c);
+    }
+}
@@ -0,0 +1,49 @@
+#include "CursorViewport.h"
+#include <QtGlobal>
+#include <cmath>
+
+namespace {
+const double kDeadZone = 0.6;        // Fraction of the viewport the cursor may roam without panning
+const double kTimeConstantSec = 0.15; // Pan easing; ~95% of the way after 0.45 s
+}
+
+void CursorViewport::reset(int frameW, int frameH, int viewW, int viewH) {
+    m_frameW = frameW;
+    m_frameH = frameH;
+    m_viewW = qMax(2, qMin(viewW, frameW) & ~1);
+    m_viewH = qMax(2, qMin(viewH, frameH) & ~1);
+    m_lastNs = -1;
+    m_rect = QRect(0, 0, m_viewW, m_viewH);
+}
+
+QRect CursorViewport::update(const QPoint &cursor, int64_t nowNs) {
+    if (m_lastNs < 0) {
+        m_cx = cursor.x();
+        m_cy = cursor.y();
+    } else {
+        // Nearest centre that puts the cursor back inside the dead zone
+        double zoneX = m_viewW * kDeadZone / 2.0;
+        double zoneY = m_viewH * kDeadZone / 2.0;
+        double tx = m_cx, ty = m_cy;
+        if (cursor.x() > m_cx + zoneX) tx = cursor.x() - zoneX;
+        else if (cursor.x() < m_cx - zoneX) tx = cursor.x() + zoneX;
+        if (cursor.y() > m_cy + zoneY) ty = cursor.y() - zoneY;
+        else if (cursor.y() < m_cy - zoneY) ty = cursor.y() + zoneY;
+
+        // Frame-rate independent exponential easing
+        double dt = qMax<int64_t>(0, nowNs - m_lastNs) / 1e9;
+        double k = 1.0 - std::exp(-dt / kTimeConstantSec);
+        m_cx += (tx - m_cx) * k;
+        m_cy += (ty - m_cy) * k;
+    }
+    m_lastNs = nowNs;
+
+    // Keep the centre where the viewport fits; the cursor can't drag it off the frame
+    m_cx = qBound(m_viewW / 2.0, m_cx, m_frameW - m_viewW / 2.0);
+    m_cy = qBound(m_viewH / 2.0, m_cy, m_frameH - m_viewH / 2.0);
+
+    int x = qBound(0, (int)std::lround(m_cx - m_viewW / 2.0), m_frameW - m_viewW) & ~1;
+    int y = qBound(0, (int)std::lround(m_cy - m_viewH / 2.0), m_frameH - m_viewH) & ~1;
+    m_rect = QRect(x, y, m_viewW, m_viewH);
+    return m_rect;
+}
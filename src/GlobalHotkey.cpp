@@ -74,6 +74,7 @@ void GlobalHotkey::unregisterAll() {
 #ifdef Q_OS_WIN
     UnregisterHotKey(nullptr, ShowMainWindow);
     UnregisterHotKey(nullptr, StartStopRecording);
+    UnregisterHotKey(nullptr, AddMarker);
 #endif
 }
 
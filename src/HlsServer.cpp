@@ -0,0 +1,76 @@
+#include "HlsServer.h"
+#include <QTcpSocket>
+#include <QFile>
+#include <QRegularExpression>
+
+const char *HlsServer::kPlaylistName = "live.m3u8";
+
+HlsServer::HlsServer(QObject *parent) : QObject(parent) {
+    connect(&m_server, &QTcpServer::newConnection, this, &HlsServer::onNewConnection);
+}
+
+HlsServer::~HlsServer() {
+    stop();
+}
+
+bool HlsServer::start(const QString &dir, quint16 port, bool lan) {
+    stop();
+    m_dir = dir;
+    return m_server.listen(lan ? QHostAddress::Any : QHostAddress::LocalHost, port);
+}
+
+void HlsServer::stop() {
+    if (m_server.isListening()) m_server.close();
+}
+
+QString HlsServer::playlistUrl() const {
+    return QString("http://127.0.0.1:%1/%2").arg(m_server.serverPort()).arg(kPlaylistName);
+}
+
+void HlsServer::onNewConnection() {
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { handleRequest(socket); });
+    }
+}
+
+void HlsServer::handleRequest(QTcpSocket *socket) {
+    // Only the request line matters; wait until it is complete
+    if (!socket->canReadLine()) {
+        if (socket->bytesAvailable() > 8192) socket->abort();
+        return;
+    }
+    QList<QByteArray> parts = socket->readLine().trimmed().split(' ');
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+    if (parts.size() < 2 || (parts[0] != "GET" && parts[0] != "HEAD")) {
+        reply(socket, 405, "Method Not Allowed", "text/plain", "405 Method Not Allowed\n", false);
+        return;
+    }
+    bool headOnly = parts[0] == "HEAD";
+    QString name = QString::fromUtf8(parts[1].split('?').first()).mid(1);
+    if (name.isEmpty()) name = kPlaylistName;
+
+    // Flat names from the output directory only, so no path can leave it
+    static const QRegularExpression kSafeName("^[A-Za-z0-9_-]+\\.(m3u8|m4s|mp4)$");
+    QFile file(m_dir + "/" + name);
+    if (!kSafeName.match(name).hasMatch() || !file.open(QIODevice::ReadOnly)) {
+        reply(socket, 404, "Not Found", "text/plain", "404 Not Found\n", headOnly);
+        return;
+    }
+    QByteArray type = name.endsWith(".m3u8") ? "application/vnd.apple.mpegurl" : "video/mp4";
+    reply(socket, 200, "OK", type, file.readAll(), headOnly);
+}
+
+void HlsServer::reply(QTcpSocket *socket, int status, const QByteArray &reason, const QByteArray &contentType,
+                      const QByteArray &body, bool headOnly) {
+    QByteArray header = "HTTP/1.0 " + QByteArray::number(status) + " " + reason + "\r\n"
+            "Content-Type: " + contentType + "\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            // The playlist changes every segment; browsers play it through hls.js
+            "Cache-Control: no-cache\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "Connection: close\r\n\r\n";
+    socket->write(header);
+    if (!headOnly) socket->write(body);
+    socket->disconnectFromHost();
+}
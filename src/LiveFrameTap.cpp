@@ -0,0 +1,40 @@
+#include "LiveFrameTap.h"
+
+LiveFrameTap::LiveFrameTap(QObject *parent) : QObject(parent) {}
+
+LiveFrameTap::~LiveFrameTap() {
+    av_frame_free(&m_pending);
+}
+
+void LiveFrameTap::setActive(bool active, int intervalMs) {
+    m_intervalNs = (int64_t)qMax(1, intervalMs) * 1000000;
+    m_active = active;
+    if (!active) {
+        QMutexLocker lock(&m_mutex);
+        av_frame_free(&m_pending);
+    }
+}
+
+void LiveFrameTap::offer(const AVFrame *frame, int64_t timeNs) {
+    if (!m_active.load()) return;
+    if (m_lastOfferNs != INT64_MIN && timeNs - m_lastOfferNs < m_intervalNs.load()) return;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_pending) {
+            // The monitor hasn't caught up; it gets the next one instead
+            m_skipped++;
+            return;
+        }
+        m_pending = av_frame_clone(frame);
+        if (!m_pending) return;
+    }
+    m_lastOfferNs = timeNs;
+    emit frameAvailable();
+}
+
+AVFrame *LiveFrameTap::take() {
+    QMutexLocker lock(&m_mutex);
+    AVFrame *frame = m_pending;
+    m_pending = nullptr;
+    return frame;
+}
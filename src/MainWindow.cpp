@@ -260,6 +260,14 @@ MainWindow::MainWindow(QWidget *parent)
     });
 
     connect(m_recorder, &RecorderController::audioLevelsCalculated, this, &MainWindow::updateAudioLevels);
+    connect(m_recorder, &RecorderController::storageWarning, this, [this](const QString &msg){
+        ToastTip::warning(this, msg, 5000);
+        logMessage(msg);
+    });
+    connect(m_recorder, &RecorderController::markerAdded, this, [this](qint64 ms){
+        ToastTip::info(this, QString("已添加标记 %1").arg(formatTime(ms)));
+        logMessage(QString("Marker added at %1").arg(formatTime(ms)));
+    });
 
     // Initial Load
     refreshHistoryList();
@@ -282,7 +290,7 @@ MainWindow::MainWindow(QWidget *parent)
 }
 
 MainWindow::~MainWindow() {
-    if (m_recorder && m_recorder->state() == RecorderController::Recording) {
+    if (m_recorder && m_recorder->state() != RecorderController::Stopped) {
         m_recorder->stopRecording();
     }
     if (m_floatingBall) delete m_floatingBall;
@@ -818,9 +826,7 @@ void MainWindow::onStartStopClicked() {
     onSelectAreaClicked();
 }
 
-void MainWindow::startRecordingInternal() {
-    m_pendingRecording = false;
-    
+void MainWindow::configureRecorder() {
     if (m_chkSysAudio->isChecked() && !m_recorder->checkSystemAudioAvailable()) {
         ToastTip::warning(this, "系统声音设备不可用");
         m_chkSysAudio->setChecked(false);
@@ -829,11 +835,18 @@ void MainWindow::startRecordingInternal() {
     // 录制区域往内缩小2px，避免把框线录进去
     QRect recordRegion = m_currentSelection.adjusted(2, 2, -2, -2);
     m_recorder->setRegion(recordRegion);
+    m_recorder->setWindow(m_overlay ? m_overlay->selectedWindow() : 0);
     m_recorder->setAudioConfig(m_chkSysAudio->isChecked(), m_sliderSysVol->value() / 100.0, 
                                m_chkMicAudio->isChecked(), m_sliderMicVol->value() / 100.0);
     
     m_recorder->setFps(m_settings->value("fps", 30).toInt());
+}
 
+void MainWindow::startRecordingInternal() {
+    m_pendingRecording = false;
+
+    // Normally armed when the area was selected; otherwise this is a cold start
+    if (m_recorder->state() != RecorderController::Armed) configureRecorder();
     m_recorder->startRecording();
     
     // Save current audio config
@@ -846,9 +859,23 @@ void MainWindow::startRecordingInternal() {
 }
 
 void MainWindow::onRecorderStateChanged(RecorderController::State state) {
+    if (state == RecorderController::Armed) {
+        return; // Overlay stays up until the countdown finishes
+    }
     if (state == RecorderController::Recording) {
         m_btnStartStop->setEnabled(false);
         m_btnSettings->setEnabled(false);
+        registerMarkerHotkey(true);
+
+        // The preview area monitors what is being recorded
+        if (m_isPlaying) {
+            m_isPlaying = false;
+            m_btnPlayPause->setIcon(createIcon(style()->standardIcon(QStyle::SP_MediaPlay), getThemeIconColor()));
+            m_rangeSlider->setPlaybackValue(-1);
+        }
+        m_player->show();
+        m_previewLabel->hide();
+        m_player->startLive(m_recorder->liveTap());
         
         // Timer should start here, when actual recording starts
         m_currentDuration = 0; // Reset duration
@@ -862,12 +889,24 @@ void MainWindow::onRecorderStateChanged(RecorderController::State state) {
         // Re-enable UI
         m_btnStartStop->setEnabled(true);
         m_btnSettings->setEnabled(true);
+        registerMarkerHotkey(false);
         m_recTimer->stop();
+        if (m_player->isLive()) {
+            m_player->stopLive(); // The finished recording is loaded once it is saved
+            if (m_lastRecordedFile.isEmpty()) {
+                m_player->hide();
+                m_previewLabel->show();
+            }
+        }
         
-        // Close overlay and show main window
-        if (m_overlay) {
+        // Close overlay and show main window (only when it was showing a recording:
+        // the final Stopped after Finalizing must not reset a new selection)
+        if (m_overlay && m_overlay->isRecording()) {
             m_overlay->stopRecording();
         }
+        if (state == RecorderController::Finalizing) {
+            logMessage("Finalizing recording...");
+        }
     }
 }
 
@@ -901,11 +940,28 @@ void MainWindow::loadVideo(const QString &path, qint64 durationMs) {
     m_btnPlayPause->setIcon(createIcon(style()->standardIcon(QStyle::SP_MediaPause), getThemeIconColor()));
     
     m_isPlaying = true;
-    m_totalDuration = getVideoDuration(path); 
+    // Recordings carry a sidecar index; other files are probed
+    bool indexed = m_index.load(path);
+    m_totalDuration = indexed ? m_index.durationMs() : getVideoDuration(path);
     if (durationMs > 0) m_totalDuration = durationMs;
+    if (indexed) {
+        const RecordingIndex::EncoderParams &enc = m_index.encoder();
+        logMessage(QString("Index: %1 %2x%3 %4 fps, %5 keyframes").arg(enc.videoCodec).arg(enc.width).arg(enc.height)
+                   .arg(av_q2d(enc.frameRate), 0, 'f', 2).arg(m_index.keyframes().size()));
+    }
     
     m_rangeSlider->setRange(0, 1000);
     m_rangeSlider->setValues(0, 1000);
+    QList<int> markers;
+    int waveformEnd = 0;
+    if (m_totalDuration > 0) {
+        for (qint64 ms : indexed ? m_index.markersMs() : VideoUtils::readMarkers(path)) {
+            markers.append((int)(ms * 1000 / m_totalDuration));
+        }
+        waveformEnd = (int)qMin<qint64>(1000, (qint64)(m_index.peaks().size() * m_index.peakIntervalMs()) * 1000 / m_totalDuration);
+    }
+    m_rangeSlider->setMarkers(markers);
+    m_rangeSlider->setWaveform(indexed ? m_index.peaks() : QVector<quint8>(), waveformEnd);
     
     updateTimeLabel(0, m_totalDuration);
 }
@@ -1028,9 +1084,18 @@ void MainWindow::onAreaSelected(const QRect &rect) {
     m_currentSelection = rect;
     // 不再立即显示主窗口，等待用户点击工具栏上的开始按钮
     logMessage(QString("Area selected: %1x%2").arg(rect.width()).arg(rect.height()));
+
+    // 预先打开采集设备和编码器，倒计时结束即可开始录制
+    // 同步取消预备：异步停止此时仍处于保存状态，下面无法重新预备
+    m_recorder->disarm();
+    if (m_recorder->state() == RecorderController::Stopped) {
+        configureRecorder();
+        m_recorder->armRecording();
+    }
 }
 
 void MainWindow::onSelectionCancelled() {
+    if (m_recorder->state() == RecorderController::Armed) m_recorder->stopRecording();
     showNormal();
 }
 
@@ -1049,6 +1114,8 @@ void MainWindow::onTrimClicked() {
     
     qint64 startMs = m_rangeSlider->lowerValue() * m_totalDuration / 1000;
     qint64 endMs = m_rangeSlider->upperValue() * m_totalDuration / 1000;
+    // A stream copy starts on the first keyframe at or after the handle
+    if (m_index.isValid() && m_index.keyframeAtOrAfter(startMs) >= 0) startMs = m_index.keyframeAtOrAfter(startMs);
     
     if (endMs <= startMs) {
         ToastTip::warning(this, "剪切范围无效");
@@ -1206,6 +1273,12 @@ void MainWindow::onDeleteHistoryClicked() {
 
     for (QListWidgetItem *item : selectedItems) {
         QString id = item->data(Qt::UserRole).toString();
+        // The recording itself stays on disk; its preview proxy is only a cache
+        for (const auto &rec : m_historyMgr->getHistory()) {
+            if (rec.id != id) continue;
+            QFile::remove(VideoUtils::proxyPathFor(rec.filePath));
+            QFile::remove(RecordingIndex::pathFor(VideoUtils::proxyPathFor(rec.filePath)));
+        }
             m_historyMgr->deleteRecord(id);
         delete m_listHistory->takeItem(m_listHistory->row(item));
     }
@@ -1351,6 +1424,19 @@ void MainWindow::registerHotkeys() {
     }
 }
 
+void MainWindow::registerMarkerHotkey(bool enable) {
+    // Only held while recording, so the key stays free for other applications otherwise
+    GlobalHotkey *hotkey = GlobalHotkey::instance();
+    hotkey->unregisterHotkey(GlobalHotkey::AddMarker);
+    if (!enable) return;
+    QKeySequence seq = SettingsDialog::getAddMarkerHotkey();
+    if (!seq.isEmpty()) {
+        HotkeyEdit tempEdit;
+        tempEdit.setKeySequence(seq);
+        hotkey->forceRegisterHotkey(GlobalHotkey::AddMarker, tempEdit.getModifiers(), tempEdit.getVirtualKey());
+    }
+}
+
 void MainWindow::onHotkeyTriggered(int id) {
     switch (id) {
         case GlobalHotkey::ShowMainWindow:
@@ -1383,6 +1469,10 @@ void MainWindow::onHotkeyTriggered(int id) {
                 onSelectAreaClicked();
             }
             break;
+            
+        case GlobalHotkey::AddMarker:
+            m_recorder->addMarker();
+            break;
     }
 }
 
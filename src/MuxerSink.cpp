@@ -0,0 +1,263 @@
+#include "MuxerSink.h"
+#include "VideoEncoderPreset.h"
+#include <QFile>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#endif
+
+MuxerSink::MuxerSink() {}
+
+MuxerSink::~MuxerSink() {
+    close(0);
+}
+
+QString MuxerSink::formatFor(const QString &url) {
+    QString scheme = url.section("://", 0, 0).toLower();
+    if (scheme == "rtmp" || scheme == "rtmps") return "flv";
+    if (scheme == "srt" || scheme == "udp" || scheme == "tcp" || scheme == "rtp") return "mpegts";
+    return QString(); // Local files and the like: guessed from the name
+}
+
+QString MuxerSink::pipeUrlFor(const QString &target, QMap<QString, QString> *options, QString *error) {
+#ifdef Q_OS_UNIX
+    // A consumer that exits must fail the sink (EPIPE), not kill the recorder
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    if (target == "-" || target == "stdout") return "pipe:1";
+    if (target.startsWith("unix:")) {
+#ifdef Q_OS_UNIX
+        // A socket left by an earlier run would make bind() fail
+        QByteArray path = target.mid(5).toLocal8Bit();
+        struct stat st;
+        if (stat(path.constData(), &st) == 0 && S_ISSOCK(st.st_mode)) ::unlink(path.constData());
+        (*options)["listen"] = "1";
+        return target;
+#else
+        *error = "此系统不支持 Unix 套接字";
+        return QString();
+#endif
+    }
+#ifdef Q_OS_UNIX
+    // Opening a FIFO for writing blocks until there is a reader, and nothing could
+    // interrupt that; check for one without blocking first
+    QByteArray path = target.toLocal8Bit();
+    struct stat st;
+    if (stat(path.constData(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int fd = ::open(path.constData(), O_WRONLY | O_NONBLOCK);
+        if (fd < 0) {
+            *error = QString("管道 %1 没有读取端，请先启动接收程序").arg(target);
+            return QString();
+        }
+        ::close(fd);
+        return "file:" + target;
+    }
+#endif
+    if (target.startsWith("\\\\.\\pipe\\")) return "file:" + target;
+    *error = QString("不支持的管道输出: %1").arg(target);
+    return QString();
+}
+
+bool MuxerSink::open(const QString &url, const QString &format, const QMap<QString, QString> &options,
+                     const AVCodecContext *video, const AVCodecContext *audio) {
+    close(0);
+    if (url.isEmpty() || !video) return false;
+    m_url = url;
+    m_format = format.isEmpty() ? formatFor(url) : format;
+    m_options = options;
+    m_error.clear();
+    m_failed = false;
+    m_abort = false;
+    m_packets = 0;
+    m_dropped = 0;
+    m_bytes = 0;
+    m_stop = false;
+    m_waitKeyframe = true;
+    m_queuedBytes = 0;
+
+    // Parameters are copied: the encoders may be gone before the writer thread finishes
+    m_videoPar = avcodec_parameters_alloc();
+    avcodec_parameters_from_context(m_videoPar, video);
+    m_videoTb = video->time_base;
+    if (audio) {
+        m_audioPar = avcodec_parameters_alloc();
+        avcodec_parameters_from_context(m_audioPar, audio);
+        m_audioTb = audio->time_base;
+    }
+
+    m_thread = QThread::create([this](){ threadFunc(); });
+    m_thread->start();
+    return true;
+}
+
+void MuxerSink::close(int timeoutMs) {
+    if (!m_thread) return;
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_cond.wakeAll();
+    }
+    // A dead relay must not hold up finalizing the recording
+    if (!m_thread->wait(timeoutMs > 0 ? timeoutMs : 1)) {
+        m_abort = true;
+        m_cond.wakeAll();
+        m_thread->wait();
+    }
+    delete m_thread;
+    m_thread = nullptr;
+    {
+        QMutexLocker lock(&m_mutex);
+        clearQueue();
+    }
+    avcodec_parameters_free(&m_videoPar);
+    avcodec_parameters_free(&m_audioPar);
+}
+
+QString MuxerSink::errorString() const {
+    QMutexLocker lock(&m_mutex);
+    return m_error;
+}
+
+MuxerSink::Stats MuxerSink::stats() const {
+    Stats s;
+    s.packets = m_packets.load();
+    s.dropped = m_dropped.load();
+    s.bytes = m_bytes.load();
+    QMutexLocker lock(&m_mutex);
+    s.queuedBytes = m_queuedBytes;
+    return s;
+}
+
+void MuxerSink::push(const AVPacket *pkt, AVRational tb, StreamKind kind) {
+    if (!m_thread || m_failed.load()) return;
+    bool key = kind == Video && (pkt->flags & AV_PKT_FLAG_KEY);
+    QMutexLocker lock(&m_mutex);
+    if (m_stop) return;
+    if (m_queuedBytes + pkt->size > kMaxQueuedBytes) {
+        // The writer can't keep up: give up what is queued rather than block or grow
+        m_dropped += (qint64)m_queue.size();
+        clearQueue();
+        m_waitKeyframe = true;
+    }
+    if (m_waitKeyframe) {
+        if (!key) { m_dropped++; return; }
+        m_waitKeyframe = false;
+    }
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref) return;
+    m_queue.push_back({ ref, tb, kind });
+    m_queuedBytes += ref->size;
+    m_cond.wakeOne();
+}
+
+void MuxerSink::clearQueue() {
+    for (Item &item : m_queue) av_packet_free(&item.pkt);
+    m_queue.clear();
+    m_queuedBytes = 0;
+}
+
+void MuxerSink::setError(const QString &msg) {
+    QMutexLocker lock(&m_mutex);
+    if (m_error.isEmpty()) m_error = msg;
+    m_failed = true;
+    clearQueue();
+}
+
+int MuxerSink::interruptCallback(void *opaque) {
+    return static_cast<MuxerSink*>(opaque)->m_abort.load() ? 1 : 0;
+}
+
+bool MuxerSink::openOutput() {
+    QByteArray url = m_url.toUtf8();
+    QByteArray format = m_format.toUtf8();
+    avformat_alloc_output_context2(&m_fmtCtx, nullptr, format.isEmpty() ? nullptr : format.constData(), url.constData());
+    if (!m_fmtCtx) { setError("不支持的输出格式"); return false; }
+    m_fmtCtx->interrupt_callback = { &MuxerSink::interruptCallback, this };
+
+    AVCodecParameters *pars[2] = { m_videoPar, m_audioPar };
+    AVRational tbs[2] = { m_videoTb, m_audioTb };
+    for (int i = 0; i < 2; i++) {
+        if (!pars[i]) continue;
+        AVStream *st = avformat_new_stream(m_fmtCtx, nullptr);
+        if (!st) { setError("无法创建输出流"); return false; }
+        if (avformat_query_codec(m_fmtCtx->oformat, pars[i]->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+            // FLV (RTMP) takes no HEVC / AV1
+            setError(QString("%1 格式不支持 %2 编码").arg(m_fmtCtx->oformat->name, avcodec_get_name(pars[i]->codec_id)));
+            return false;
+        }
+        avcodec_parameters_copy(st->codecpar, pars[i]);
+        // Let the muxer pick its own tag, except HEVC in fMP4 (hvc1)
+        st->codecpar->codec_tag = VideoEncoderPreset::codecTagFor(m_fmtCtx->oformat, pars[i]->codec_id);
+        st->time_base = tbs[i];      // A hint; the muxer may change it in write_header
+        m_streamIndex[i] = st->index;
+    }
+
+    AVDictionary *opts = nullptr;
+    for (auto it = m_options.constBegin(); it != m_options.constEnd(); ++it) {
+        av_dict_set(&opts, it.key().toUtf8().constData(), it.value().toUtf8().constData(), 0);
+    }
+    if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE)) {
+        AVDictionary *ioOpts = nullptr;
+        av_dict_copy(&ioOpts, opts, 0);
+        int ret = avio_open2(&m_fmtCtx->pb, url.constData(), AVIO_FLAG_WRITE, &m_fmtCtx->interrupt_callback, &ioOpts);
+        av_dict_free(&ioOpts);
+        if (ret < 0) {
+            char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+            av_strerror(ret, err, sizeof(err));
+            setError(QString("无法连接 %1 (%2)").arg(m_url, err));
+            av_dict_free(&opts);
+            return false;
+        }
+    }
+    int ret = avformat_write_header(m_fmtCtx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, err, sizeof(err));
+        setError(QString("写入 %1 头失败 (%2)").arg(m_url, err));
+        return false;
+    }
+    return true;
+}
+
+void MuxerSink::threadFunc() {
+    bool headerWritten = openOutput();
+    while (headerWritten) {
+        Item item;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.empty() && !m_stop && !m_abort.load()) m_cond.wait(&m_mutex);
+            if (m_abort.load() || m_queue.empty()) break; // Aborted, or stopped and drained
+            item = m_queue.front();
+            m_queue.pop_front();
+            m_queuedBytes -= item.pkt->size;
+        }
+        int streamIdx = m_streamIndex[item.kind];
+        if (streamIdx >= 0) {
+            int size = item.pkt->size;
+            item.pkt->stream_index = streamIdx;
+            av_packet_rescale_ts(item.pkt, item.tb, m_fmtCtx->streams[streamIdx]->time_base);
+            int ret = av_interleaved_write_frame(m_fmtCtx, item.pkt);
+            if (ret < 0) {
+                char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+                av_strerror(ret, err, sizeof(err));
+                setError(QString("%1 写入失败 (%2)").arg(m_url, err));
+                av_packet_free(&item.pkt);
+                break;
+            }
+            m_packets++;
+            m_bytes += size;
+        }
+        av_packet_free(&item.pkt);
+    }
+
+    if (m_fmtCtx) {
+        if (headerWritten && !m_failed.load()) av_write_trailer(m_fmtCtx);
+        if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE)) avio_closep(&m_fmtCtx->pb);
+        avformat_free_context(m_fmtCtx);
+        m_fmtCtx = nullptr;
+    }
+    m_streamIndex[0] = m_streamIndex[1] = -1;
+}
@@ -1,11 +1,16 @@
 #include "NativePlayerWidget.h"
 #include "LogManager.h"
+#include "VideoUtils.h"
 #include <QDebug>
 #include <QDateTime>
 #include <QElapsedTimer>
 #include <QStandardPaths>
 #include <QFile>
 #include <QTextStream>
+#include <QGenericMatrix>
+#include <QVector3D>
+#include <QGuiApplication>
+#include <QScreen>
 
 // TRACE LOGGING
 static void trace(const QString& msg) {
@@ -87,6 +92,36 @@ void PacketQueue::start() {
     size = 0;
 }
 
+// Copies a decoded frame into a tightly packed planar buffer. 4:2:0 and 4:4:4 frames are
+// copied as they are; other formats are converted to 4:2:0 through *sws.
+static bool packFrame(const AVFrame *frame, SwsContext **sws, PlayerFrame &out) {
+    int w = frame->width, h = frame->height;
+    AVPixelFormat fmt = (AVPixelFormat)frame->format;
+    out.width = w;
+    out.height = h;
+    out.chroma444 = (fmt == AV_PIX_FMT_YUV444P || fmt == AV_PIX_FMT_YUVJ444P);
+    out.bt709 = (frame->colorspace == AVCOL_SPC_BT709);
+    out.fullRange = (frame->color_range == AVCOL_RANGE_JPEG || fmt == AV_PIX_FMT_YUVJ420P || fmt == AV_PIX_FMT_YUVJ444P);
+    bool direct = out.chroma444 || fmt == AV_PIX_FMT_YUV420P || fmt == AV_PIX_FMT_YUVJ420P;
+
+    AVPixelFormat packedFmt = out.chroma444 ? AV_PIX_FMT_YUV444P : AV_PIX_FMT_YUV420P;
+    int size = av_image_get_buffer_size(packedFmt, w, h, 1);
+    if (size <= 0) return false;
+    out.data.resize(size);
+    uint8_t *dst[4];
+    int lines[4];
+    av_image_fill_arrays(dst, lines, (uint8_t*)out.data.data(), packedFmt, w, h, 1);
+
+    if (direct) {
+        av_image_copy(dst, lines, (const uint8_t**)frame->data, frame->linesize, packedFmt, w, h);
+        return true;
+    }
+    *sws = sws_getCachedContext(*sws, w, h, fmt, w, h, AV_PIX_FMT_YUV420P, SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (!*sws) return false;
+    sws_scale(*sws, frame->data, frame->linesize, 0, h, dst, lines);
+    return true;
+}
+
 // --- Shader Sources ---
 static const char *vertexShaderSource =
     "attribute vec4 vertexIn;\n"
@@ -102,18 +137,31 @@ static const char *fragmentShaderSource =
     "uniform sampler2D tex_y;\n"
     "uniform sampler2D tex_u;\n"
     "uniform sampler2D tex_v;\n"
+    "uniform mat3 colorMatrix;\n"
+    "uniform vec3 colorOffset;\n"
     "void main(void) {\n"
     "    vec3 yuv;\n"
-    "    vec3 rgb;\n"
     "    yuv.x = texture2D(tex_y, textureOut).r;\n"
-    "    yuv.y = texture2D(tex_u, textureOut).r - 0.5;\n"
-    "    yuv.z = texture2D(tex_v, textureOut).r - 0.5;\n"
-    "    rgb = mat3( 1,       1,         1,\n"
-    "                0,       -0.39465,  2.03211,\n"
-    "                1.13983, -0.58060,  0) * yuv;\n"
-    "    gl_FragColor = vec4(rgb, 1);\n"
+    "    yuv.y = texture2D(tex_u, textureOut).r;\n"
+    "    yuv.z = texture2D(tex_v, textureOut).r;\n"
+    "    gl_FragColor = vec4(clamp(colorMatrix * (yuv - colorOffset), 0.0, 1.0), 1);\n"
     "}\n";
 
+// YCbCr -> RGB for the shader, including the range expansion
+static QMatrix3x3 yuvToRgbMatrix(bool bt709, bool fullRange) {
+    double kr = bt709 ? 0.2126 : 0.299;
+    double kb = bt709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    double ys = fullRange ? 1.0 : 255.0 / 219.0;
+    double cs = fullRange ? 1.0 : 255.0 / 224.0;
+    float m[9] = {
+        (float)ys, 0.0f,                                       (float)(cs * 2.0 * (1.0 - kr)),
+        (float)ys, (float)(-cs * 2.0 * kb * (1.0 - kb) / kg),  (float)(-cs * 2.0 * kr * (1.0 - kr) / kg),
+        (float)ys, (float)(cs * 2.0 * (1.0 - kb)),             0.0f
+    };
+    return QMatrix3x3(m);
+}
+
 // --- NativePlayerWidget Implementation ---
 
 NativePlayerWidget::NativePlayerWidget(QWidget *parent) 
@@ -127,6 +175,7 @@ NativePlayerWidget::NativePlayerWidget(QWidget *parent)
         qDebug() << "Could not initialize SDL -" << SDL_GetError();
         trace("SDL Init Failed");
     }
+    qRegisterMetaType<PlayerFrame>("PlayerFrame");
     connect(this, &NativePlayerWidget::frameReady, this, &NativePlayerWidget::onFrameReady, Qt::QueuedConnection);
     
     m_previewThread = QThread::create([this](){ previewThreadFunc(); });
@@ -135,6 +184,7 @@ NativePlayerWidget::NativePlayerWidget(QWidget *parent)
 
 NativePlayerWidget::~NativePlayerWidget() {
     trace("Destructor");
+    stopLive();
     stopPlay();
     m_isPreviewRunning = false;
     m_semPreview.release();
@@ -155,12 +205,14 @@ void NativePlayerWidget::setRange(qint64 startMs, qint64 endMs) {
 
 void NativePlayerWidget::startPlay(const QString &filePath) {
     trace(QString("startPlay: %1, Range: %2-%3").arg(filePath).arg(m_startMs).arg(m_endMs));
+    stopLive();
     stopPlay();
-    m_filePath = filePath;
+    // Recordings with a proxy play from it; trims and exports still read filePath
+    m_filePath = VideoUtils::previewPathFor(filePath);
     m_isRunning = true;
     m_isPreviewActive = false; // Clear preview flag when starting playback
     m_audioClock = 0; // Fix: Reset audio clock to prevent fast playback
-    m_currentYUV.clear();
+    m_currentFrame.data.clear();
     
     m_videoQ.start();
     m_audioQ.start(); // Audio Queue Start
@@ -174,6 +226,7 @@ void NativePlayerWidget::freePreviewResources() {
     if (m_previewCodecCtx) { avcodec_free_context(&m_previewCodecCtx); m_previewCodecCtx = nullptr; }
     if (m_previewFmtCtx) { avformat_close_input(&m_previewFmtCtx); m_previewFmtCtx = nullptr; }
     m_previewStreamIdx = -1;
+    m_previewIndex.clear();
     m_currentOpenPath.clear();
 }
 
@@ -182,11 +235,13 @@ void NativePlayerWidget::seek(const QString &filePath, qint64 ms) {
     // stopPlay() would clear resources and block, interfering with preview
     
     trace(QString("seek called: file=%1, ms=%2").arg(filePath).arg(ms));
+    if (m_liveTap) return; // The live monitor owns the view while recording
     
     m_isPreviewActive = true; // Mark preview as active
     
+    QString previewPath = VideoUtils::previewPathFor(filePath); // Scrubbing decodes the proxy
     QMutexLocker lock(&m_previewMutex);
-    m_previewPath = filePath;
+    m_previewPath = previewPath;
     m_reqPreviewMs = ms;
     m_semPreview.release(); // Wake up preview thread
 }
@@ -222,7 +277,11 @@ void NativePlayerWidget::previewThreadFunc() {
             if (avformat_open_input(&m_previewFmtCtx, filePath.toUtf8().constData(), nullptr, nullptr) < 0) {
                  if (avformat_open_input(&m_previewFmtCtx, filePath.toLocal8Bit().constData(), nullptr, nullptr) < 0) continue;
             }
-            if (avformat_find_stream_info(m_previewFmtCtx, nullptr) < 0) { freePreviewResources(); continue; }
+            // A recording's sidecar already says what probing would find out
+            if (!m_previewIndex.load(filePath) && avformat_find_stream_info(m_previewFmtCtx, nullptr) < 0) {
+                freePreviewResources();
+                continue;
+            }
             
             m_previewStreamIdx = -1;
             for(unsigned int i=0; i<m_previewFmtCtx->nb_streams; i++) {
@@ -231,6 +290,7 @@ void NativePlayerWidget::previewThreadFunc() {
             if(m_previewStreamIdx < 0) { freePreviewResources(); continue; }
             
             AVCodec *dec = avcodec_find_decoder(m_previewFmtCtx->streams[m_previewStreamIdx]->codecpar->codec_id);
+            if (!dec) { freePreviewResources(); continue; }
             m_previewCodecCtx = avcodec_alloc_context3(dec);
             avcodec_parameters_to_context(m_previewCodecCtx, m_previewFmtCtx->streams[m_previewStreamIdx]->codecpar);
             avcodec_open2(m_previewCodecCtx, dec, nullptr);
@@ -243,6 +303,11 @@ void NativePlayerWidget::previewThreadFunc() {
         int64_t startTs = (st && st->start_time != AV_NOPTS_VALUE) ? st->start_time : 0;
         int64_t ts = ms * 1000;
         ts = av_rescale_q(ts, AVRational{1, 1000000}, st->time_base) + startTs;
+        if (m_previewIndex.isValid()) {
+            // Seek straight to the keyframe the decode has to start from
+            int64_t keyPts = m_previewIndex.keyframePtsAtOrBefore(ms);
+            if (keyPts != AV_NOPTS_VALUE) ts = av_rescale_q(keyPts, m_previewIndex.timeBase(), st->time_base) + startTs;
+        }
         
         auto decodeNearestFrame = [&](int seekFlags, int64_t seekTargetTs) -> bool {
             // Robust Seek: Use avformat_seek_file which is generally better than av_seek_frame for complex containers
@@ -331,26 +396,12 @@ void NativePlayerWidget::previewThreadFunc() {
 
             bool emitted = false;
             if (hasCandidate && candidateFrame->width > 0) {
-                if (!m_previewSwsCtx) {
-                    m_previewSwsCtx = sws_getContext(candidateFrame->width, candidateFrame->height, (AVPixelFormat)candidateFrame->format,
-                                                     candidateFrame->width, candidateFrame->height, AV_PIX_FMT_YUV420P,
-                                                     SWS_BICUBIC, nullptr, nullptr, nullptr);
-                } else if (m_previewCodecCtx->width != candidateFrame->width || m_previewCodecCtx->height != candidateFrame->height) {
-                    sws_freeContext(m_previewSwsCtx);
-                    m_previewSwsCtx = sws_getContext(candidateFrame->width, candidateFrame->height, (AVPixelFormat)candidateFrame->format,
-                                                     candidateFrame->width, candidateFrame->height, AV_PIX_FMT_YUV420P,
-                                                     SWS_BICUBIC, nullptr, nullptr, nullptr);
+                PlayerFrame out;
+                if (packFrame(candidateFrame, &m_previewSwsCtx, out)) {
+                    trace(QString("Preview emit: ms=%1 w=%2 h=%3 444=%4").arg(ms).arg(out.width).arg(out.height).arg(out.chroma444));
+                    emit frameReady(out);
+                    emitted = true;
                 }
-
-                int w = candidateFrame->width;
-                int h = candidateFrame->height;
-                QByteArray yuv; yuv.resize(w * h * 3 / 2);
-                uint8_t *dst[4] = { (uint8_t*)yuv.data(), (uint8_t*)yuv.data() + w*h, (uint8_t*)yuv.data() + w*h*5/4, nullptr };
-                int lines[4] = { w, w/2, w/2, 0 };
-                sws_scale(m_previewSwsCtx, candidateFrame->data, candidateFrame->linesize, 0, h, dst, lines);
-                trace(QString("Preview emit: ms=%1 w=%2 h=%3").arg(ms).arg(w).arg(h));
-                emit frameReady(yuv, w, h);
-                emitted = true;
             }
 
             av_frame_free(&frame);
@@ -392,6 +443,60 @@ void NativePlayerWidget::stopPlay() {
     trace("stopPlay finished");
 }
 
+void NativePlayerWidget::startLive(LiveFrameTap *tap) {
+    stopPlay();
+    stopLive();
+    if (!tap) return;
+    m_liveTap = tap;
+    // At most one frame per screen refresh; anything faster would never be seen
+    QScreen *screen = QGuiApplication::primaryScreen();
+    qreal hz = screen && screen->refreshRate() > 1 ? screen->refreshRate() : 60.0;
+    int intervalMs = qMax(1, (int)(1000.0 / hz));
+    connect(tap, &LiveFrameTap::frameAvailable, this, &NativePlayerWidget::onLiveFrame, Qt::QueuedConnection);
+    tap->setActive(true, intervalMs);
+    trace(QString("startLive: %1 ms interval").arg(intervalMs));
+}
+
+void NativePlayerWidget::stopLive() {
+    if (!m_liveTap) return;
+    m_liveTap->setActive(false);
+    disconnect(m_liveTap, nullptr, this, nullptr);
+    trace(QString("stopLive: %1 frames skipped").arg(m_liveTap->skippedFrames()));
+    m_liveTap = nullptr;
+    m_liveUploaded = false;
+    m_currentFrame = PlayerFrame();
+    update();
+}
+
+void NativePlayerWidget::onLiveFrame() {
+    if (!m_liveTap) return;
+    AVFrame *frame = m_liveTap->take();
+    if (!frame) return;
+    AVPixelFormat fmt = (AVPixelFormat)frame->format;
+    bool chroma444 = fmt == AV_PIX_FMT_YUV444P;
+    // Minimized while recording: just hand the reference back
+    if (isVisible() && m_program && (chroma444 || fmt == AV_PIX_FMT_YUV420P)) {
+        // Upload straight from the recorder's planes and release them before the next
+        // picture is converted; paintGL only draws the textures
+        int cw = chroma444 ? frame->width : (frame->width + 1) / 2;
+        int ch = chroma444 ? frame->height : (frame->height + 1) / 2;
+        makeCurrent();
+        uploadPlane(m_texY, 0, frame->width, frame->height, frame->data[0], frame->linesize[0]);
+        uploadPlane(m_texU, 1, cw, ch, frame->data[1], frame->linesize[1]);
+        uploadPlane(m_texV, 2, cw, ch, frame->data[2], frame->linesize[2]);
+        doneCurrent();
+        m_currentFrame = PlayerFrame();
+        m_currentFrame.width = frame->width;
+        m_currentFrame.height = frame->height;
+        m_currentFrame.chroma444 = chroma444;
+        m_currentFrame.bt709 = frame->colorspace == AVCOL_SPC_BT709;
+        m_currentFrame.fullRange = frame->color_range == AVCOL_RANGE_JPEG;
+        m_liveUploaded = true;
+        update();
+    }
+    av_frame_free(&frame);
+}
+
 void NativePlayerWidget::freeResources() {
     trace("freeResources");
     m_videoQ.clear();
@@ -553,7 +658,8 @@ void NativePlayerWidget::readThreadFunc() {
             return;
         }
     }
-    if (avformat_find_stream_info(m_fmtCtx, nullptr) < 0) return;
+    RecordingIndex index;
+    if (!index.load(m_filePath) && avformat_find_stream_info(m_fmtCtx, nullptr) < 0) return;
 
     // Find Video Stream
     m_vStreamIdx = -1;
@@ -568,6 +674,13 @@ void NativePlayerWidget::readThreadFunc() {
     }
 
     // Open Video
+    if (m_vStreamIdx >= 0 && !avcodec_find_decoder(m_fmtCtx->streams[m_vStreamIdx]->codecpar->codec_id)) {
+        // AV1 needs libdav1d or libaom in the FFmpeg build
+        const char *codecName = avcodec_get_name(m_fmtCtx->streams[m_vStreamIdx]->codecpar->codec_id);
+        emit logMessage(QString("无法播放 %1 视频：当前 FFmpeg 不包含该解码器").arg(codecName));
+        trace(QString("No decoder for %1").arg(codecName));
+        m_vStreamIdx = -1;
+    }
     if (m_vStreamIdx >= 0) {
         AVCodec *dec = avcodec_find_decoder(m_fmtCtx->streams[m_vStreamIdx]->codecpar->codec_id);
         m_vCodecCtx = avcodec_alloc_context3(dec);
@@ -617,7 +730,14 @@ void NativePlayerWidget::readThreadFunc() {
         int64_t startTs = (st && st->start_time != AV_NOPTS_VALUE) ? st->start_time : 0;
         trace(QString("readThreadFunc Initial Seek: %1 (start_time=%2)").arg(m_startMs).arg(startTs));
         int64_t ts = av_rescale_q(m_startMs * 1000, AVRational{1, 1000000}, st->time_base) + startTs;
-        avformat_seek_file(m_fmtCtx, m_vStreamIdx, INT64_MIN, ts, INT64_MAX, 0);
+        int64_t keyPts = index.isValid() ? index.keyframePtsAtOrBefore(m_startMs) : AV_NOPTS_VALUE;
+        if (keyPts != AV_NOPTS_VALUE) {
+            // Land on the keyframe before the start; pre-roll skips the frames up to it
+            ts = av_rescale_q(keyPts, index.timeBase(), st->time_base) + startTs;
+            avformat_seek_file(m_fmtCtx, m_vStreamIdx, INT64_MIN, ts, ts, AVSEEK_FLAG_BACKWARD);
+        } else {
+            avformat_seek_file(m_fmtCtx, m_vStreamIdx, INT64_MIN, ts, INT64_MAX, 0);
+        }
     }
 
     AVPacket pkt;
@@ -745,20 +865,9 @@ void NativePlayerWidget::videoThreadFunc() {
                     // Convert to ms (absolute)
                     int64_t videoMsAbs = (int64_t)(pts * 1000.0);
 
-                    if (!m_swsCtx) {
-                        m_swsCtx = sws_getContext(m_vCodecCtx->width, m_vCodecCtx->height, m_vCodecCtx->pix_fmt,
-                                                  m_vCodecCtx->width, m_vCodecCtx->height, AV_PIX_FMT_YUV420P,
-                                                  SWS_BICUBIC, nullptr, nullptr, nullptr);
-                    }
-                    int w = m_vCodecCtx->width;
-                    int h = m_vCodecCtx->height;
-                    QByteArray yuv; yuv.resize(w * h * 3 / 2);
-                    uint8_t *dst[4] = { (uint8_t*)yuv.data(), (uint8_t*)yuv.data() + w*h, (uint8_t*)yuv.data() + w*h*5/4, nullptr };
-                    int lines[4] = { w, w/2, w/2, 0 };
-                    sws_scale(m_swsCtx, frame->data, frame->linesize, 0, h, dst, lines);
-
-                    if (!m_isPreviewActive) {
-                        emit frameReady(yuv, w, h);
+                    PlayerFrame out;
+                    if (packFrame(frame, &m_swsCtx, out) && !m_isPreviewActive) {
+                        emit frameReady(out);
                         emit positionChanged((qint64)videoMsAbs);
                     }
                 }
@@ -864,22 +973,13 @@ void NativePlayerWidget::videoThreadFunc() {
                     continue;
                 }
 
-                if (!m_swsCtx) {
-                     m_swsCtx = sws_getContext(m_vCodecCtx->width, m_vCodecCtx->height, m_vCodecCtx->pix_fmt,
-                                               m_vCodecCtx->width, m_vCodecCtx->height, AV_PIX_FMT_YUV420P,
-                                               SWS_BICUBIC, nullptr, nullptr, nullptr);
-                }
-                
-                int w = m_vCodecCtx->width;
-                int h = m_vCodecCtx->height;
-                QByteArray yuv; yuv.resize(w * h * 3 / 2);
-                uint8_t *dst[4] = { (uint8_t*)yuv.data(), (uint8_t*)yuv.data() + w*h, (uint8_t*)yuv.data() + w*h*5/4, nullptr };
-                int lines[4] = { w, w/2, w/2, 0 };
-                sws_scale(m_swsCtx, frame->data, frame->linesize, 0, h, dst, lines);
+                // 4:2:0 / 4:4:4 frames are copied straight to the GL upload buffer
+                PlayerFrame out;
+                if (!packFrame(frame, &m_swsCtx, out)) continue;
                 
                 // Don't send playback frames if preview is active (preview takes priority)
                 if (!m_isPreviewActive) {
-                    emit frameReady(yuv, w, h);
+                    emit frameReady(out);
                     emit positionChanged((qint64)videoMsAbs);
                 }
             }
@@ -902,42 +1002,38 @@ void NativePlayerWidget::initializeGL() {
     m_texYLoc = m_program->uniformLocation("tex_y");
     m_texULoc = m_program->uniformLocation("tex_u");
     m_texVLoc = m_program->uniformLocation("tex_v");
+    m_colorMatrixLoc = m_program->uniformLocation("colorMatrix");
+    m_colorOffsetLoc = m_program->uniformLocation("colorOffset");
     m_texY = new QOpenGLTexture(QOpenGLTexture::Target2D); m_texY->create();
     m_texU = new QOpenGLTexture(QOpenGLTexture::Target2D); m_texU->create();
     m_texV = new QOpenGLTexture(QOpenGLTexture::Target2D); m_texV->create();
 }
 void NativePlayerWidget::resizeGL(int w, int h) { glViewport(0, 0, w, h); }
-void NativePlayerWidget::onFrameReady(const QByteArray &data, int width, int height) {
+void NativePlayerWidget::onFrameReady(const PlayerFrame &frame) {
     // Accept all frames: preview thread only sends when preview is active,
     // playback thread skips sending when preview is active (see videoThreadFunc)
+    if (m_liveTap) return; // A late preview frame must not cover the live monitor
     trace(QString("onFrameReady: bytes=%1 w=%2 h=%3 previewActive=%4 running=%5")
-              .arg(data.size()).arg(width).arg(height)
+              .arg(frame.data.size()).arg(frame.width).arg(frame.height)
               .arg(m_isPreviewActive.load() ? 1 : 0)
               .arg(m_isRunning.load() ? 1 : 0));
-    m_currentYUV = data;
-    m_videoW = width;
-    m_videoH = height;
+    m_currentFrame = frame;
+    m_liveUploaded = false;
     update();
     // For preview scrubbing: also emit CPU image for QLabel preview (avoids OpenGL repaint issues on some machines)
-    if (!m_isRunning && width > 0 && height > 0 && data.size() >= (width * height * 3 / 2)) {
-        if (!m_rgbSwsCtx || m_rgbW != width || m_rgbH != height) {
-            if (m_rgbSwsCtx) sws_freeContext(m_rgbSwsCtx);
-            m_rgbSwsCtx = sws_getContext(width, height, AV_PIX_FMT_YUV420P,
-                                         width, height, AV_PIX_FMT_BGRA,
-                                         SWS_BILINEAR, nullptr, nullptr, nullptr);
-            m_rgbW = width;
-            m_rgbH = height;
-        }
+    int width = frame.width, height = frame.height;
+    AVPixelFormat fmt = frame.chroma444 ? AV_PIX_FMT_YUV444P : AV_PIX_FMT_YUV420P;
+    if (!m_isRunning && width > 0 && height > 0 && frame.data.size() >= av_image_get_buffer_size(fmt, width, height, 1)) {
+        m_rgbSwsCtx = sws_getCachedContext(m_rgbSwsCtx, width, height, fmt,
+                                           width, height, AV_PIX_FMT_BGRA,
+                                           SWS_BILINEAR, nullptr, nullptr, nullptr);
         if (m_rgbSwsCtx) {
+            sws_setColorspaceDetails(m_rgbSwsCtx, sws_getCoefficients(frame.bt709 ? SWS_CS_ITU709 : SWS_CS_DEFAULT), frame.fullRange ? 1 : 0,
+                                     sws_getCoefficients(SWS_CS_DEFAULT), 1, 0, 1 << 16, 1 << 16);
             QImage img(width, height, QImage::Format_ARGB32);
-            const uint8_t *base = (const uint8_t*)data.constData();
-            uint8_t *src[4] = {
-                (uint8_t*)base,
-                (uint8_t*)(base + width * height),
-                (uint8_t*)(base + width * height + (width * height) / 4),
-                nullptr
-            };
-            int srcLines[4] = { width, width / 2, width / 2, 0 };
+            uint8_t *src[4];
+            int srcLines[4];
+            av_image_fill_arrays(src, srcLines, (const uint8_t*)frame.data.constData(), fmt, width, height, 1);
             uint8_t *dst[4] = { (uint8_t*)img.bits(), nullptr, nullptr, nullptr };
             int dstLines[4] = { img.bytesPerLine(), 0, 0, 0 };
             sws_scale(m_rgbSwsCtx, src, srcLines, 0, height, dst, dstLines);
@@ -952,13 +1048,13 @@ void NativePlayerWidget::paintGL() {
     glClearColor(0, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (m_currentYUV.isEmpty()) return;
+    if (m_currentFrame.data.isEmpty() && !m_liveUploaded) return;
     
-    if (m_videoW > 0 && m_videoH > 0) {
+    if (m_currentFrame.width > 0 && m_currentFrame.height > 0) {
         float widgetW = width();
         float widgetH = height();
-        float videoW = m_videoW;
-        float videoH = m_videoH;
+        float videoW = m_currentFrame.width;
+        float videoH = m_currentFrame.height;
 
         float widgetRatio = widgetW / widgetH;
         float videoRatio = videoW / videoH;
@@ -989,28 +1085,50 @@ void NativePlayerWidget::paintGL() {
     glVertexAttribPointer(m_texAttr, 2, GL_FLOAT, GL_FALSE, 0, tex);
     glEnableVertexAttribArray(m_texAttr);
     
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    const uint8_t *d = (const uint8_t*)m_currentYUV.constData();
-    int w = m_videoW, h = m_videoH;
-    int y = w*h;
-    
-    glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, m_texY->textureId());
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, d);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, m_texU->textureId());
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, d+y);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, m_texV->textureId());
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w/2, h/2, 0, GL_RED, GL_UNSIGNED_BYTE, d+y+y/4);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (!m_liveUploaded) {
+        const uint8_t *d = (const uint8_t*)m_currentFrame.data.constData();
+        int w = m_currentFrame.width, h = m_currentFrame.height;
+        // 4:4:4 chroma planes are uploaded at full size, 4:2:0 at half (rounded up)
+        int cw = m_currentFrame.chroma444 ? w : (w + 1) / 2;
+        int ch = m_currentFrame.chroma444 ? h : (h + 1) / 2;
+        int y = w*h;
+        int c = cw*ch;
+        uploadPlane(m_texY, 0, w, h, d, w);
+        uploadPlane(m_texU, 1, cw, ch, d+y, cw);
+        uploadPlane(m_texV, 2, cw, ch, d+y+c, cw);
+    }
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, (i == 0 ? m_texY : i == 1 ? m_texU : m_texV)->textureId());
+    }
     
     glUniform1i(m_texYLoc, 0); glUniform1i(m_texULoc, 1); glUniform1i(m_texVLoc, 2);
+    m_program->setUniformValue(m_colorMatrixLoc, yuvToRgbMatrix(m_currentFrame.bt709, m_currentFrame.fullRange));
+    float yOff = m_currentFrame.fullRange ? 0.0f : 16.0f / 255.0f;
+    m_program->setUniformValue(m_colorOffsetLoc, QVector3D(yOff, 128.0f / 255.0f, 128.0f / 255.0f));
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     m_program->release();
 }
+
+void NativePlayerWidget::uploadPlane(QOpenGLTexture *tex, int unit, int w, int h, const uint8_t *data, int stride) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, tex->textureId());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (stride == w) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+    } else {
+        // Padded rows (frames straight from the recorder): let GL skip the padding
+#ifdef GL_UNPACK_ROW_LENGTH
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        for (int row = 0; row < h; row++) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, w, 1, GL_RED, GL_UNSIGNED_BYTE, data + (int64_t)row * stride);
+        }
+#endif
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
@@ -0,0 +1,296 @@
+#include "PipCompositor.h"
+#include <QElapsedTimer>
+#include <QStringList>
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PC_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(PC_X86) && defined(__GNUC__)
+#define PC_TARGET_SSE2 __attribute__((target("sse2")))
+#define PC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PC_TARGET_SSE2
+#define PC_TARGET_AVX2
+#endif
+
+namespace {
+
+// d = (s * a + d * (255 - a)) / 255, rounded. Every intermediate fits in 16 unsigned
+// bits, and (t + (t >> 8)) >> 8 is the exact rounded division for this range.
+void blendRowScalar(uint8_t *d, const uint8_t *s, const uint8_t *a, int x, int width) {
+    for (; x < width; x++) {
+        int t = s[x] * a[x] + d[x] * (255 - a[x]) + 128;
+        d[x] = (uint8_t)((t + (t >> 8)) >> 8);
+    }
+}
+
+#ifdef PC_X86
+PC_TARGET_SSE2 inline __m128i blend16Sse2(__m128i d, __m128i s, __m128i a) {
+    const __m128i c255 = _mm_set1_epi16(255), c128 = _mm_set1_epi16(128);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(c255, a)));
+    t = _mm_add_epi16(t, c128);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+PC_TARGET_SSE2 int blendRowSse2(uint8_t *d, const uint8_t *s, const uint8_t *a, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i dv = _mm_loadu_si128((const __m128i*)(d + x));
+        __m128i sv = _mm_loadu_si128((const __m128i*)(s + x));
+        __m128i av = _mm_loadu_si128((const __m128i*)(a + x));
+        __m128i lo = blend16Sse2(_mm_unpacklo_epi8(dv, zero), _mm_unpacklo_epi8(sv, zero), _mm_unpacklo_epi8(av, zero));
+        __m128i hi = blend16Sse2(_mm_unpackhi_epi8(dv, zero), _mm_unpackhi_epi8(sv, zero), _mm_unpackhi_epi8(av, zero));
+        _mm_storeu_si128((__m128i*)(d + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+PC_TARGET_AVX2 inline __m256i blend16Avx2(__m256i d, __m256i s, __m256i a) {
+    const __m256i c255 = _mm256_set1_epi16(255), c128 = _mm256_set1_epi16(128);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)));
+    t = _mm256_add_epi16(t, c128);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// Unpack and pack both work within 128-bit lanes, so bytes come back in order
+PC_TARGET_AVX2 int blendRowAvx2(uint8_t *d, const uint8_t *s, const uint8_t *a, int width) {
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i dv = _mm256_loadu_si256((const __m256i*)(d + x));
+        __m256i sv = _mm256_loadu_si256((const __m256i*)(s + x));
+        __m256i av = _mm256_loadu_si256((const __m256i*)(a + x));
+        __m256i lo = blend16Avx2(_mm256_unpacklo_epi8(dv, zero), _mm256_unpacklo_epi8(sv, zero), _mm256_unpacklo_epi8(av, zero));
+        __m256i hi = blend16Avx2(_mm256_unpackhi_epi8(dv, zero), _mm256_unpackhi_epi8(sv, zero), _mm256_unpackhi_epi8(av, zero));
+        _mm256_storeu_si256((__m256i*)(d + x), _mm256_packus_epi16(lo, hi));
+    }
+    return x + blendRowSse2(d + x, s + x, a + x, width - x);
+}
+#endif
+
+int interruptCallback(void *opaque) {
+    return static_cast<std::atomic<bool>*>(opaque)->load() ? 1 : 0;
+}
+
+} // namespace
+
+PipCompositor::PipCompositor() {}
+
+PipCompositor::~PipCompositor() {
+    close();
+}
+
+bool PipCompositor::open(const QString &source, const QString &options, int frameW, int frameH, AVPixelFormat fmt,
+                         Corner corner, int scalePercent, int opacityPercent, ColorConverter::Isa maxIsa) {
+    close();
+    m_error.clear();
+    m_sourceFrames = 0;
+    m_stop = false;
+    if (fmt != AV_PIX_FMT_YUV420P && fmt != AV_PIX_FMT_YUV444P) { m_error = "unsupported frame format"; return false; }
+    m_fmt = fmt;
+    m_chromaShift = fmt == AV_PIX_FMT_YUV444P ? 0 : 1;
+    m_isa = qMin(ColorConverter::detectIsa(), maxIsa);
+
+    // "format:device", unless the prefix is not an input format (URLs, drive letters)
+    QString device = source;
+    AVInputFormat *inFmt = nullptr;
+    int colon = source.indexOf(':');
+    if (colon > 0 && !source.contains("://")) {
+        inFmt = av_find_input_format(source.left(colon).toUtf8().constData());
+        if (inFmt) device = source.mid(colon + 1);
+    }
+    AVDictionary *opts = nullptr;
+    for (const QString &pair : options.split(',')) {
+        if (pair.trimmed().isEmpty()) continue;
+        av_dict_set(&opts, pair.section('=', 0, 0).trimmed().toUtf8().constData(),
+                    pair.section('=', 1).trimmed().toUtf8().constData(), 0);
+    }
+    m_fmtCtx = avformat_alloc_context();
+    m_fmtCtx->interrupt_callback = { &interruptCallback, &m_stop };
+    int ret = avformat_open_input(&m_fmtCtx, device.toUtf8().constData(), inFmt, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, err, sizeof(err));
+        m_error = QString("无法打开画中画源 %1 (%2)").arg(source, err);
+        m_fmtCtx = nullptr; // Freed by avformat_open_input on failure
+        return false;
+    }
+    avformat_find_stream_info(m_fmtCtx, nullptr);
+    m_streamIdx = av_find_best_stream(m_fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (m_streamIdx < 0) { m_error = "画中画源没有视频"; freeAll(); return false; }
+    AVCodecParameters *par = m_fmtCtx->streams[m_streamIdx]->codecpar;
+    AVCodec *dec = avcodec_find_decoder(par->codec_id);
+    m_decCtx = dec ? avcodec_alloc_context3(dec) : nullptr;
+    if (!m_decCtx || avcodec_parameters_to_context(m_decCtx, par) < 0 || avcodec_open2(m_decCtx, dec, nullptr) < 0) {
+        m_error = "画中画源无法解码";
+        freeAll();
+        return false;
+    }
+
+    // Inset keeps the source's aspect ratio; even size and position so chroma lines up
+    int srcW = m_decCtx->width > 0 ? m_decCtx->width : 16;
+    int srcH = m_decCtx->height > 0 ? m_decCtx->height : 9;
+    int w = qMax(32, frameW * qBound(10, scalePercent, 50) / 100) & ~1;
+    int h = (int)((int64_t)w * srcH / srcW) & ~1;
+    int maxH = (frameH - 2 * kMargin) & ~1;
+    if (h > maxH) {
+        h = maxH;
+        w = (int)((int64_t)h * srcW / srcH) & ~1;
+    }
+    if (w < 2 || h < 2 || w > frameW - 2 * kMargin) { m_error = "画面太小，无法放置画中画"; freeAll(); return false; }
+    bool right = corner == BottomRight || corner == TopRight;
+    bool bottom = corner == BottomRight || corner == BottomLeft;
+    int x = right ? (frameW - kMargin - w) & ~1 : kMargin;
+    int y = bottom ? (frameH - kMargin - h) & ~1 : kMargin;
+    m_rect = QRect(x, y, w, h);
+    buildAlpha(opacityPercent);
+
+    m_thread = QThread::create([this](){ threadFunc(); });
+    m_thread->start();
+    return true;
+}
+
+void PipCompositor::buildAlpha(int opacityPercent) {
+    int w = m_rect.width(), h = m_rect.height();
+    float opacity = qBound(0, opacityPercent, 100) * 2.55f;
+    float r = h / 12.0f; // Rounded corners, antialiased over one pixel
+    m_alphaY.resize((size_t)w * h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float cx = std::min(x + 0.5f, w - x - 0.5f);
+            float cy = std::min(y + 0.5f, h - y - 0.5f);
+            float cover = 1.0f;
+            if (cx < r && cy < r) {
+                float dist = std::sqrt((r - cx) * (r - cx) + (r - cy) * (r - cy));
+                cover = std::min(1.0f, std::max(0.0f, r - dist + 0.5f));
+            }
+            m_alphaY[(size_t)y * w + x] = (uint8_t)std::lround(cover * opacity);
+        }
+    }
+    if (m_chromaShift == 0) {
+        m_alphaC = m_alphaY;
+        return;
+    }
+    int cw = w / 2, ch = h / 2;
+    m_alphaC.resize((size_t)cw * ch);
+    for (int y = 0; y < ch; y++) {
+        const uint8_t *a0 = &m_alphaY[(size_t)(y * 2) * w];
+        const uint8_t *a1 = a0 + w;
+        for (int x = 0; x < cw; x++) {
+            m_alphaC[(size_t)y * cw + x] = (uint8_t)((a0[x * 2] + a0[x * 2 + 1] + a1[x * 2] + a1[x * 2 + 1] + 2) >> 2);
+        }
+    }
+}
+
+void PipCompositor::close() {
+    if (m_thread) {
+        m_stop = true;
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    freeAll();
+}
+
+void PipCompositor::freeAll() {
+    if (m_decCtx) avcodec_free_context(&m_decCtx);
+    if (m_fmtCtx) avformat_close_input(&m_fmtCtx);
+    if (m_swsCtx) { sws_freeContext(m_swsCtx); m_swsCtx = nullptr; }
+    QMutexLocker lock(&m_mutex);
+    av_frame_free(&m_latest);
+}
+
+void PipCompositor::threadFunc() {
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVRational tb = m_fmtCtx->streams[m_streamIdx]->time_base;
+    QElapsedTimer clock;
+    int64_t firstUs = AV_NOPTS_VALUE;
+
+    while (!m_stop.load()) {
+        int ret = av_read_frame(m_fmtCtx, pkt);
+        if (ret == AVERROR(EAGAIN)) { QThread::msleep(5); continue; }
+        if (ret < 0) break; // End of a file, device unplugged: the last picture stays up
+        if (pkt->stream_index != m_streamIdx || avcodec_send_packet(m_decCtx, pkt) < 0) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        av_packet_unref(pkt);
+        while (!m_stop.load() && avcodec_receive_frame(m_decCtx, frame) == 0) {
+            // lavfi and files produce frames as fast as they are read; hold them to real time
+            int64_t ts = frame->best_effort_timestamp;
+            if (ts != AV_NOPTS_VALUE) {
+                int64_t us = av_rescale_q(ts, tb, AV_TIME_BASE_Q);
+                if (firstUs == AV_NOPTS_VALUE) {
+                    firstUs = us;
+                    clock.start();
+                }
+                int64_t waitUs = (us - firstUs) - clock.nsecsElapsed() / 1000;
+                while (waitUs > 0 && !m_stop.load()) {
+                    QThread::usleep((unsigned long)std::min<int64_t>(waitUs, 20000));
+                    waitUs = (us - firstUs) - clock.nsecsElapsed() / 1000;
+                }
+            }
+
+            // A fresh buffer per picture: blend() may still be reading the previous one
+            AVFrame *scaled = av_frame_alloc();
+            scaled->format = m_fmt;
+            scaled->width = m_rect.width();
+            scaled->height = m_rect.height();
+            AVPixelFormat srcFmt = (AVPixelFormat)frame->format;
+            m_swsCtx = sws_getCachedContext(m_swsCtx, frame->width, frame->height, srcFmt,
+                                            scaled->width, scaled->height, m_fmt,
+                                            SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (m_swsCtx && av_frame_get_buffer(scaled, 32) >= 0) {
+                // Into the recording's BT.709 limited range
+                bool srcFull = frame->color_range == AVCOL_RANGE_JPEG || srcFmt == AV_PIX_FMT_YUVJ420P ||
+                               srcFmt == AV_PIX_FMT_YUVJ422P || srcFmt == AV_PIX_FMT_YUVJ444P;
+                sws_setColorspaceDetails(m_swsCtx, sws_getCoefficients(frame->colorspace == AVCOL_SPC_BT709 ? SWS_CS_ITU709 : SWS_CS_DEFAULT),
+                                         srcFull ? 1 : 0, sws_getCoefficients(SWS_CS_ITU709), 0, 0, 1 << 16, 1 << 16);
+                sws_scale(m_swsCtx, frame->data, frame->linesize, 0, frame->height, scaled->data, scaled->linesize);
+                QMutexLocker lock(&m_mutex);
+                av_frame_free(&m_latest);
+                m_latest = scaled;
+                scaled = nullptr;
+                m_sourceFrames++;
+            }
+            av_frame_free(&scaled);
+            av_frame_unref(frame);
+        }
+    }
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+}
+
+void PipCompositor::blend(AVFrame *frame) {
+    AVFrame *pic = nullptr;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_latest) pic = av_frame_clone(m_latest);
+    }
+    if (!pic) return;
+    for (int p = 0; p < 3; p++) {
+        int shift = p == 0 ? 0 : m_chromaShift;
+        int w = m_rect.width() >> shift, h = m_rect.height() >> shift;
+        int x0 = m_rect.x() >> shift, y0 = m_rect.y() >> shift;
+        const uint8_t *alpha = p == 0 ? m_alphaY.data() : m_alphaC.data();
+        for (int y = 0; y < h; y++) {
+            uint8_t *d = frame->data[p] + (int64_t)(y0 + y) * frame->linesize[p] + x0;
+            const uint8_t *s = pic->data[p] + (int64_t)y * pic->linesize[p];
+            const uint8_t *a = alpha + (int64_t)y * w;
+            int x = 0;
+#ifdef PC_X86
+            if (m_isa == ColorConverter::Avx2) x = blendRowAvx2(d, s, a, w);
+            else if (m_isa == ColorConverter::Sse2) x = blendRowSse2(d, s, a, w);
+#endif
+            blendRowScalar(d, s, a, x, w);
+        }
+    }
+    av_frame_free(&pic);
+}
@@ -0,0 +1,207 @@
+#include "ProxyEncoder.h"
+#include <QFile>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+ProxyEncoder::ProxyEncoder() {}
+
+ProxyEncoder::~ProxyEncoder() {
+    close();
+}
+
+bool ProxyEncoder::open(const QString &path, int srcW, int srcH, AVPixelFormat srcFmt, AVRational timeBase,
+                        AVRational frameRate, const AVCodecContext *audio) {
+    close();
+    m_error.clear();
+    m_frames = 0;
+    m_dropped = 0;
+    m_srcTimeBase = timeBase;
+    if (srcW <= 0 || srcH <= 0) { m_error = "invalid source size"; return false; }
+
+    // Same aspect ratio, even dimensions
+    int h = qMin(kHeight, srcH) & ~1;
+    int w = (int)((int64_t)srcW * h / srcH) & ~1;
+
+    // Written under a temporary name: the player only picks up finished proxies
+    m_path = path;
+    QString partPath = path + ".part";
+    avformat_alloc_output_context2(&m_fmtCtx, nullptr, "mp4", partPath.toUtf8().constData());
+    if (!m_fmtCtx) { m_error = "alloc output failed"; return false; }
+
+    const AVCodec *enc = avcodec_find_encoder(AV_CODEC_ID_H264);
+    m_encCtx = enc ? avcodec_alloc_context3(enc) : nullptr;
+    if (!m_encCtx) { m_error = "no H.264 encoder"; freeAll(); return false; }
+    m_encCtx->width = w;
+    m_encCtx->height = h;
+    m_encCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+    m_encCtx->time_base = timeBase;
+    m_encCtx->framerate = frameRate;
+    m_encCtx->gop_size = kGopFrames;
+    m_encCtx->max_b_frames = 0;
+    m_encCtx->color_range = AVCOL_RANGE_MPEG;
+    m_encCtx->colorspace = AVCOL_SPC_BT709;
+    m_encCtx->color_primaries = AVCOL_PRI_BT709;
+    m_encCtx->color_trc = AVCOL_TRC_BT709;
+    m_encCtx->thread_count = 1;
+    if (m_fmtCtx->oformat->flags & AVFMT_GLOBALHEADER) m_encCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    // Cheap to encode and to decode; quality only has to be good enough to find a cut
+    av_opt_set(m_encCtx->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(m_encCtx->priv_data, "tune", "fastdecode,zerolatency", 0);
+    av_opt_set(m_encCtx->priv_data, "crf", "28", 0);
+    if (avcodec_open2(m_encCtx, enc, nullptr) < 0) { m_error = "open encoder failed"; freeAll(); return false; }
+
+    m_vStream = avformat_new_stream(m_fmtCtx, nullptr);
+    avcodec_parameters_from_context(m_vStream->codecpar, m_encCtx);
+    m_vStream->time_base = m_encCtx->time_base;
+    m_vStream->avg_frame_rate = frameRate;
+    if (audio) {
+        m_aStream = avformat_new_stream(m_fmtCtx, nullptr);
+        avcodec_parameters_from_context(m_aStream->codecpar, audio);
+        m_aStream->time_base = audio->time_base;
+    }
+
+    m_swsCtx = sws_getContext(srcW, srcH, srcFmt, w, h, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+    m_scaled = av_frame_alloc();
+    m_scaled->format = AV_PIX_FMT_YUV420P;
+    m_scaled->width = w;
+    m_scaled->height = h;
+    if (!m_swsCtx || av_frame_get_buffer(m_scaled, 32) < 0) { m_error = "scaler init failed"; freeAll(); return false; }
+
+    if (avio_open(&m_fmtCtx->pb, partPath.toUtf8().constData(), AVIO_FLAG_WRITE) < 0) {
+        m_error = "cannot open " + partPath;
+        freeAll();
+        return false;
+    }
+    if (avformat_write_header(m_fmtCtx, nullptr) < 0) {
+        m_error = "write header failed";
+        freeAll();
+        QFile::remove(partPath);
+        return false;
+    }
+
+    m_index.clear();
+    m_index.setEncoder(m_encCtx, audio, false);
+
+    m_stop = false;
+    m_thread = QThread::create([this](){ threadFunc(); });
+    m_thread->start();
+    return true;
+}
+
+void ProxyEncoder::close() {
+    if (!m_fmtCtx) return;
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_cond.wakeAll();
+    }
+    if (m_thread) {
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+
+    // The side thread has drained the queue; flush and finish the file
+    encode(nullptr);
+    bool ok = av_write_trailer(m_fmtCtx) >= 0;
+    avio_closep(&m_fmtCtx->pb);
+    freeAll();
+
+    QString partPath = m_path + ".part";
+    QFile::remove(m_path);
+    if (!ok || !QFile::rename(partPath, m_path)) {
+        m_error = "finalize failed";
+        QFile::remove(partPath);
+        return;
+    }
+    if (!m_index.save(m_path)) QFile::remove(RecordingIndex::pathFor(m_path)); // Readers probe instead
+    m_index.clear();
+}
+
+ProxyEncoder::Stats ProxyEncoder::stats() const {
+    Stats s;
+    s.frames = m_frames.load();
+    s.dropped = m_dropped.load();
+    return s;
+}
+
+void ProxyEncoder::pushVideo(const AVFrame *frame) {
+    if (!m_fmtCtx) return;
+    QMutexLocker lock(&m_mutex);
+    if ((int)m_queue.size() >= kMaxQueued) {
+        m_dropped++;
+        return;
+    }
+    // A reference, not a copy: while we hold it the record loop converts the next picture
+    // into another pooled buffer
+    AVFrame *ref = av_frame_clone(frame);
+    if (!ref) return;
+    m_queue.push_back(ref);
+    m_cond.wakeOne();
+}
+
+void ProxyEncoder::writeAudio(const AVPacket *pkt, AVRational tb) {
+    if (!m_fmtCtx || !m_aStream) return;
+    AVPacket *copy = av_packet_clone(pkt);
+    if (!copy) return;
+    copy->stream_index = m_aStream->index;
+    av_packet_rescale_ts(copy, tb, m_aStream->time_base);
+    QMutexLocker lock(&m_muxMutex);
+    av_interleaved_write_frame(m_fmtCtx, copy);
+    av_packet_free(&copy);
+}
+
+void ProxyEncoder::threadFunc() {
+    while (true) {
+        AVFrame *frame = nullptr;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.empty() && !m_stop) m_cond.wait(&m_mutex);
+            if (m_queue.empty()) break; // Stopped and drained
+            frame = m_queue.front();
+            m_queue.pop_front();
+        }
+        if (av_frame_make_writable(m_scaled) >= 0) {
+            sws_scale(m_swsCtx, frame->data, frame->linesize, 0, frame->height, m_scaled->data, m_scaled->linesize);
+            m_scaled->pts = av_rescale_q(frame->pts, m_srcTimeBase, m_encCtx->time_base);
+            m_index.addFrame(m_scaled->pts);
+            encode(m_scaled);
+            m_frames++;
+        }
+        av_frame_free(&frame);
+    }
+}
+
+void ProxyEncoder::encode(AVFrame *frame) {
+    if (avcodec_send_frame(m_encCtx, frame) < 0) return;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = nullptr;
+    pkt.size = 0;
+    while (avcodec_receive_packet(m_encCtx, &pkt) == 0) {
+        m_index.addPacket(&pkt); // Encoder time base, the index's
+        pkt.stream_index = m_vStream->index;
+        av_packet_rescale_ts(&pkt, m_encCtx->time_base, m_vStream->time_base);
+        QMutexLocker lock(&m_muxMutex);
+        av_interleaved_write_frame(m_fmtCtx, &pkt);
+        av_packet_unref(&pkt);
+    }
+}
+
+void ProxyEncoder::freeAll() {
+    {
+        QMutexLocker lock(&m_mutex);
+        for (AVFrame *frame : m_queue) av_frame_free(&frame);
+        m_queue.clear();
+    }
+    if (m_fmtCtx && m_fmtCtx->pb) avio_closep(&m_fmtCtx->pb);
+    if (m_fmtCtx) { avformat_free_context(m_fmtCtx); m_fmtCtx = nullptr; }
+    avcodec_free_context(&m_encCtx);
+    sws_freeContext(m_swsCtx);
+    m_swsCtx = nullptr;
+    av_frame_free(&m_scaled);
+    m_vStream = nullptr;
+    m_aStream = nullptr;
+}
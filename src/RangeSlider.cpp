@@ -27,6 +27,27 @@ void RangeSlider::setPlaybackValue(int value) {
     update();
 }
 
+void RangeSlider::setMarkers(const QList<int> &values) {
+    m_markers = values;
+    update();
+}
+
+void RangeSlider::setWaveform(const QVector<quint8> &peaks, int endValue) {
+    m_peaks = peaks;
+    m_peaksEnd = endValue;
+    update();
+}
+
+int RangeSlider::snapToMarker(int val) const {
+    // Within a few pixels of a marker the handle lands exactly on it
+    const int snapPx = 6;
+    int x = valToPos(val);
+    for (int marker : m_markers) {
+        if (abs(valToPos(marker) - x) <= snapPx) return marker;
+    }
+    return val;
+}
+
 void RangeSlider::paintEvent(QPaintEvent *) {
     QPainter p(this);
     p.setRenderHint(QPainter::Antialiasing);
@@ -35,8 +56,24 @@ void RangeSlider::paintEvent(QPaintEvent *) {
     int xStart = valToPos(lowerValue());
     int xEnd = valToPos(upperValue());
 
-    // Groove (Background)
+    // Waveform: loudest peak under each pixel column
     p.setPen(Qt::NoPen);
+    if (!m_peaks.isEmpty() && m_peaksEnd > m_min) {
+        int x0 = valToPos(m_min);
+        int x1 = valToPos(m_peaksEnd);
+        int halfHeight = height() / 2 - 2;
+        p.setBrush(QColor(0x80, 0x80, 0x80, 90));
+        for (int x = x0; x < x1; x++) {
+            int first = (int)((qint64)(x - x0) * m_peaks.size() / (x1 - x0));
+            int last = qMax(first + 1, (int)((qint64)(x + 1 - x0) * m_peaks.size() / (x1 - x0)));
+            int peak = 0;
+            for (int i = first; i < last && i < m_peaks.size(); i++) peak = qMax(peak, (int)m_peaks[i]);
+            int h = peak * halfHeight / 255;
+            if (h > 0) p.drawRect(x, cy - h, 1, 2 * h);
+        }
+    }
+
+    // Groove (Background)
     p.setBrush(QColor("#404040")); 
     p.drawRoundedRect(m_margin, cy - 2, width() - 2 * m_margin, 4, 2, 2);
 
@@ -55,6 +92,12 @@ void RangeSlider::paintEvent(QPaintEvent *) {
             p.drawRoundedRect(xStart, cy - 2, xPlay - xStart, 4, 2, 2);
     }
     
+    // Markers
+    p.setBrush(QColor("#ffb300"));
+    for (int marker : m_markers) {
+        p.drawRect(valToPos(marker) - 1, cy - 7, 2, 14);
+    }
+    
     // Debug: Draw playhead (Red line)
     // int xHead = valToPos(m_playbackVal);
     // p.setPen(QPen(Qt::red, 1));
@@ -102,7 +145,7 @@ int RangeSlider::posToVal(int pos) const {
 void RangeSlider::mousePressEvent(QMouseEvent *event) {
     if (event->button() == Qt::LeftButton) {
         int x = event->pos().x();
-        int val = posToVal(x);
+        int val = snapToMarker(posToVal(x));
         
         int x1 = valToPos(m_pos1);
         int x2 = valToPos(m_pos2);
@@ -127,7 +170,7 @@ void RangeSlider::mousePressEvent(QMouseEvent *event) {
 
 void RangeSlider::mouseMoveEvent(QMouseEvent *event) {
     if (m_draggingHandle != 0) {
-        int val = posToVal(event->pos().x());
+        int val = snapToMarker(posToVal(event->pos().x()));
         if (m_draggingHandle == 1) m_pos1 = val;
         else m_pos2 = val;
         
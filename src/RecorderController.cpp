@@ -1,5 +1,7 @@
 #include "RecorderController.h"
 #include "LogManager.h"
+#include "SyncAnalyzer.h"
+#include "VideoUtils.h"
 #include <QCoreApplication>
 #include <QDir>
 #include <QDebug>
@@ -12,6 +14,10 @@
 #include <QFile>
 #include <QTextStream>
 #include <QProcess>
+#include <QCursor>
+#ifdef MSR_X11_DAMAGE
+#include "X11DamageGrabber.h"
+#endif
 
 #ifdef Q_OS_WIN
 #include <objbase.h> // For CoInitialize
@@ -65,11 +71,127 @@ static void trace(const QString& msg) {
     LogManager::instance().write(formatted, LogManager::Recorder);
 }
 
+// Aborts blocking FFmpeg I/O as soon as the owning "running" flag drops
+static int inputInterruptCallback(void *opaque) {
+    return static_cast<std::atomic<bool>*>(opaque)->load() ? 0 : 1;
+}
+
+// Loopback "device" that plays the SyncAnalyzer beeps instead of capturing
+static const QString kSyncTestDevice = "lavfi:sync-test";
+
+static AVFormatContext *allocInterruptibleInput(std::atomic<bool> *running) {
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (ctx) {
+        ctx->interrupt_callback.callback = inputInterruptCallback;
+        ctx->interrupt_callback.opaque = running;
+    }
+    return ctx;
+}
+
+// Largest rectangle with the source aspect ratio that fits dst, centred and even-aligned
+static QRect fitInside(int srcW, int srcH, int dstW, int dstH) {
+    int w = dstW;
+    int h = (int)((int64_t)dstW * srcH / srcW);
+    if (h > dstH) {
+        h = dstH;
+        w = (int)((int64_t)dstH * srcW / srcH);
+    }
+    w = qMax(2, w & ~1);
+    h = qMax(2, h & ~1);
+    return QRect(((dstW - w) / 2) & ~1, ((dstH - h) / 2) & ~1, w, h);
+}
+
+// Limited-range black for the planar YUV formats the encoder uses
+static void fillBlack(AVFrame *frame) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    for (int p = 0; p < 3; p++) {
+        int w = p ? AV_CEIL_RSHIFT(frame->width, desc->log2_chroma_w) : frame->width;
+        int h = p ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        for (int y = 0; y < h; y++) memset(frame->data[p] + (int64_t)y * frame->linesize[p], p ? 128 : 16, w);
+    }
+}
+
+// Copies the rows a partial conversion leaves alone from the previous picture. Follows
+// ColorConverter's row selection: a 4:2:0 row pair and its chroma row are converted
+// when either row changed.
+static void copyUnchangedRows(AVFrame *dst, const AVFrame *src, const std::vector<RowSpan> &changed) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)dst->format);
+    int step = 1 << desc->log2_chroma_h; // Luma rows per chroma row
+    int chromaW = AV_CEIL_RSHIFT(dst->width, desc->log2_chroma_w);
+    std::vector<uint8_t> groupChanged((dst->height + step - 1) / step, 0);
+    for (const RowSpan &span : changed) {
+        for (int r = qMax(span.first, 0); r < qMin(span.last, dst->height); r++) groupChanged[r / step] = 1;
+    }
+    for (int g = 0; g < (int)groupChanged.size(); g++) {
+        if (groupChanged[g]) continue;
+        for (int r = g * step; r < qMin((g + 1) * step, dst->height); r++) {
+            memcpy(dst->data[0] + (int64_t)r * dst->linesize[0], src->data[0] + (int64_t)r * src->linesize[0], dst->width);
+        }
+        for (int p = 1; p < 3; p++) {
+            memcpy(dst->data[p] + (int64_t)g * dst->linesize[p], src->data[p] + (int64_t)g * src->linesize[p], chromaW);
+        }
+    }
+}
+
+// Marker PTS (encoder time base) -> MP4 chapters; the mov muxer writes them as a Nero
+// chapter list when the trailer is written. Each chapter runs to the next marker.
+static void addMarkerChapters(AVFormatContext *fmtCtx, const std::vector<int64_t> &markers, int64_t endPts, AVRational tb) {
+    for (size_t i = 0; i < markers.size(); i++) {
+        AVChapter *chapter = (AVChapter*)av_mallocz(sizeof(AVChapter));
+        AVChapter **chapters = chapter ? (AVChapter**)av_realloc_array(fmtCtx->chapters, fmtCtx->nb_chapters + 1, sizeof(AVChapter*)) : nullptr;
+        if (!chapters) { av_free(chapter); return; }
+        fmtCtx->chapters = chapters;
+        chapter->id = (int)i + 1;
+        chapter->time_base = tb;
+        chapter->start = markers[i];
+        chapter->end = i + 1 < markers.size() ? markers[i + 1] : qMax(endPts, markers[i] + 1);
+        av_dict_set(&chapter->metadata, "title", QString("标记 %1").arg(i + 1).toUtf8().constData(), 0);
+        fmtCtx->chapters[fmtCtx->nb_chapters++] = chapter;
+    }
+}
+
+// Global cursor position in the coordinates the screen grabbers use. Off Windows this
+// is QCursor, which is GUI-thread only; the worker reads m_cursorPos instead.
+static QPoint globalCursorPos() {
+#ifdef Q_OS_WIN
+    POINT p;
+    if (GetCursorPos(&p)) return QPoint(p.x, p.y);
+    return QPoint();
+#else
+    return QCursor::pos();
+#endif
+}
+
+static quint64 packPoint(const QPoint &p) {
+    return ((quint64)(quint32)p.x() << 32) | (quint32)p.y();
+}
+
+static QPoint unpackPoint(quint64 v) {
+    return QPoint((qint32)(quint32)(v >> 32), (qint32)(quint32)v);
+}
+
 static void audioRecordCallback(void *userdata, Uint8 *stream, int len) {
-    AudioBuffer *buf = (AudioBuffer*)userdata;
-    if (buf) buf->write(stream, len);
+    MicCapture *capture = (MicCapture*)userdata;
+    if (!capture) return;
+    // Monitor first: its push is lock-free and shouldn't wait behind the mixer ring
+    if (AudioMonitor *monitor = capture->monitor.load(std::memory_order_acquire)) monitor->push(stream, len);
+    if (capture->source) capture->source->writeInterleaved(stream, len);
 }
 
+// SDL sample formats the mixer can take as they are (NONE = let SDL convert)
+static AVSampleFormat sdlToAvSampleFormat(SDL_AudioFormat fmt) {
+    switch (fmt) {
+        case AUDIO_U8: return AV_SAMPLE_FMT_U8;
+        case AUDIO_S16SYS: return AV_SAMPLE_FMT_S16;
+        case AUDIO_S32SYS: return AV_SAMPLE_FMT_S32;
+        case AUDIO_F32SYS: return AV_SAMPLE_FMT_FLT;
+        default: return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+// Raw PCM from many mics is very quiet; their gain is boosted on top of the volume slider
+static const double kMicBoost = 10.0;
+
 // Helper: Match SDL device name
 static int findSdlDeviceIndex(bool isCapture, const QString &keyword) {
     int count = SDL_GetNumAudioDevices(isCapture ? 1 : 0);
@@ -98,6 +220,11 @@ RecorderController::RecorderController(QObject *parent)
     // QFile::remove(QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/rec_trace.txt"); // Handled by LogManager rotation
     trace("RecorderController Created");
 
+    // Viewport mode off Windows: the GUI thread samples the cursor for the worker
+    m_cursorTimer = new QTimer(this);
+    m_cursorTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_cursorTimer, &QTimer::timeout, this, [this]() { m_cursorPos = packPoint(globalCursorPos()); });
+
     avdevice_register_all();
     AVInputFormat *fmt = av_find_input_format("wasapi");
     emit logMessage(QString("FFmpeg WASAPI Support: %1").arg(fmt ? "Yes" : "No"));
@@ -125,6 +252,7 @@ RecorderController::RecorderController(QObject *parent)
 RecorderController::~RecorderController() {
     trace("RecorderController Destructor");
     stopRecording();
+    waitForFinalize();
     SDL_Quit();
 #ifdef Q_OS_WIN
     CoUninitialize();
@@ -135,6 +263,7 @@ QString RecorderController::getFFmpegPath() { return ""; }
 bool RecorderController::probeAudioDevice(const QString& deviceName) { return true; }
 
 void RecorderController::setRegion(const QRect &rect) { m_recordRegion = rect; }
+void RecorderController::setWindow(quintptr window) { m_recordWindow = window; }
 void RecorderController::setAudioConfig(bool recordSys, double sysVol, bool recordMic, double micVol) {
     m_recordSys = recordSys;
     m_sysVolume = sysVol;
@@ -205,28 +334,134 @@ void RecorderController::setFps(int fps) {
     if (m_fps < 10) m_fps = 10;
     if (m_fps > 60) m_fps = 60;
 }
-qint64 RecorderController::getDuration() const { return m_timer.elapsed(); }
+void RecorderController::addMarker() {
+    if (m_state != Recording) return;
+    // Stamped now; the worker forces a keyframe on the first frame captured after this
+    QMutexLocker lock(&m_markerMutex);
+    m_pendingMarkers.push_back(m_clock.nowNs());
+}
 
-void RecorderController::startRecording() {
-    if (m_isRecording) return;
-    trace("startRecording called");
-    trace(QString("Audio Request -> Sys:%1 Mic:%2").arg(m_recordSys ? "on" : "off").arg(m_recordMic ? "on" : "off"));
-    
+qint64 RecorderController::getDuration() const {
+    int64_t startNs = m_startRequestNs.load();
+    return startNs >= 0 ? (m_clock.nowNs() - startNs) / 1000000 : 0;
+}
+
+QString RecorderController::makeOutputPath() {
     QString savePath = QStandardPaths::writableLocation(QStandardPaths::MoviesLocation);
     QSettings settings("KSO", "MScreenRecord");
     savePath = settings.value("savePath", savePath).toString();
     QDir().mkpath(savePath);
     QString fileName = QString("Rec_%1.mp4").arg(QDateTime::currentDateTime().toStringEx("yyyyMMdd_HHmmss"));
-    m_currentFile = QDir(savePath).filePath(fileName);
+    return QDir(savePath).filePath(fileName);
+}
+
+QString RecorderController::makeSyncTestPath() {
+    // Kept out of savePath so test runs never show up next to real recordings
+    QString dir = QDir(QStandardPaths::writableLocation(QStandardPaths::TempLocation)).filePath("MScreenRecord-sync-test");
+    QDir().mkpath(dir);
+    QString fileName = QString("SyncTest_%1.mp4").arg(QDateTime::currentDateTime().toStringEx("yyyyMMdd_HHmmss"));
+    return QDir(dir).filePath(fileName);
+}
+
+void RecorderController::armRecording() {
+    if (m_isRecording) return;
+    if (m_state == Finalizing) {
+        emit logMessage("上一个录制仍在保存中，请稍候...");
+        return;
+    }
+    trace("armRecording called");
+    trace(QString("Audio Request -> Sys:%1 Mic:%2").arg(m_recordSys ? "on" : "off").arg(m_recordMic ? "on" : "off"));
+    
+    QSettings settings("KSO", "MScreenRecord");
+    // Reserve disk space up-front to avoid fragmentation on long recordings (0 = off)
+    m_preallocateBytes = settings.value("preallocateMB", 256).toLongLong() * 1024 * 1024;
+    m_screenContent444 = settings.value("screenContent444", false).toBool();
+    m_videoCodec = VideoEncoderPreset::codecFromName(settings.value("videoCodec", "h264").toString());
+    m_followWindow = settings.value("followWindow", true).toBool();
+    m_viewportMode = settings.value("viewportMode", false).toBool();
+    QStringList viewport = settings.value("viewportSize", "1280x720").toString().split('x');
+    m_viewportSize = QSize(viewport.value(0).toInt(), viewport.value(1).toInt());
+    if (m_viewportSize.width() < 64 || m_viewportSize.height() < 64) m_viewportSize = QSize(1280, 720);
+    m_monitorMic = settings.value("micMonitor", false).toBool();
+    m_proxyFile = settings.value("proxyFile", true).toBool();
+    m_sceneCutKeyframes = settings.value("sceneCutKeyframes", false).toBool();
+    m_streamUrl = settings.value("streamUrl").toString().trimmed();
+    m_videoFilter = settings.value("videoFilter").toString().trimmed();
+    m_videoFilterThreads = qBound(0, settings.value("videoFilterThreads", 0).toInt(), 16);
+    m_pipSource = settings.value("pipEnabled", false).toBool() ? settings.value("pipSource").toString().trimmed() : QString();
+    m_pipOptions = settings.value("pipOptions").toString();
+    m_pipCorner = qBound(0, settings.value("pipCorner", 0).toInt(), 3);
+    m_pipScale = qBound(10, settings.value("pipScale", 25).toInt(), 50);
+    m_pipOpacity = qBound(0, settings.value("pipOpacity", 100).toInt(), 100);
+    m_pipeOutput = settings.value("pipeOutput").toString().trimmed();
+    m_pipeFormat = settings.value("pipeFormat", "mpegts").toString() == "nut" ? "nut" : "mpegts";
+    m_hlsPreview = settings.value("hlsPreview", false).toBool();
+    m_hlsSegmentSec = qBound(1, settings.value("hlsSegmentSec", 2).toInt(), 10);
+    // Timelapse: one frame every N seconds, played back at the normal frame rate, no audio
+    m_timelapse = settings.value("timelapseMode", false).toBool();
+    m_timelapseIntervalSec = qBound(1, settings.value("timelapseInterval", 2).toInt(), 10);
+    if (m_timelapse) {
+        m_recordSys = false;
+        m_recordMic = false;
+        m_preallocateBytes = 0; // A few MB per hour
+        trace(QString("Timelapse: 1 frame / %1 s").arg(m_timelapseIntervalSec));
+    }
+    if (m_syncTest) {
+        // Fixed pattern, real-time pacing: nothing in front of the encoders but lavfi.
+        // The user's settings must neither change what is measured nor receive the test
+        // output (stream, pipe, HLS, proxy, savePath)
+        m_timelapse = false;
+        m_viewportMode = false;
+        m_monitorMic = false;
+        m_recordMic = false;
+        m_recordSys = true;
+        m_preallocateBytes = 0;
+        m_screenContent444 = false;
+        m_videoCodec = VideoEncoderPreset::H264;
+        m_proxyFile = false;
+        m_sceneCutKeyframes = false;
+        m_streamUrl.clear();
+        m_videoFilter.clear();
+        m_pipSource.clear();
+        m_pipeOutput.clear();
+        m_hlsPreview = false;
+        trace("Sync test: lavfi flash / beep sources, user settings ignored");
+    }
+    // Refuse before any device opens rather than record in a codec nobody chose
+    VideoEncoderPreset::Codec codec = (VideoEncoderPreset::Codec)m_videoCodec;
+    if (!VideoEncoderPreset::findEncoder(codec)) {
+        trace("armRecording refused: no encoder for " + VideoEncoderPreset::codecName(codec));
+        emit errorOccurred(QString("当前 FFmpeg 不包含 %1 编码器，无法录制，请在设置中更换视频编码")
+                           .arg(VideoEncoderPreset::codecName(codec).toUpper()));
+        return;
+    }
+    if (m_hlsPreview) {
+        // Segments from the previous recording would show up in the new playlist's directory
+        m_hlsDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/hls";
+        QDir(m_hlsDir).removeRecursively();
+        QDir().mkpath(m_hlsDir);
+        quint16 port = (quint16)settings.value("hlsPort", 8089).toUInt();
+        if (m_hlsServer.start(m_hlsDir, port, settings.value("hlsLan", false).toBool())) {
+            emit logMessage("实时预览地址: " + m_hlsServer.playlistUrl());
+        } else {
+            emit logMessage(QString("警告：实时预览端口 %1 无法监听: %2").arg(port).arg(m_hlsServer.errorString()));
+            m_hlsPreview = false;
+        }
+    }
 
     // Initialize Audio Buffers (larger to avoid overflow on slow consumers)
-    m_bufSys.init(1024 * 1024 * 8);
-    m_bufMic.init(1024 * 1024 * 8);
-    trace("Buffers Init (8MB per buffer)");
+    // Every source stamps its data against this clock from the moment devices open
+    m_clock.start();
+    m_mixer.init(&m_clock, 2); // Rate is chosen from the devices once they are open
+    trace("Audio Mixer Init (stereo, 30 s ring per source)");
+    // Extra capture latency per source kind on top of what the devices report (ms)
+    // (the sync test measures the pipeline without them)
+    int64_t sysLatencyNs = m_syncTest ? 0 : settings.value("sysLatencyMs", 0).toLongLong() * 1000000LL;
+    int64_t micLatencyNs = m_syncTest ? 0 : settings.value("micLatencyMs", 0).toLongLong() * 1000000LL;
 
     // Initialize SDL Devices (Main Thread)
     m_devSys = 0;
-    m_devMic = 0;
+    m_devMics.clear();
     
     // Ensure SDL is initialized
     if (SDL_WasInit(SDL_INIT_AUDIO) == 0) {
@@ -236,20 +471,38 @@ void RecorderController::startRecording() {
         }
     }
     
+    // Ask for what the mixer works in, but take the device's own rate, format and
+    // channel count so SDL doesn't resample in front of the mixer
     SDL_AudioSpec want;
     memset(&want, 0, sizeof(want));
-    want.freq = 44100;
-    want.format = AUDIO_S16SYS;
+    want.freq = 48000;
+    want.format = AUDIO_F32SYS;
     want.channels = 2;
-    want.samples = 1024;
+    want.samples = m_monitorMic ? 256 : 512; // Smaller blocks keep the monitor delay down
     
     // --- WASAPI Loopback (System Audio) ---
+    // The platform's virtual device plus any extra loopback devices from the settings;
+    // each gets its own thread and mixer source
     if (m_recordSys) {
+        QStringList loopbacks;
+        if (m_syncTest) {
+            loopbacks << kSyncTestDevice;
+        } else {
+            loopbacks << QString();
+            loopbacks << settings.value("extraLoopbackDevices").toStringList();
+        }
         m_isSysAudioRunning = true;
-        m_sysAudioThread = QThread::create([this](){ sysAudioThreadFunc(); });
-        m_sysAudioThread->start();
+        for (const QString &device : loopbacks) {
+            // The thread sets the input format once the device is open
+            AudioMixer::Source *source = m_mixer.addSource(device.isEmpty() ? QString("loopback") : device,
+                                                           AudioMixer::Loopback, 0, 0, AV_SAMPLE_FMT_NONE,
+                                                           m_sysVolume, sysLatencyNs);
+            QThread *thread = QThread::create([this, source, device](){ sysAudioThreadFunc(source, device); });
+            m_sysAudioThreads.push_back(thread);
+            thread->start();
+        }
         emit logMessage("启动系统声音录制 (虚拟声卡模式)...");
-        trace("System Audio Thread Started");
+        trace(QString("System Audio Threads Started: %1").arg(loopbacks.size()));
     }
     
     int deviceCount = SDL_GetNumAudioDevices(1); // 1 = capture devices
@@ -260,22 +513,72 @@ void RecorderController::startRecording() {
     
     if (m_recordMic) {
         if (deviceCount > 0) {
-            int idx = findSdlDeviceIndex(true, "Microphone");
-            if (idx < 0) idx = findSdlDeviceIndex(true, "麦克风");
-            if (idx < 0) idx = findSdlDeviceIndex(true, "Audio");
-            if (idx < 0) idx = findSdlDeviceIndex(true, "耳机");
-            
-            want.callback = audioRecordCallback;
-            want.userdata = &m_bufMic;
-            const char* name = (idx >= 0) ? SDL_GetAudioDeviceName(idx, 1) : nullptr;
-            m_devMic = SDL_OpenAudioDevice(name, 1, &want, nullptr, 0);
-            if (m_devMic > 0) {
-                SDL_PauseAudioDevice(m_devMic, 0);
-                emit logMessage("已连接麦克风 (SDL): " + (name ? QString::fromUtf8(name) : QString("Default")));
-                trace(QString("SDL Mic Opened: %1").arg(name ? QString::fromUtf8(name) : "Default"));
-            } else {
-                trace(QString("SDL Mic Open Failed: %1").arg(SDL_GetError()));
-                emit logMessage(QString("警告：SDL 无法打开麦克风: %1").arg(SDL_GetError()));
+            // "micDevices" lists name keywords, one microphone each; by default the first
+            // device matching the usual names (or SDL's default) is used
+            QStringList micKeys = settings.value("micDevices").toStringList();
+            if (micKeys.isEmpty()) {
+                int idx = findSdlDeviceIndex(true, "Microphone");
+                if (idx < 0) idx = findSdlDeviceIndex(true, "麦克风");
+                if (idx < 0) idx = findSdlDeviceIndex(true, "Audio");
+                if (idx < 0) idx = findSdlDeviceIndex(true, "耳机");
+                micKeys << ((idx >= 0) ? QString::fromUtf8(SDL_GetAudioDeviceName(idx, 1)) : QString());
+            }
+
+            for (const QString &key : micKeys) {
+                int idx = key.isEmpty() ? -1 : findSdlDeviceIndex(true, key);
+                if (!key.isEmpty() && idx < 0) {
+                    trace("SDL Mic Not Found: " + key);
+                    emit logMessage("警告：未找到麦克风: " + key);
+                    continue;
+                }
+                const char* name = (idx >= 0) ? SDL_GetAudioDeviceName(idx, 1) : nullptr;
+                QString label = name ? QString::fromUtf8(name) : QString("Default");
+                AudioMixer::Source *source = m_mixer.addSource(label, AudioMixer::Microphone, 0, 0, AV_SAMPLE_FMT_NONE,
+                                                               m_micVolume * kMicBoost, micLatencyNs);
+                m_micCaptures.emplace_back(new MicCapture);
+                MicCapture *capture = m_micCaptures.back().get();
+                capture->source = source;
+                want.callback = audioRecordCallback;
+                want.userdata = capture;
+                SDL_AudioSpec have;
+                SDL_AudioDeviceID dev = SDL_OpenAudioDevice(name, 1, &want, &have, SDL_AUDIO_ALLOW_ANY_CHANGE);
+                if (dev > 0 && sdlToAvSampleFormat(have.format) == AV_SAMPLE_FMT_NONE) {
+                    // Exotic device format: SDL converts the sample format, never the rate
+                    SDL_CloseAudioDevice(dev);
+                    dev = SDL_OpenAudioDevice(name, 1, &want, &have,
+                                              SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+                }
+                if (dev > 0 && !source->setInputFormat(have.freq, have.channels, sdlToAvSampleFormat(have.format))) {
+                    SDL_CloseAudioDevice(dev);
+                    dev = 0;
+                }
+                if (dev > 0) {
+                    // The callback stamps a block when it arrives; one more period sits in
+                    // the driver queue by then
+                    source->setLatencyNs(micLatencyNs + MediaClock::fromStreamTs(have.samples, AVRational{1, have.freq}));
+                    m_devMics.push_back(dev);
+                    // Monitoring plays the first microphone in its own format, straight
+                    // from the callback. The output stays paused and detached until
+                    // startRecording(), so nothing is heard while armed.
+                    if (m_monitorMic && !m_micMonitor.isOpen()) {
+                        if (m_micMonitor.open(have, settings.value("micMonitorDevice").toString())) {
+                            m_monitorCapture = capture;
+                            trace(QString("Mic monitor opened (paused): max added %1 ms").arg(m_micMonitor.maxAddedMs(), 0, 'f', 1));
+                        } else {
+                            emit logMessage("警告：无法打开麦克风监听输出: " + m_micMonitor.errorString());
+                            trace("Mic monitor open failed: " + m_micMonitor.errorString());
+                        }
+                    }
+                    SDL_PauseAudioDevice(dev, 0);
+                    emit logMessage("已连接麦克风 (SDL): " + label);
+                    trace(QString("SDL Mic Opened: %1 (%2 Hz, %3 ch, fmt 0x%4, latency %5 ms)")
+                          .arg(label).arg(have.freq).arg(have.channels).arg(have.format, 0, 16)
+                          .arg(source->latencyNs() / 1000000));
+                } else {
+                    source->setActive(false);
+                    trace(QString("SDL Mic Open Failed: %1").arg(SDL_GetError()));
+                    emit logMessage(QString("警告：SDL 无法打开麦克风: %1").arg(SDL_GetError()));
+                }
             }
         } else {
             trace("No SDL capture devices found");
@@ -299,7 +602,8 @@ void RecorderController::startRecording() {
         trace(QString("  - %1").arg(d.deviceName()));
     }
 
-    if (m_recordMic && m_devMic == 0) {
+    if (m_recordMic && m_devMics.empty()) {
+        if (m_monitorMic) trace("Mic monitor needs an SDL microphone, not available on the Qt fallback");
         
         QAudioDeviceInfo dev = findQtDevice("Microphone");
         if (dev.isNull()) dev = findQtDevice("麦克风");
@@ -308,13 +612,32 @@ void RecorderController::startRecording() {
         if (dev.isNull()) dev = QAudioDeviceInfo::defaultInputDevice(); // Last resort
         
         if (!dev.isNull()) {
-            if (dev.isFormatSupported(qtFmt)) {
+            // The device's own rate, float samples if it offers them; 44.1 kHz 16-bit last
+            QList<QAudioFormat> candidates;
+            QAudioFormat nativeFmt = qtFmt;
+            nativeFmt.setSampleRate(dev.preferredFormat().sampleRate());
+            QAudioFormat floatFmt = nativeFmt;
+            floatFmt.setSampleSize(32);
+            floatFmt.setSampleType(QAudioFormat::Float);
+            candidates << floatFmt << nativeFmt << qtFmt;
+            QAudioFormat chosenFmt;
+            for (const QAudioFormat &candidate : candidates) {
+                if (candidate.sampleRate() > 0 && dev.isFormatSupported(candidate)) { chosenFmt = candidate; break; }
+            }
+            if (chosenFmt.isValid()) {
+                qtFmt = chosenFmt;
+                AVSampleFormat avFmt = (qtFmt.sampleType() == QAudioFormat::Float) ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_S16;
+                AudioMixer::Source *source = m_mixer.addSource(dev.deviceName(), AudioMixer::Microphone, qtFmt.sampleRate(),
+                                                               qtFmt.channelCount(), avFmt, m_micVolume * kMicBoost);
                 m_qtAudioMic = new QAudioInput(dev, qtFmt, this);
-                m_qtWrapMic = new AudioWrapper(&m_bufMic, this);
+                m_qtWrapMic = new AudioWrapper(source, this);
                 m_qtWrapMic->open(QIODevice::WriteOnly);
                 m_qtAudioMic->start(m_qtWrapMic);
+                // Qt pushes whole periods, so one period is in flight when a block arrives
+                source->setLatencyNs(micLatencyNs + qtFmt.durationForBytes(m_qtAudioMic->periodSize()) * 1000LL);
                 emit logMessage("已连接麦克风 (Qt): " + dev.deviceName());
-                trace("Qt Mic Started: " + dev.deviceName());
+                trace(QString("Qt Mic Started: %1 (%2 Hz, %3-bit, latency %4 ms)").arg(dev.deviceName())
+                      .arg(qtFmt.sampleRate()).arg(qtFmt.sampleSize()).arg(source->latencyNs() / 1000000));
             } else {
                 trace(QString("Qt Format Not Supported for: %1").arg(dev.deviceName()));
                 emit logMessage(QString("警告：设备 %1 不支持所需音频格式").arg(dev.deviceName()));
@@ -325,37 +648,69 @@ void RecorderController::startRecording() {
         }
     }
 
+    m_startTriggered = false;
+    m_startRequestNs = -1;
+    {
+        QMutexLocker lock(&m_markerMutex);
+        m_pendingMarkers.clear();
+    }
     m_isRecording = true;
-    m_state = Recording;
-    emit logMessage("开始录制 (Native API)...");
-    emit stateChanged(Recording);
-    m_timer.start();
+#ifndef Q_OS_WIN
+    if (m_viewportMode) {
+        // Twice per frame keeps the sample within half a frame of the grab
+        m_cursorPos = packPoint(globalCursorPos());
+        m_cursorTimer->start(qMax(4, 1000 / (2 * qMax(1, m_fps))));
+    }
+#endif
+    m_state = Armed;
+    emit logMessage("录制预备中，设备已打开...");
+    emit stateChanged(Armed);
 
+    // The worker opens capture and encoders now and then waits for startRecording()
     m_recordThread = QThread::create([this](){ recordThreadFunc(); });
     m_recordThread->start();
-    trace("Thread Started");
+    trace("Thread Started (armed)");
+}
+
+void RecorderController::startRecording() {
+    if (m_state == Recording) return;
+    if (m_state != Armed) {
+        // Cold start: device setup happens now and adds to the start latency
+        QElapsedTimer coldTimer;
+        coldTimer.start();
+        armRecording();
+        if (m_state != Armed) return;
+        trace(QString("Cold start: armed in %1 ms").arg(coldTimer.elapsed()));
+    }
+    trace("startRecording called");
+
+    m_startRequestNs = m_clock.nowNs();
+    // Named now so the timestamp is the start, not the arm time; the worker reads it once
+    // it sees m_startTriggered
+    m_currentFile = m_syncTest ? makeSyncTestPath() : makeOutputPath();
+    trace("Output: " + m_currentFile);
+    m_startTriggered = true;
+    m_state = Recording;
+    emit logMessage("开始录制 (Native API)...");
+    if (m_monitorCapture && m_micMonitor.isOpen()) {
+        m_micMonitor.start();
+        m_monitorCapture->monitor.store(&m_micMonitor, std::memory_order_release);
+        emit logMessage(QString("麦克风监听已开启 (附加延迟不超过 %1 ms)").arg(m_micMonitor.maxAddedMs(), 0, 'f', 1));
+        trace("Mic monitor started");
+    }
+    emit stateChanged(Recording);
 }
 
 void RecorderController::stopRecording() {
     if (!m_isRecording) return;
     trace("stopRecording called");
     
-    emit logMessage("正在停止录制...");
+    bool started = m_startTriggered.load();
+    emit logMessage(started ? "正在停止录制..." : "已取消录制预备");
+    // Both flags feed the input interrupt callbacks, so blocking reads return now
     m_isRecording = false;
-    
-    if (m_recordThread) {
-        trace("Waiting for thread...");
-        m_recordThread->wait();
-        delete m_recordThread; 
-        m_recordThread = nullptr;
-        trace("Thread joined");
-    }
-    if (m_sysAudioThread) {
-        m_isSysAudioRunning = false;
-        m_sysAudioThread->wait();
-        delete m_sysAudioThread; m_sysAudioThread = nullptr;
-        trace("SysAudio Thread Joined");
-    }
+    m_isSysAudioRunning = false;
+    m_cursorTimer->stop();
     
     // Close SDL Devices
     if (m_devSys > 0) {
@@ -363,11 +718,20 @@ void RecorderController::stopRecording() {
         SDL_CloseAudioDevice(m_devSys);
         m_devSys = 0;
     }
-    if (m_devMic > 0) {
-        SDL_PauseAudioDevice(m_devMic, 1);
-        SDL_CloseAudioDevice(m_devMic);
-        m_devMic = 0;
+    for (SDL_AudioDeviceID dev : m_devMics) {
+        SDL_PauseAudioDevice(dev, 1);
+        SDL_CloseAudioDevice(dev);
+    }
+    m_devMics.clear();
+    // Capture callbacks have returned, nothing pushes into the monitor any more
+    if (m_micMonitor.isOpen()) {
+        AudioMonitor::Stats mon = m_micMonitor.stats();
+        trace(QString("Mic monitor closed: buffer delay (est.) %1 ms, underruns %2, dropped %3 ms")
+              .arg(mon.bufferDelayMs, 0, 'f', 1).arg(mon.underruns).arg(mon.droppedMs));
+        m_micMonitor.close();
     }
+    m_monitorCapture = nullptr;
+    m_micCaptures.clear();
 
     // Stop Qt Audio
     if (m_qtAudioSys) { m_qtAudioSys->stop(); delete m_qtAudioSys; m_qtAudioSys = nullptr; }
@@ -375,182 +739,532 @@ void RecorderController::stopRecording() {
     if (m_qtAudioMic) { m_qtAudioMic->stop(); delete m_qtAudioMic; m_qtAudioMic = nullptr; }
     if (m_qtWrapMic) { delete m_qtWrapMic; m_qtWrapMic = nullptr; }
 
+    m_state = Finalizing;
+    emit stateChanged(Finalizing);
+
+    // Encoder flush and trailer run on the worker; join it off the UI thread
+    QThread *recordThread = m_recordThread;
+    std::vector<QThread*> sysAudioThreads = m_sysAudioThreads;
+    m_finalizeThread = QThread::create([this, recordThread, sysAudioThreads, started](){
+        QElapsedTimer joinTimer;
+        joinTimer.start();
+        if (recordThread) recordThread->wait();
+        for (QThread *thread : sysAudioThreads) thread->wait();
+        trace(QString("Workers joined in %1 ms").arg(joinTimer.elapsed()));
+        QMetaObject::invokeMethod(this, "onFinalized", Qt::QueuedConnection, Q_ARG(bool, started));
+    });
+    m_finalizeThread->start();
+    trace("stopRecording returned (finalizing)");
+}
+
+void RecorderController::disarm() {
+    if (m_state != Armed) return;
+    // The monitor never started; detach it before the devices close
+    if (m_monitorCapture) m_monitorCapture->monitor.store(nullptr, std::memory_order_release);
+    // Nothing was recorded, so the join is short: the worker is only draining the grabber
+    stopRecording();
+    waitForFinalize();
+}
+
+void RecorderController::waitForFinalize() {
+    if (!m_finalizeThread) return;
+    m_finalizeThread->wait();
+    onFinalized(m_startTriggered.load());
+}
+
+void RecorderController::onFinalized(bool started) {
+    if (m_state != Finalizing) return; // Already handled by waitForFinalize()
+
+    if (m_finalizeThread) {
+        m_finalizeThread->wait();
+        delete m_finalizeThread; m_finalizeThread = nullptr;
+    }
+    if (m_recordThread) { delete m_recordThread; m_recordThread = nullptr; }
+    for (QThread *thread : m_sysAudioThreads) delete thread;
+    m_sysAudioThreads.clear();
+    trace("Threads joined");
+
     // Free Buffers
     trace("Freeing Buffers...");
-    m_bufSys.free();
-    m_bufMic.free();
+    m_mixer.release();
     trace("Buffers Freed");
+    m_hlsServer.stop();
     
     m_state = Stopped;
+    m_startTriggered = false;
+    m_startRequestNs = -1;
     emit stateChanged(Stopped);
-    emit recordingFinished(m_currentFile);
-    trace("stopRecording finished");
+    if (started) emit recordingFinished(m_currentFile);
+    trace("Finalize finished");
 }
 
 void RecorderController::recordThreadFunc() {
     trace("Worker Thread Start");
+    QElapsedTimer armTimer;
+    armTimer.start();
     // Reset Contexts
     m_outFmtCtx = nullptr;
     m_vInFmtCtx = nullptr;
     m_vEncCtx = nullptr;
     m_aEncCtx = nullptr;
     m_swsCtx = nullptr;
-    m_swrMicCtx = nullptr;
 
     bool headerWritten = false;
+    AVCodecContext *vDecCtx = nullptr;
+    AVDictionary *inputOpts = nullptr;
+
+    // The muxer writes through m_fileWriter's AVIOContext; detach it once the writer is closed
+    auto closeWriter = [&]() {
+        if (!m_fileWriter.isOpen()) return;
+        trace("Close Writer");
+        if (!m_fileWriter.close()) trace("Err: output writer: " + m_fileWriter.errorString());
+        if (m_outFmtCtx) m_outFmtCtx->pb = nullptr;
+        AsyncFileWriter::Stats io = m_fileWriter.stats();
+        trace(QString("IO Summary: written=%1MB stalls=%2 (%3ms) maxWrite=%4ms")
+              .arg(io.bytesWritten / (1024 * 1024)).arg(io.stallCount).arg(io.stallMs).arg(io.maxWriteMs));
+    };
+    // Everything setup allocates; the end of the thread and every setup failure go through here
+    auto releaseContexts = [&]() {
+        m_videoGraph.close();
+        trace("Free Video Enc");
+        if (m_vEncCtx) avcodec_free_context(&m_vEncCtx);
+        trace("Free Audio Enc");
+        if (m_aEncCtx) avcodec_free_context(&m_aEncCtx);
+        closeWriter();
+        if (m_outFmtCtx) {
+            trace("Free OutCtx");
+            avformat_free_context(m_outFmtCtx);
+            m_outFmtCtx = nullptr;
+        }
+        // Note: SDL/Qt Closed in stopRecording()
+        trace("Free Video Dec");
+        if (vDecCtx) avcodec_free_context(&vDecCtx);
+        trace("Close Input");
+        if (m_vInFmtCtx) avformat_close_input(&m_vInFmtCtx);
+        av_dict_free(&inputOpts);
+        trace("Free Sws");
+        if (m_swsCtx) {
+            sws_freeContext(m_swsCtx);
+            m_swsCtx = nullptr;
+        }
+    };
+    // Setup failed: nothing was recorded, release what is open and let the UI thread run the
+    // normal stop path (as a cancelled arm, so no recordingFinished for a file that isn't there)
+    auto abortSetup = [&](const QString &error, const QString &detail) {
+        if (!error.isEmpty()) emit errorOccurred(error); // Empty: already reported
+        trace("Err: " + detail);
+        m_startTriggered = false;
+        releaseContexts();
+        QMetaObject::invokeMethod(this, "stopRecording", Qt::QueuedConnection);
+        trace("Worker Cleanup Done (setup failed)");
+    };
 
-    // 1. Open Output
-    avformat_alloc_output_context2(&m_outFmtCtx, nullptr, "mp4", m_currentFile.toUtf8().constData());
-    if (!m_outFmtCtx) { emit errorOccurred("无法创建输出文件"); trace("Err: alloc output"); return; }
+    // 1. Open Output (the file itself is named and opened at the start)
+    avformat_alloc_output_context2(&m_outFmtCtx, nullptr, "mp4", nullptr);
+    if (!m_outFmtCtx) { abortSetup("无法创建输出文件", "alloc output"); return; }
 
     // 2. Open Video Input
-    AVDictionary *opts = nullptr;
-    // Use user-configured frame rate from settings
-    QString fpsStr = QString::number(m_fps);
-    av_dict_set(&opts, "framerate", fpsStr.toUtf8().constData(), 0);
-    av_dict_set(&opts, "probesize", "50M", 0);
-    trace(QString("Requesting FPS from gdigrab: %1").arg(m_fps));
-    av_dict_set(&opts, "draw_mouse", "1", 0); // Enable cursor capture
+    int vInStreamIdx = -1;
+    AVRational inputFps = {m_fps, 1};
+    AVRational vInTimeBase = {1, AV_TIME_BASE};
+    int captureW = 0, captureH = 0;
+    bool damageCapture = false; // Frames come from x11Grabber instead of m_vInFmtCtx
+    // Snapped to a window: the capture follows it and resizes are scaled into the encoder size
+    quintptr captureWindow = m_followWindow && !m_syncTest ? m_recordWindow : 0;
+#ifdef MSR_X11_DAMAGE
+    // Linux: re-read only the rows XDamage reports as changed; x11grab is the fallback
+    X11DamageGrabber x11Grabber;
+    bool grabberOpen = !m_syncTest && (captureWindow ? x11Grabber.openWindow(captureWindow, m_fps, true)
+                                                     : x11Grabber.open(m_recordRegion, m_fps, true));
+    if (grabberOpen) {
+        damageCapture = true;
+        captureW = x11Grabber.width();
+        captureH = x11Grabber.height();
+        QRect r = x11Grabber.region();
+        trace(QString("X11 damage capture: %1x%2 at (%3,%4)%5").arg(captureW).arg(captureH).arg(r.x()).arg(r.y())
+              .arg(captureWindow ? QString(", following window 0x%1").arg(captureWindow, 0, 16) : QString()));
+    } else if (!m_syncTest) {
+        trace("X11 damage capture unavailable (" + x11Grabber.errorString() + "), using x11grab");
+    }
+#endif
 
+    // Opens m_vInFmtCtx and its decoder; also reopens a window capture after a resize
     const char* inputFormat = "gdigrab";
-    const char* inputDevice = "desktop";
+    QByteArray inputDevice = "desktop";
+    int64_t syncTestStartNs = -1; // Sync test: clock time of the pattern's t = 0
+    auto openVideoInput = [&]() -> bool {
+        AVDictionary *opts = nullptr;
+        av_dict_copy(&opts, inputOpts, 0);
+        m_vInFmtCtx = allocInterruptibleInput(&m_isRecording);
+        int ret = avformat_open_input(&m_vInFmtCtx, inputDevice.constData(), av_find_input_format(inputFormat), &opts);
+        av_dict_free(&opts);
+        if (ret < 0) {
+            emit errorOccurred("无法打开屏幕捕获设备"); trace("Err: open " + QString(inputFormat) + " " + inputDevice); return false;
+        }
+        avformat_find_stream_info(m_vInFmtCtx, nullptr);
+        vInStreamIdx = -1;
+        for(int i=0; i < static_cast<int>(m_vInFmtCtx->nb_streams); i++) {
+            if(m_vInFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) vInStreamIdx = i;
+        }
+        if (vInStreamIdx < 0) {
+            emit errorOccurred("未找到视频流"); trace("Err: no video stream"); return false;
+        }
+
+        // 2.5 Video Decoder
+        const AVCodec *vDec = avcodec_find_decoder(m_vInFmtCtx->streams[vInStreamIdx]->codecpar->codec_id);
+        vDecCtx = avcodec_alloc_context3(vDec);
+        avcodec_parameters_to_context(vDecCtx, m_vInFmtCtx->streams[vInStreamIdx]->codecpar);
+        avcodec_open2(vDecCtx, vDec, nullptr);
+        return true;
+    };
+
+    if (!damageCapture) {
+        // Use user-configured frame rate from settings
+        QString fpsStr = QString::number(m_fps);
+        av_dict_set(&inputOpts, "framerate", fpsStr.toUtf8().constData(), 0);
+        av_dict_set(&inputOpts, "probesize", "50M", 0);
+        trace(QString("Requesting FPS from gdigrab: %1").arg(m_fps));
+        av_dict_set(&inputOpts, "draw_mouse", "1", 0); // Enable cursor capture
     
-    #ifdef Q_OS_MAC
-    inputFormat = "avfoundation";
-    inputDevice = "1:none";
-    av_dict_set(&opts, "capture_cursor", "1", 0);
-    av_dict_set(&opts, "capture_mouse_clicks", "1", 0);
-    #endif
-
-    if (!m_recordRegion.isNull()) {
+        #ifdef Q_OS_MAC
+        inputFormat = "avfoundation";
+        inputDevice = "1:none";
+        av_dict_set(&inputOpts, "capture_cursor", "1", 0);
+        av_dict_set(&inputOpts, "capture_mouse_clicks", "1", 0);
+        #elif defined(Q_OS_LINUX)
+        // x11grab takes the origin in the device name: "<display>+x,y"
+        inputFormat = "x11grab";
+        inputDevice = qgetenv("DISPLAY");
+        if (inputDevice.isEmpty()) inputDevice = ":0.0";
+        if (captureWindow) {
+            // Grabs the window itself (x11grab window_id, FFmpeg 5.0+)
+            av_dict_set(&inputOpts, "window_id", QString::number(captureWindow).toUtf8().constData(), 0);
+        } else if (!m_recordRegion.isNull()) {
+            inputDevice += QString("+%1,%2").arg(m_recordRegion.x()).arg(m_recordRegion.y()).toUtf8();
+            av_dict_set(&inputOpts, "video_size", QString("%1x%2").arg(m_recordRegion.width() & ~1).arg(m_recordRegion.height() & ~1).toUtf8().constData(), 0);
+        }
+        #endif
+
         #ifdef Q_OS_WIN
-        // 确保宽高是偶数（H.264 编码器要求）
-        int w = m_recordRegion.width();
-        int h = m_recordRegion.height();
-        if (w % 2 != 0) w -= 1;
-        if (h % 2 != 0) h -= 1;
-        // 确保最小尺寸
-        if (w < 64) w = 64;
-        if (h < 64) h = 64;
+        if (captureWindow) {
+            // gdigrab grabs from the window's DC, so it follows moves and ignores overlapping
+            // windows. It looks the window up by title; read the caption it has right now.
+            wchar_t title[256] = {0};
+            GetWindowTextW((HWND)captureWindow, title, 256);
+            inputDevice = "title=" + QString::fromWCharArray(title).toUtf8();
+            trace(QString("Recording window: %1").arg(QString::fromWCharArray(title)));
+        } else if (!m_recordRegion.isNull()) {
+            // 确保宽高是偶数（H.264 编码器要求）
+            int w = m_recordRegion.width();
+            int h = m_recordRegion.height();
+            if (w % 2 != 0) w -= 1;
+            if (h % 2 != 0) h -= 1;
+            // 确保最小尺寸
+            if (w < 64) w = 64;
+            if (h < 64) h = 64;
         
-        av_dict_set(&opts, "video_size", QString("%1x%2").arg(w).arg(h).toUtf8().constData(), 0);
-        av_dict_set(&opts, "offset_x", QString::number(m_recordRegion.x()).toUtf8().constData(), 0);
-        av_dict_set(&opts, "offset_y", QString::number(m_recordRegion.y()).toUtf8().constData(), 0);
-        trace(QString("Recording region: %1x%2 at (%3,%4)").arg(w).arg(h).arg(m_recordRegion.x()).arg(m_recordRegion.y()));
+            av_dict_set(&inputOpts, "video_size", QString("%1x%2").arg(w).arg(h).toUtf8().constData(), 0);
+            av_dict_set(&inputOpts, "offset_x", QString::number(m_recordRegion.x()).toUtf8().constData(), 0);
+            av_dict_set(&inputOpts, "offset_y", QString::number(m_recordRegion.y()).toUtf8().constData(), 0);
+            trace(QString("Recording region: %1x%2 at (%3,%4)").arg(w).arg(h).arg(m_recordRegion.x()).arg(m_recordRegion.y()));
+        }
         #endif
-    }
-    
-    if (avformat_open_input(&m_vInFmtCtx, inputDevice, av_find_input_format(inputFormat), &opts) < 0) {
-        emit errorOccurred("无法打开屏幕捕获设备"); trace("Err: open gdigrab"); return;
-    }
-    avformat_find_stream_info(m_vInFmtCtx, nullptr);
-    int vInStreamIdx = -1;
-    for(int i=0; i < static_cast<int>(m_vInFmtCtx->nb_streams); i++) {
-        if(m_vInFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) vInStreamIdx = i;
-    }
-    if (vInStreamIdx < 0) {
-        emit errorOccurred("未找到视频流"); trace("Err: no video stream"); return;
-    }
 
-    // 2.5 Video Decoder
-    const AVCodec *vDec = avcodec_find_decoder(m_vInFmtCtx->streams[vInStreamIdx]->codecpar->codec_id);
-    AVCodecContext *vDecCtx = avcodec_alloc_context3(vDec);
-    avcodec_parameters_to_context(vDecCtx, m_vInFmtCtx->streams[vInStreamIdx]->codecpar);
-    avcodec_open2(vDecCtx, vDec, nullptr);
+        if (m_syncTest) {
+            // Start the pattern on a frame boundary of the clock so flashes land on frames
+            av_dict_free(&inputOpts);
+            int64_t frameIndex = av_rescale_rnd(m_clock.nowNs(), m_fps, 1000000000LL, AV_ROUND_UP);
+            syncTestStartNs = av_rescale(frameIndex, 1000000000LL, m_fps);
+            int64_t waitNs = syncTestStartNs - m_clock.nowNs();
+            if (waitNs > 0) QThread::usleep((unsigned long)(waitNs / 1000));
+            QSize size = m_recordRegion.isNull() ? QSize(1280, 720) : m_recordRegion.size();
+            inputFormat = "lavfi";
+            inputDevice = SyncAnalyzer::videoGraph(size.width() & ~1, size.height() & ~1, m_fps,
+                                                   SyncAnalyzer::markerPhase(syncTestStartNs)).toUtf8();
+            trace(QString("Sync test pattern: %1x%2 at %3 fps").arg(size.width() & ~1).arg(size.height() & ~1).arg(m_fps));
+        }
+    
+        if (!openVideoInput()) { abortSetup(QString(), "open video input"); return; }
 
-    // Get input stream frame rate (use r_frame_rate or avg_frame_rate)
-    AVRational inputFps = m_vInFmtCtx->streams[vInStreamIdx]->r_frame_rate;
-    if (inputFps.num == 0 || inputFps.den == 0) {
-        inputFps = m_vInFmtCtx->streams[vInStreamIdx]->avg_frame_rate;
-    }
-    // Use user-configured FPS if input stream doesn't provide valid FPS
-    if (inputFps.num == 0 || inputFps.den == 0) {
-        inputFps = {m_fps, 1}; // Use user-configured FPS
-        trace(QString("Input stream FPS not available, using configured FPS: %1").arg(m_fps));
-    } else {
-        trace(QString("Input Stream FPS: %1/%2 = %3").arg(inputFps.num).arg(inputFps.den).arg(av_q2d(inputFps)));
-        // If input FPS differs significantly from configured FPS, use configured FPS
-        double inputFpsValue = av_q2d(inputFps);
-        if (qAbs(inputFpsValue - m_fps) > 2.0) {
-            trace(QString("Input FPS (%1) differs from configured FPS (%2), using configured FPS").arg(inputFpsValue).arg(m_fps));
-            inputFps = {m_fps, 1};
+        // Get input stream frame rate (use r_frame_rate or avg_frame_rate)
+        inputFps = m_vInFmtCtx->streams[vInStreamIdx]->r_frame_rate;
+        if (inputFps.num == 0 || inputFps.den == 0) {
+            inputFps = m_vInFmtCtx->streams[vInStreamIdx]->avg_frame_rate;
         }
+        // Use user-configured FPS if input stream doesn't provide valid FPS
+        if (inputFps.num == 0 || inputFps.den == 0) {
+            inputFps = {m_fps, 1}; // Use user-configured FPS
+            trace(QString("Input stream FPS not available, using configured FPS: %1").arg(m_fps));
+        } else {
+            trace(QString("Input Stream FPS: %1/%2 = %3").arg(inputFps.num).arg(inputFps.den).arg(av_q2d(inputFps)));
+            // If input FPS differs significantly from configured FPS, use configured FPS
+            double inputFpsValue = av_q2d(inputFps);
+            if (qAbs(inputFpsValue - m_fps) > 2.0) {
+                trace(QString("Input FPS (%1) differs from configured FPS (%2), using configured FPS").arg(inputFpsValue).arg(m_fps));
+                inputFps = {m_fps, 1};
+            }
+        }
+        // A window's client area can have odd dimensions
+        captureW = m_vInFmtCtx->streams[vInStreamIdx]->codecpar->width & ~1;
+        captureH = m_vInFmtCtx->streams[vInStreamIdx]->codecpar->height & ~1;
+        vInTimeBase = m_vInFmtCtx->streams[vInStreamIdx]->time_base;
     }
 
     // 3. Video Encoder
     AVStream *vOutStream = avformat_new_stream(m_outFmtCtx, nullptr);
-    const AVCodec *vEnc = avcodec_find_encoder(AV_CODEC_ID_H264);
+    VideoEncoderPreset::Codec codec = (VideoEncoderPreset::Codec)m_videoCodec;
+    const AVCodec *vEnc = VideoEncoderPreset::findEncoder(codec); // Checked by armRecording
+    if (!vEnc) {
+        abortSetup(QString("当前 FFmpeg 不包含 %1 编码器").arg(VideoEncoderPreset::codecName(codec).toUpper()),
+                   "no encoder for " + VideoEncoderPreset::codecName(codec));
+        return;
+    }
+    trace(QString("Video encoder: %1").arg(vEnc->name));
     m_vEncCtx = avcodec_alloc_context3(vEnc);
-    m_vEncCtx->width = m_vInFmtCtx->streams[vInStreamIdx]->codecpar->width;
-    m_vEncCtx->height = m_vInFmtCtx->streams[vInStreamIdx]->codecpar->height;
+    // Cursor-follow viewport: only a fixed-size window around the mouse is converted and encoded
+    int viewportW = 0, viewportH = 0;
+    if (m_viewportMode) {
+        viewportW = qMin(m_viewportSize.width(), captureW) & ~1;
+        viewportH = qMin(m_viewportSize.height(), captureH) & ~1;
+        trace(QString("Cursor viewport: %1x%2 of %3x%4").arg(viewportW).arg(viewportH).arg(captureW).arg(captureH));
+    }
+    // Canvas: what the colour converter produces; the encoder gets it as is unless a filter
+    // chain sits in between
+    int canvasW = viewportW > 0 ? viewportW : captureW;
+    int canvasH = viewportH > 0 ? viewportH : captureH;
+    // Screen-content profile keeps full-resolution chroma so text and UI edges stay sharp
+    AVPixelFormat canvasFmt = m_screenContent444 ? AV_PIX_FMT_YUV444P : AV_PIX_FMT_YUV420P;
+    if (vEnc && canvasFmt == AV_PIX_FMT_YUV444P && !VideoEncoderPreset::supportsFormat(vEnc, canvasFmt)) {
+        // SVT-AV1 only takes 4:2:0
+        emit logMessage(QString("提示：%1 编码器不支持 4:4:4，已使用 4:2:0").arg(vEnc->name));
+        trace(QString("%1 has no YUV444P, using YUV420P").arg(vEnc->name));
+        canvasFmt = AV_PIX_FMT_YUV420P;
+    }
+    m_vEncCtx->width = canvasW;
+    m_vEncCtx->height = canvasH;
+    m_vEncCtx->pix_fmt = canvasFmt;
+    AVRational encodeFps = inputFps;
     
-    // Use input FPS for encoder time_base to ensure correct timing
-    m_vEncCtx->time_base = {inputFps.den, inputFps.num}; // time_base = 1/fps
-    m_vEncCtx->framerate = inputFps; // Set framerate for encoder
-    m_vEncCtx->pix_fmt = AV_PIX_FMT_YUV420P;
-    m_vEncCtx->bit_rate = 3000000;
+    // 90 kHz time base: PTS come from MediaClock capture times, not from a frame counter
+    m_vEncCtx->time_base = {1, 90000};
+    m_videoGraph.close();
+    if (!m_videoFilter.isEmpty()) {
+        // Canvas format first: the sink only converts when the chain changed it
+        AVPixelFormat otherFmt = canvasFmt == AV_PIX_FMT_YUV444P ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_YUV444P;
+        std::vector<AVPixelFormat> sinkFormats = { canvasFmt };
+        if (VideoEncoderPreset::supportsFormat(vEnc, otherFmt)) sinkFormats.push_back(otherFmt);
+        if (m_videoGraph.init(m_videoFilter, canvasW, canvasH, canvasFmt, m_vEncCtx->time_base, inputFps,
+                              sinkFormats, m_videoFilterThreads)) {
+            m_vEncCtx->width = m_videoGraph.outWidth();
+            m_vEncCtx->height = m_videoGraph.outHeight();
+            m_vEncCtx->pix_fmt = m_videoGraph.outFormat();
+            if (m_videoGraph.outFrameRate().num > 0) encodeFps = m_videoGraph.outFrameRate();
+            trace(QString("Video filter: %1 -> %2x%3 %4").arg(m_videoFilter).arg(m_vEncCtx->width).arg(m_vEncCtx->height)
+                  .arg(av_get_pix_fmt_name(m_vEncCtx->pix_fmt)));
+        } else {
+            emit logMessage("警告：视频滤镜无效，已忽略: " + m_videoGraph.errorString());
+            trace("Video filter disabled: " + m_videoGraph.errorString());
+        }
+    }
+    m_vEncCtx->framerate = encodeFps; // Set framerate for encoder
+    // Both conversion paths produce BT.709 limited range; tag the stream so players agree
+    m_vEncCtx->color_range = AVCOL_RANGE_MPEG;
+    m_vEncCtx->colorspace = AVCOL_SPC_BT709;
+    m_vEncCtx->color_primaries = AVCOL_PRI_BT709;
+    m_vEncCtx->color_trc = AVCOL_TRC_BT709;
+    m_vEncCtx->bit_rate = VideoEncoderPreset::defaultBitRate(codec);
     // GOP size: keyframe every 1 second (round to ensure integer)
-    int gopSize = (int)(inputFps.num / (double)inputFps.den + 0.5);
+    int gopSize = (int)(encodeFps.num / (double)encodeFps.den + 0.5);
     if (gopSize < 1) gopSize = 30; // Minimum 1 second
     m_vEncCtx->gop_size = gopSize;
     m_vEncCtx->thread_count = 1; // Single thread to avoid crash
+    if (m_sceneCutKeyframes) {
+        // Extra keyframes at slide / window switches; a short minimum interval lets a cut
+        // that follows a regular keyframe still get its own
+        m_vEncCtx->keyint_min = qMax(1, gopSize / 10);
+        trace(QString("Scene-cut keyframes: keyint_min %1").arg(m_vEncCtx->keyint_min));
+    }
+    VideoEncoderPreset::apply(m_vEncCtx, vEnc, m_sceneCutKeyframes);
     if (m_outFmtCtx->oformat->flags & AVFMT_GLOBALHEADER) m_vEncCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    avcodec_open2(m_vEncCtx, vEnc, nullptr);
+    if (avcodec_open2(m_vEncCtx, vEnc, nullptr) < 0) {
+        abortSetup(QString("无法打开视频编码器 %1").arg(vEnc->name), "open video encoder failed");
+        return;
+    }
     avcodec_parameters_from_context(vOutStream->codecpar, m_vEncCtx);
+    vOutStream->codecpar->codec_tag = VideoEncoderPreset::codecTagFor(m_outFmtCtx->oformat, m_vEncCtx->codec_id);
     // CRITICAL: Set output stream time_base to match encoder time_base
     vOutStream->time_base = m_vEncCtx->time_base;
-    vOutStream->avg_frame_rate = inputFps;
-    vOutStream->r_frame_rate = inputFps;
-    trace(QString("Output Stream time_base: %1/%2, fps: %3/%4").arg(vOutStream->time_base.num).arg(vOutStream->time_base.den).arg(inputFps.num).arg(inputFps.den));
+    vOutStream->avg_frame_rate = encodeFps;
+    vOutStream->r_frame_rate = encodeFps;
+    trace(QString("Video encoder pix_fmt: %1").arg(av_get_pix_fmt_name(m_vEncCtx->pix_fmt)));
+    trace(QString("Output Stream time_base: %1/%2, fps: %3/%4").arg(vOutStream->time_base.num).arg(vOutStream->time_base.den).arg(encodeFps.num).arg(encodeFps.den));
 
     // 4. Audio Setup
+    // The encoder runs at the devices' native rate: loopback threads report their format
+    // once the device is open, so give them a moment before the mixer rate is fixed
+    QElapsedTimer formatTimer;
+    formatTimer.start();
+    while (m_isRecording && !m_mixer.formatsKnown() && formatTimer.elapsed() < 2000) QThread::msleep(10);
     // Check if ANY device was opened (SysThread, SDL or Qt)
-    bool hasAudio = (m_isSysAudioRunning.load() || m_devMic > 0 || m_qtAudioMic);
+    bool hasAudio = m_mixer.activeSourceCount() > 0;
     
     AVStream *aOutStream = nullptr;
     if (hasAudio) {
         aOutStream = avformat_new_stream(m_outFmtCtx, nullptr);
         const AVCodec *aEnc = avcodec_find_encoder(AV_CODEC_ID_AAC);
+        int mixRate = m_mixer.lockSampleRate(aEnc->supported_samplerates);
+        trace(QString("Audio rate: %1 Hz (formats known after %2 ms)").arg(mixRate).arg(formatTimer.elapsed()));
         m_aEncCtx = avcodec_alloc_context3(aEnc);
-        m_aEncCtx->sample_rate = 44100;
+        m_aEncCtx->sample_rate = mixRate;
         m_aEncCtx->channel_layout = AV_CH_LAYOUT_STEREO;
         m_aEncCtx->channels = 2;
         m_aEncCtx->sample_fmt = AV_SAMPLE_FMT_FLTP;
-        m_aEncCtx->time_base = {1, 44100};
+        m_aEncCtx->time_base = {1, mixRate};
         m_aEncCtx->thread_count = 1; // Single thread to avoid crash
         if (m_outFmtCtx->oformat->flags & AVFMT_GLOBALHEADER) m_aEncCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
         avcodec_open2(m_aEncCtx, aEnc, nullptr);
         avcodec_parameters_from_context(aOutStream->codecpar, m_aEncCtx);
         // CRITICAL: Set output stream time_base to match encoder time_base
         aOutStream->time_base = m_aEncCtx->time_base;
-        
-        m_swrMicCtx = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLTP, 44100,
-                                         AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 44100, 0, nullptr);
-        swr_init(m_swrMicCtx);
+
+        for (int i = 0; i < m_mixer.sourceCount(); i++) {
+            AudioMixer::Source *source = m_mixer.source(i);
+            trace(QString("Audio source: %1 (%2) %3 Hz%4 gain=%5 latency=%6ms%7")
+                  .arg(source->name()).arg(source->kind() == AudioMixer::Microphone ? "mic" : "loopback")
+                  .arg(source->inputSampleRate()).arg(source->isNativeRate() ? "" : " resampled")
+                  .arg(source->gain()).arg(source->latencyNs() / 1000000).arg(source->isActive() ? "" : " [inactive]"));
+        }
     }
-    trace("Encoders Setup Done");
+    trace(QString("Encoders Setup Done (armed in %1 ms)").arg(armTimer.elapsed()));
+
+    // 4.5 Armed: wait for the start trigger. Keep draining the grabber so no stale
+    // frames are queued when recording begins; audio before the first video frame
+    // is dropped by AudioBuffer::readAt.
+    AVPacket pkt; av_init_packet(&pkt);
+    while (m_isRecording && !m_startTriggered) {
+        if (!damageCapture && av_read_frame(m_vInFmtCtx, &pkt) >= 0) av_packet_unref(&pkt);
+        else QThread::msleep(5); // The damage grabber only reads on demand
+    }
+    if (!m_isRecording) trace("Disarmed before start");
+    const QString outputPath = m_startTriggered ? m_currentFile : QString(); // Set by startRecording()
 
     // 5. Write Header
-    if (!(m_outFmtCtx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&m_outFmtCtx->pb, m_currentFile.toUtf8().constData(), AVIO_FLAG_WRITE) < 0) {
-            emit errorOccurred("无法打开输出文件"); trace("Err: avio_open"); return;
+    if (m_isRecording) {
+        av_freep(&m_outFmtCtx->url);
+        m_outFmtCtx->url = av_strdup(outputPath.toUtf8().constData());
+        m_storage.start(outputPath);
+        StorageMonitor::Sample disk = m_storage.lastSample();
+        if (disk.freeBytes >= 0 && disk.freeBytes < m_storage.reserveBytes()) {
+            abortSetup("磁盘空间不足，无法开始录制",
+                       QString("not enough disk space (%1 MB free)").arg(disk.freeBytes / (1024 * 1024)));
+            return;
+        }
+        trace(QString("Output volume free: %1 MB").arg(disk.freeBytes / (1024 * 1024)));
+
+        // Output goes through a write-behind AVIO so disk stalls don't block capture
+        if (!(m_outFmtCtx->oformat->flags & AVFMT_NOFILE)) {
+            if (!m_fileWriter.open(outputPath, 64 * 1024 * 1024, m_preallocateBytes)) {
+                abortSetup("无法打开输出文件", "open output: " + m_fileWriter.errorString());
+                return;
+            }
+            m_outFmtCtx->pb = m_fileWriter.ioContext();
+            m_outFmtCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+            trace(QString("Output writer opened (prealloc %1 MB)").arg(m_fileWriter.stats().preallocatedBytes / (1024 * 1024)));
+        }
+        if (avformat_write_header(m_outFmtCtx, nullptr) >= 0) {
+            headerWritten = true;
+            trace("Header Written");
+            m_index.clear();
+            m_index.setEncoder(m_vEncCtx, m_aEncCtx, m_sceneCutKeyframes);
+            // Live output from the same packets; connects on its own thread
+            m_sinks.clear();
+            if (!m_streamUrl.isEmpty()) {
+                std::unique_ptr<MuxerSink> sink(new MuxerSink());
+                if (sink->open(m_streamUrl, QString(), {}, m_vEncCtx, m_aEncCtx)) {
+                    trace("Stream sink: " + m_streamUrl);
+                    m_sinks.push_back(std::move(sink));
+                }
+            }
+            if (!m_pipeOutput.isEmpty()) {
+                // Downstream tools read the same packets while the file is still growing
+                QMap<QString, QString> pipeOptions;
+                QString pipeError;
+                QString pipeUrl = MuxerSink::pipeUrlFor(m_pipeOutput, &pipeOptions, &pipeError);
+                std::unique_ptr<MuxerSink> sink(new MuxerSink());
+                if (pipeUrl.isEmpty()) {
+                    emit errorOccurred("无法输出到管道: " + pipeError);
+                    trace("Err: pipe output: " + pipeError);
+                } else if (sink->open(pipeUrl, m_pipeFormat, pipeOptions, m_vEncCtx, m_aEncCtx)) {
+                    trace(QString("Pipe sink: %1 (%2)").arg(pipeUrl, m_pipeFormat));
+                    m_sinks.push_back(std::move(sink));
+                }
+            }
+            if (m_hlsPreview) {
+                // Segments are cut at keyframes (one per second), so whole seconds line up;
+                // temp_file keeps the server from handing out a half-written segment
+                QMap<QString, QString> hlsOptions;
+                hlsOptions["hls_time"] = QString::number(m_hlsSegmentSec);
+                hlsOptions["hls_list_size"] = "6";
+                hlsOptions["hls_segment_type"] = "fmp4";
+                hlsOptions["hls_fmp4_init_filename"] = "init.mp4";
+                hlsOptions["hls_flags"] = "delete_segments+independent_segments+temp_file";
+                std::unique_ptr<MuxerSink> sink(new MuxerSink());
+                if (sink->open(m_hlsDir + "/" + HlsServer::kPlaylistName, "hls", hlsOptions, m_vEncCtx, m_aEncCtx)) {
+                    trace("HLS preview sink: " + m_hlsDir);
+                    m_sinks.push_back(std::move(sink));
+                }
+            }
+        } else {
+            trace("Err: write_header failed");
+        }
+
+        // Scrubbing proxy, only worth it when the recording is larger than the proxy
+        if (headerWritten && m_proxyFile && m_vEncCtx->height > ProxyEncoder::kHeight) {
+            QString proxyPath = VideoUtils::proxyPathFor(outputPath);
+            QDir().mkpath(QFileInfo(proxyPath).absolutePath());
+            if (m_proxy.open(proxyPath, m_vEncCtx->width, m_vEncCtx->height, m_vEncCtx->pix_fmt,
+                             m_vEncCtx->time_base, encodeFps, m_aEncCtx)) {
+                trace("Proxy: " + proxyPath);
+            } else {
+                trace("Proxy disabled: " + m_proxy.errorString());
+            }
+        }
+
+        // Picture-in-picture: the source runs on its own thread, the loop only blends
+        if (headerWritten && !m_pipSource.isEmpty()) {
+            if (m_pip.open(m_pipSource, m_pipOptions, canvasW, canvasH, canvasFmt,
+                           (PipCompositor::Corner)m_pipCorner, m_pipScale, m_pipOpacity)) {
+                QRect r = m_pip.rect();
+                trace(QString("PiP: %1 at %2x%3+%4+%5 (%6)").arg(m_pipSource).arg(r.width()).arg(r.height())
+                      .arg(r.x()).arg(r.y()).arg(ColorConverter::isaName(m_pip.isa())));
+            } else {
+                emit logMessage("警告：画中画未启用: " + m_pip.errorString());
+                trace("PiP disabled: " + m_pip.errorString());
+            }
         }
-    }
-    if (avformat_write_header(m_outFmtCtx, nullptr) >= 0) {
-        headerWritten = true;
-        trace("Header Written");
-    } else {
-        trace("Err: write_header failed");
     }
 
     // 6. Loop
-    AVPacket pkt; av_init_packet(&pkt);
     AVFrame *rawFrame = av_frame_alloc();
+    AVFrame *cropFrame = av_frame_alloc(); // Viewport view into the captured frame (no copy)
+    // Canvas pictures come from a pool: the proxy, the live monitor and the filter chain
+    // keep references to the pictures they were given, and the next one is converted into
+    // another buffer instead of a copy of the shared one
+    AVBufferPool *canvasPool = av_buffer_pool_init(av_image_get_buffer_size(canvasFmt, canvasW, canvasH, 32), av_buffer_alloc);
+    auto attachCanvas = [&](AVFrame *frame) -> bool {
+        frame->format = canvasFmt;
+        frame->width = canvasW;
+        frame->height = canvasH;
+        frame->color_range = m_vEncCtx->color_range;
+        frame->colorspace = m_vEncCtx->colorspace;
+        frame->buf[0] = canvasPool ? av_buffer_pool_get(canvasPool) : nullptr;
+        if (!frame->buf[0]) return false;
+        av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, canvasFmt, canvasW, canvasH, 32);
+        return true;
+    };
     AVFrame *yuvFrame = av_frame_alloc();
-    yuvFrame->format = AV_PIX_FMT_YUV420P;
-    yuvFrame->width = m_vEncCtx->width;
-    yuvFrame->height = m_vEncCtx->height;
-    av_frame_get_buffer(yuvFrame, 32);
+    AVFrame *prevCanvas = av_frame_alloc(); // Previous picture while rows are carried over
+    attachCanvas(yuvFrame);
     
     AVFrame *aFrame = av_frame_alloc();
     aFrame->nb_samples = 1024;
@@ -561,140 +1275,309 @@ void RecorderController::recordThreadFunc() {
     int64_t vPts = 0;
     int64_t aPts = 0;
     int lastW = 0, lastH = 0, lastFmt = -1;
+    bool fastConvert = false; // m_colorConv handles the current input geometry
+    qint64 convertNs = 0;
+    int convertFrames = 0;
     double actualFps = av_q2d(inputFps); // Actual FPS from input stream
     trace(QString("Recording with FPS: %1").arg(actualFps));
     
-    // Use actual recording time for PTS calculation
-    QElapsedTimer frameTimer;
-    frameTimer.start();
-    int64_t startTimeUs = -1; // Start time in microseconds (-1 means not initialized)
-
-    uint8_t rawSys[4096];
-    uint8_t rawMic[4096];
-    int16_t mixBuf[4096];
+    // PTS are derived from capture times on the shared MediaClock
+    MediaClock::DeviceAnchor videoAnchor;
+    if (syncTestStartNs >= 0) videoAnchor.offsetNs = syncTestStartNs; // Frames are stamped where they were generated
+    int64_t videoStartNs = -1; // Clock time of the first video frame (-1 = not yet)
+    int64_t lastVideoPts = -1;
+    int64_t lastEncodedPts = -1; // Differs from lastVideoPts only behind a filter graph
+    bool markerPending = false;  // Force the next encoded frame to a keyframe
+    std::vector<int64_t> markerPts; // Chapter starts, encoder time base
 
     trace("Enter Loop");
     
     QElapsedTimer levelTimer;
     levelTimer.start();
+    QElapsedTimer ioStatsTimer;
+    ioStatsTimer.start();
+    QElapsedTimer windowCheckTimer;
+    windowCheckTimer.start();
+    bool ioErrorReported = false;
+    QStringList sinkErrorsReported;
+    bool monitorReported = false; // Measured monitor latency shown once
+    // Bitrate steps used when the output volume runs low or can't keep up
+    // (H.264 figures; other codecs scale from their own starting rate)
+    static const int64_t kBitrateLadder[] = { 3000000, 1500000, 800000 };
+    int bitrateStep = 0;
+    bool bitrateFixedReported = false;
+    bool autoStop = false; // Finalize early (disk full / write error)
+
+    // Convert + encode one captured frame. dirtyRows (damage capture only) lists the
+    // rows that changed since the previous frame; nullptr means the whole frame.
+    bool convertedOnce = false; // yuvFrame holds a conversion of the current geometry
+    bool clearCanvas = false;   // Letterboxed input: the bars need painting before scaling
+    QRect scaleRect; // swscale target inside yuvFrame
+    CursorViewport viewport;
+    int64_t timelapseFrames = 0;
+    int64_t nextGrabNs = 0; // Clock time of the next timelapse grab
+#ifdef Q_OS_MAC
+    // avfoundation streams continuously; gdigrab/x11grab only grab when read and can stay open
+    const bool releaseBetweenGrabs = m_timelapse && !damageCapture;
+#else
+    const bool releaseBetweenGrabs = false;
+#endif
+    std::vector<RowSpan> viewportDirty;
+    std::vector<RowSpan> pipDirty;
+    // Top-left of the captured area on the desktop, to map the cursor into the frame
+    auto captureOrigin = [&]() -> QPoint {
+#ifdef MSR_X11_DAMAGE
+        if (damageCapture) return x11Grabber.region().topLeft();
+#endif
+#ifdef Q_OS_WIN
+        if (captureWindow) {
+            POINT p = { 0, 0 };
+            ClientToScreen((HWND)captureWindow, &p);
+            return QPoint(p.x, p.y);
+        }
+#endif
+        return m_recordRegion.isNull() ? QPoint() : m_recordRegion.topLeft();
+    };
+    // Cursor on the desktop without touching QCursor (GUI thread only) from this thread
+    auto cursorPos = [&]() -> QPoint {
+#ifdef Q_OS_WIN
+        return globalCursorPos();
+#else
+#ifdef MSR_X11_DAMAGE
+        if (damageCapture) return x11Grabber.cursorPos();
+#endif
+        return unpackPoint(m_cursorPos.load());
+#endif
+    };
+    // Frame in the encoder's size and format, PTS in its time base
+    auto encodeFrame = [&](AVFrame *frame, int64_t captureNs) {
+        if (markerPending && (markerPts.empty() || markerPts.back() != frame->pts)) {
+            markerPts.push_back(frame->pts);
+            frame->pict_type = AV_PICTURE_TYPE_I;
+            qint64 markerMs = av_rescale_q(frame->pts, m_vEncCtx->time_base, {1, 1000});
+            trace(QString("Marker %1 at %2 ms").arg(markerPts.size()).arg(markerMs));
+            emit markerAdded(markerMs);
+        }
+        markerPending = false;
+        lastEncodedPts = frame->pts;
+        m_proxy.pushVideo(frame);
+        m_liveTap.offer(frame, captureNs);
 
-    while (m_isRecording) {
-        // Video
-        if (av_read_frame(m_vInFmtCtx, &pkt) >= 0) {
+        avcodec_send_frame(m_vEncCtx, frame);
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        m_index.addFrame(frame->pts);
+        AVPacket encPkt; av_init_packet(&encPkt);
+        while (avcodec_receive_packet(m_vEncCtx, &encPkt) == 0) {
+            m_index.addPacket(&encPkt);
+            for (auto &sink : m_sinks) sink->push(&encPkt, m_vEncCtx->time_base, MuxerSink::Video);
+            encPkt.stream_index = vOutStream->index;
+            av_packet_rescale_ts(&encPkt, m_vEncCtx->time_base, vOutStream->time_base);
+            if (headerWritten) av_interleaved_write_frame(m_outFmtCtx, &encPkt);
+            av_packet_unref(&encPkt);
+        }
+    };
+    auto encodeVideoFrame = [&](AVFrame *inFrame, int64_t acquiredNs, const std::vector<RowSpan> *dirtyRows) {
+        if (viewportW > 0) {
+            // Crop before conversion: the converter and encoder only see viewport pixels
+            bool reset = inFrame->width != viewport.frameWidth() || inFrame->height != viewport.frameHeight();
+            if (reset) viewport.reset(inFrame->width, inFrame->height, viewportW, viewportH);
+            QRect prev = viewport.rect();
+            QRect crop = viewport.update(cursorPos() - captureOrigin(), acquiredNs);
+            if (dirtyRows && !reset && crop == prev) {
+                // Same window as last frame: only the changed rows inside it need converting
+                viewportDirty.clear();
+                for (const RowSpan &span : *dirtyRows) {
+                    int first = qMax(span.first, crop.top()) - crop.top();
+                    int last = qMin(span.last, crop.top() + crop.height()) - crop.top();
+                    if (first < last) viewportDirty.push_back({ first, last });
+                }
+                dirtyRows = &viewportDirty;
+            } else {
+                dirtyRows = nullptr;
+            }
+
+            cropFrame->format = inFrame->format;
+            cropFrame->width = inFrame->width;
+            cropFrame->height = inFrame->height;
+            for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+                cropFrame->data[i] = inFrame->data[i];
+                cropFrame->linesize[i] = inFrame->linesize[i];
+            }
+            cropFrame->best_effort_timestamp = inFrame->best_effort_timestamp;
+            cropFrame->crop_left = crop.x();
+            cropFrame->crop_top = crop.y();
+            cropFrame->crop_right = inFrame->width - crop.x() - crop.width();
+            cropFrame->crop_bottom = inFrame->height - crop.y() - crop.height();
+            if (av_frame_apply_cropping(cropFrame, AV_FRAME_CROP_UNALIGNED) < 0) return;
+            inFrame = cropFrame;
+        }
+        if (inFrame->width != lastW || inFrame->height != lastH || inFrame->format != lastFmt) {
+            if (m_swsCtx) { sws_freeContext(m_swsCtx); m_swsCtx = nullptr; }
+            bool sameSize = inFrame->width == canvasW && inFrame->height == canvasH;
+            fastConvert = sameSize && m_colorConv.init(inFrame->width, inFrame->height, (AVPixelFormat)inFrame->format, canvasFmt);
+            if (fastConvert) {
+                trace(QString("Color convert: %1 (%2 bands)").arg(ColorConverter::isaName(m_colorConv.isa())).arg(m_colorConv.bandCount()));
+            } else {
+                // A followed window that was resized keeps its aspect ratio inside the fixed
+                // encoder size, with black bars around it
+                scaleRect = fitInside(inFrame->width, inFrame->height, canvasW, canvasH);
+                if (!sameSize) {
+                    clearCanvas = true;
+                    trace(QString("Input %1x%2 scaled to %3x%4 at (%5,%6)").arg(inFrame->width).arg(inFrame->height)
+                          .arg(scaleRect.width()).arg(scaleRect.height()).arg(scaleRect.x()).arg(scaleRect.y()));
+                }
+                m_swsCtx = sws_getContext(inFrame->width, inFrame->height, (AVPixelFormat)inFrame->format,
+                                          scaleRect.width(), scaleRect.height(), canvasFmt,
+                                          SWS_BICUBIC, nullptr, nullptr, nullptr);
+                // Match the BT.709 limited range the encoder is tagged with
+                if (m_swsCtx) {
+                    sws_setColorspaceDetails(m_swsCtx, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                             sws_getCoefficients(SWS_CS_ITU709), 0, 0, 1 << 16, 1 << 16);
+                }
+                trace(QString("Color convert: swscale (input %1)").arg(av_get_pix_fmt_name((AVPixelFormat)inFrame->format)));
+            }
+            lastW = inFrame->width; lastH = inFrame->height; lastFmt = inFrame->format;
+            convertedOnce = false;
+        }
+        if (fastConvert || m_swsCtx) {
+            // Device timestamp mapped onto the clock; falls back to acquisition time
+            int64_t captureNs = m_clock.mapDeviceTs(videoAnchor, inFrame->best_effort_timestamp, vInTimeBase, acquiredNs);
+            if (videoStartNs < 0 && captureNs < m_startRequestNs.load()) return; // Grabbed before the trigger
+
+            QElapsedTimer convertTimer;
+            convertTimer.start();
+            // Rows the grabber left untouched still hold last frame's output; the inset's rows
+            // hold last frame's blend and are always converted again
+            const std::vector<RowSpan> *convertRows = fastConvert && convertedOnce ? dirtyRows : nullptr;
+            if (convertRows && m_pip.isOpen()) {
+                pipDirty.assign(convertRows->begin(), convertRows->end());
+                pipDirty.push_back({ m_pip.rect().top(), m_pip.rect().top() + m_pip.rect().height() });
+                convertRows = &pipDirty;
+            }
+            if (!av_frame_is_writable(yuvFrame)) {
+                // Someone still holds the previous picture: take a fresh buffer and carry over
+                // only what this conversion will not write
+                av_frame_move_ref(prevCanvas, yuvFrame);
+                if (!attachCanvas(yuvFrame)) {
+                    trace("Err: canvas buffer allocation failed");
+                    av_frame_move_ref(yuvFrame, prevCanvas);
+                    return;
+                }
+                if (convertRows) copyUnchangedRows(yuvFrame, prevCanvas, *convertRows);
+                else if (!fastConvert && scaleRect != QRect(0, 0, canvasW, canvasH)) clearCanvas = true;
+                av_frame_unref(prevCanvas);
+            }
+            if (clearCanvas) {
+                fillBlack(yuvFrame);
+                clearCanvas = false;
+            }
+            if (fastConvert) {
+                m_colorConv.convert(inFrame, yuvFrame, convertRows);
+                convertedOnce = true;
+            } else {
+                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(canvasFmt);
+                int cx = scaleRect.x() >> desc->log2_chroma_w, cy = scaleRect.y() >> desc->log2_chroma_h;
+                uint8_t *dst[4] = { yuvFrame->data[0] + (int64_t)scaleRect.y() * yuvFrame->linesize[0] + scaleRect.x(),
+                                    yuvFrame->data[1] + (int64_t)cy * yuvFrame->linesize[1] + cx,
+                                    yuvFrame->data[2] + (int64_t)cy * yuvFrame->linesize[2] + cx, nullptr };
+                int lines[4] = { yuvFrame->linesize[0], yuvFrame->linesize[1], yuvFrame->linesize[2], 0 };
+                sws_scale(m_swsCtx, inFrame->data, inFrame->linesize, 0, inFrame->height, dst, lines);
+            }
+            if (m_pip.isOpen()) m_pip.blend(yuvFrame);
+            convertNs += convertTimer.nsecsElapsed();
+            convertFrames++;
+            if (videoStartNs < 0) {
+                videoStartNs = captureNs; // First frame starts at PTS 0
+                double latencyMs = (captureNs - m_startRequestNs.load()) / 1000000.0;
+                trace(QString("Start latency: %1 ms (trigger -> first frame)").arg(latencyMs, 0, 'f', 1));
+                emit logMessage(QString("录制启动延迟: %1 ms").arg(latencyMs, 0, 'f', 1));
+            }
+            // Timelapse frames are spaced one playback frame apart, not by capture time
+            int64_t pts = m_timelapse ? av_rescale_q(timelapseFrames++, av_inv_q(inputFps), m_vEncCtx->time_base)
+                                      : MediaClock::toStreamTs(captureNs - videoStartNs, m_vEncCtx->time_base);
+            if (m_timelapse) nextGrabNs = captureNs + (int64_t)m_timelapseIntervalSec * 1000000000LL;
+            if (pts <= lastVideoPts) pts = lastVideoPts + 1; // Keep strictly increasing
+            lastVideoPts = pts;
+            yuvFrame->pts = pts;
+            // First frame captured after a marker request starts a new GOP
+            {
+                QMutexLocker lock(&m_markerMutex);
+                while (!m_pendingMarkers.empty() && m_pendingMarkers.front() <= captureNs) {
+                    m_pendingMarkers.erase(m_pendingMarkers.begin());
+                    markerPending = true;
+                }
+            }
+            if (!m_videoGraph.isOpen()) {
+                encodeFrame(yuvFrame, captureNs);
+                return;
+            }
+            // The chain may hold frames back, drop or repeat them; encode whatever it has ready
+            m_videoGraph.push(yuvFrame);
+            while (AVFrame *filtered = m_videoGraph.pull()) {
+                encodeFrame(filtered, captureNs);
+                av_frame_free(&filtered);
+            }
+        }
+    };
+#ifdef MSR_X11_DAMAGE
+    AVFrame *grabFrame = av_frame_alloc();
+    std::vector<RowSpan> dirtyRows;
+    int grabFailures = 0;
+#endif
+
+    while (m_isRecording && !autoStop) {
+        // Video (timelapse: only when the next grab is due)
+        bool grabDue = !m_timelapse || m_clock.nowNs() >= nextGrabNs;
+#ifdef MSR_X11_DAMAGE
+        if (damageCapture && grabDue) {
+            // grab() paces to the frame rate itself
+            if (x11Grabber.grab(grabFrame, dirtyRows)) {
+                grabFailures = 0;
+                encodeVideoFrame(grabFrame, m_clock.nowNs(), &dirtyRows);
+            } else if (++grabFailures == 1) {
+                trace("X11 damage capture: grab failed (screen changed?), retrying with a full frame");
+            }
+        }
+#endif
+        if (!damageCapture && grabDue && !m_vInFmtCtx && !openVideoInput()) autoStop = true;
+        if (!damageCapture && grabDue && m_vInFmtCtx && av_read_frame(m_vInFmtCtx, &pkt) >= 0) {
+            int64_t acquiredNs = m_clock.nowNs();
             if (pkt.stream_index == vInStreamIdx) {
                 if (avcodec_send_packet(vDecCtx, &pkt) == 0) {
                     while (avcodec_receive_frame(vDecCtx, rawFrame) == 0) {
-                        if (!m_swsCtx || rawFrame->width != lastW || rawFrame->height != lastH || rawFrame->format != lastFmt) {
-                            if (m_swsCtx) sws_freeContext(m_swsCtx);
-                            m_swsCtx = sws_getContext(rawFrame->width, rawFrame->height, (AVPixelFormat)rawFrame->format,
-                                                      m_vEncCtx->width, m_vEncCtx->height, AV_PIX_FMT_YUV420P,
-                                                      SWS_BICUBIC, nullptr, nullptr, nullptr);
-                            lastW = rawFrame->width; lastH = rawFrame->height; lastFmt = rawFrame->format;
-                        }
-                        if (m_swsCtx) {
-                            uint8_t *dst[4] = { yuvFrame->data[0], yuvFrame->data[1], yuvFrame->data[2], nullptr };
-                            int lines[4] = { yuvFrame->linesize[0], yuvFrame->linesize[1], yuvFrame->linesize[2], 0 };
-                            sws_scale(m_swsCtx, rawFrame->data, rawFrame->linesize, 0, rawFrame->height, dst, lines);
-                            
-                            // Calculate PTS based on actual elapsed time
-                            if (startTimeUs < 0) {
-                                startTimeUs = frameTimer.elapsed() * 1000LL; // Convert to microseconds
-                                yuvFrame->pts = 0; // First frame starts at PTS 0
-                            } else {
-                                int64_t elapsedUs = frameTimer.elapsed() * 1000LL - startTimeUs;
-                                // Convert microseconds to PTS: PTS = elapsed_us * fps / 1000000
-                                // Since time_base = {den, num} = {1, fps}, PTS = elapsed_us * fps / 1000000
-                                // inputFps = {num, den}, so fps = num/den
-                                // PTS = elapsedUs * num / (1000000 * den)
-                                yuvFrame->pts = (elapsedUs * inputFps.num) / (1000000LL * inputFps.den);
-                            }
-                            
-                            avcodec_send_frame(m_vEncCtx, yuvFrame);
-                            AVPacket encPkt; av_init_packet(&encPkt);
-                            while (avcodec_receive_packet(m_vEncCtx, &encPkt) == 0) {
-                                encPkt.stream_index = vOutStream->index;
-                                av_packet_rescale_ts(&encPkt, m_vEncCtx->time_base, vOutStream->time_base);
-                                if (headerWritten) av_interleaved_write_frame(m_outFmtCtx, &encPkt);
-                                av_packet_unref(&encPkt);
-                            }
-                        }
+                        encodeVideoFrame(rawFrame, acquiredNs, nullptr);
                     }
                 }
             }
             av_packet_unref(&pkt);
         }
+        if (releaseBetweenGrabs && m_vInFmtCtx && m_clock.nowNs() < nextGrabNs) {
+            avcodec_free_context(&vDecCtx);
+            avformat_close_input(&m_vInFmtCtx);
+        }
         
-        // Audio Mixing (decouple from video FPS; fill based on elapsed wall clock)
-        if (hasAudio && startTimeUs >= 0) {
-            int64_t elapsedUs = frameTimer.elapsed() * 1000LL - startTimeUs;
-            int64_t targetSamples = (elapsedUs * 44100) / 1000000LL;
-            // Produce audio until catching up to target (allow small lead of 2048 samples)
-            while (aPts + 1024 <= targetSamples + 2048) {
-                int sysAvail = m_bufSys.available();
-                int micAvail = m_bufMic.available();
-                
-                bool sysActive = m_isSysAudioRunning.load();
-                bool micActive = (m_devMic > 0 || m_qtAudioMic);
-                
-                memset(rawSys, 0, 4096);
-                memset(rawMic, 0, 4096);
-                
-                if (sysActive && sysAvail > 0) {
-                    int toRead = qMin(sysAvail, 4096);
-                    m_bufSys.read(rawSys, toRead);
-                }
-                if (micActive && micAvail > 0) {
-                    int toRead = qMin(micAvail, 4096);
-                    m_bufMic.read(rawMic, toRead);
-                }
-                
-                int16_t* s = (int16_t*)rawSys;
-                int16_t* m = (int16_t*)rawMic;
-                
-                // Boost mic gain significantly as raw PCM from some mics is very low
-                double micBoost = 10.0; // Further increased boost for microphone (from 5.0 to 10.0)
+        // Audio Mixing: audio frame N covers the same clock interval as the video it plays
+        // against, so each source is read at its timestamp instead of "whatever is buffered".
+        if (hasAudio && videoStartNs >= 0) {
+            int64_t nowNs = m_clock.nowNs();
+            while (true) {
+                int64_t frameStartNs = videoStartNs + MediaClock::fromStreamTs(aPts, m_aEncCtx->time_base);
+                int64_t frameEndNs = videoStartNs + MediaClock::fromStreamTs(aPts + 1024, m_aEncCtx->time_base);
+                if (frameEndNs > nowNs) break;
+
+                // Wait for late device buffers unless the interval is clearly overdue
+                bool overdue = (nowNs - frameEndNs) > 250000000LL;
+                if (!overdue && m_mixer.endTimestamp() < frameEndNs) break;
+
+                av_frame_make_writable(aFrame);
+                m_mixer.mix(reinterpret_cast<float *const *>(aFrame->data), 1024, frameStartNs);
+                m_index.addAudio(reinterpret_cast<const float *const *>(aFrame->data), m_aEncCtx->channels, 1024);
 
-                // Calculate Levels (RMS) periodically
                 if (levelTimer.elapsed() > 100) {
-                    double sumSys = 0;
-                    double sumMic = 0;
-                    // Note: rawSys/rawMic are 4096 bytes = 2048 int16 samples.
-                    // If stereo, it's 1024 frames of 2 channels.
-                    // The loop below iterates 2048 times, which covers all samples.
-                    // This calculates RMS over all samples (L+R mixed). Good enough.
-                    
-                    for (int i = 0; i < 2048; i++) {
-                        if (sysActive && sysAvail > 0) sumSys += (double)s[i] * s[i];
-                        if (micActive && micAvail > 0) {
-                            // Use raw mic input for metering, but respect boost?
-                            // Let's use the boosted value to match what's recorded.
-                            // But clamp it to avoid overflow in sumMic if needed (double is huge, it's fine).
-                            double val = (double)m[i] * micBoost; 
-                            sumMic += val * val;
-                        }
-                    }
-                    
-                    double rmsSys = sqrt(sumSys / 2048.0) / 32768.0;
-                    double rmsMic = sqrt(sumMic / 2048.0) / 32768.0;
-                    
-                    if (rmsSys > 1.0) rmsSys = 1.0;
-                    if (rmsMic > 1.0) rmsMic = 1.0;
-                    
-                    emit audioLevelsCalculated(rmsSys, rmsMic);
+                    emit audioLevelsCalculated(m_mixer.level(AudioMixer::Loopback), m_mixer.level(AudioMixer::Microphone));
                     levelTimer.restart();
                 }
 
-                for (int i = 0; i < 2048; i++) {
-                    // Apply per-source volume with simple soft clip
-                    int32_t val = (int32_t)(s[i] * m_sysVolume) + (int32_t)(m[i] * m_micVolume * micBoost);
-                    if (val > 32767) val = 32767;
-                    if (val < -32768) val = -32768;
-                    mixBuf[i] = (int16_t)val;
-                }
-                
-                const uint8_t *inData[1] = { (uint8_t*)mixBuf };
-                swr_convert(m_swrMicCtx, aFrame->data, 1024, inData, 1024);
-                
                 aFrame->pts = aPts;
                 aPts += 1024;
                 
@@ -703,23 +1586,142 @@ void RecorderController::recordThreadFunc() {
                 while (avcodec_receive_packet(m_aEncCtx, &aPkt) == 0) {
                     aPkt.stream_index = aOutStream->index;
                     av_packet_rescale_ts(&aPkt, m_aEncCtx->time_base, aOutStream->time_base);
+                    m_proxy.writeAudio(&aPkt, aOutStream->time_base);
+                    for (auto &sink : m_sinks) sink->push(&aPkt, aOutStream->time_base, MuxerSink::Audio);
                     if (headerWritten) av_interleaved_write_frame(m_outFmtCtx, &aPkt);
                     av_packet_unref(&aPkt);
                 }
             }
         }
         
-        QThread::msleep(1); 
+        // Output I/O health
+        if (!ioErrorReported && m_fileWriter.hasError()) {
+            ioErrorReported = true;
+            autoStop = true;
+            emit errorOccurred("写入录制文件失败: " + m_fileWriter.errorString());
+            trace("Err: output write failed: " + m_fileWriter.errorString());
+        }
+        // A failed live output is reported once; the file recording carries on
+        for (auto &sink : m_sinks) {
+            if (sink->hasFailed() && !sinkErrorsReported.contains(sink->url())) {
+                sinkErrorsReported.append(sink->url());
+                emit errorOccurred("实时输出已中断，继续录制到文件: " + sink->errorString());
+                trace("Err: stream sink: " + sink->errorString());
+            }
+        }
+        switch (m_storage.update(m_fileWriter.stats())) {
+        case StorageMonitor::Warn: {
+            StorageMonitor::Sample s = m_storage.lastSample();
+            emit storageWarning(QString("磁盘剩余空间仅够录制约 %1 分钟").arg(qMax<qint64>(1, s.remainingSec / 60)));
+            trace(QString("Storage: low space, free=%1MB remaining=%2s").arg(s.freeBytes / (1024 * 1024)).arg(s.remainingSec));
+            break;
+        }
+        case StorageMonitor::ReduceBitrate:
+            if (!VideoEncoderPreset::canChangeBitRate(m_vEncCtx->codec)) {
+                if (!bitrateFixedReported) {
+                    bitrateFixedReported = true;
+                    emit storageWarning("磁盘空间或写入速度不足，当前编码器无法在录制中降低码率");
+                    trace(QString("Storage: %1 cannot change bitrate while recording").arg(m_vEncCtx->codec->name));
+                }
+            } else if (bitrateStep + 1 < (int)(sizeof(kBitrateLadder) / sizeof(kBitrateLadder[0]))) {
+                bitrateStep++;
+                // libx264 picks up bit_rate changes on the next frame (ABR reconfig)
+                int64_t rate = kBitrateLadder[bitrateStep] * VideoEncoderPreset::defaultBitRate(codec) / kBitrateLadder[0];
+                m_vEncCtx->bit_rate = rate;
+                emit storageWarning(QString("磁盘空间或写入速度不足，已降低码率至 %1 kbps").arg(rate / 1000));
+                trace(QString("Storage: bitrate -> %1 (remaining=%2s write=%3MB/s out=%4MB/s)")
+                      .arg(rate).arg(m_storage.lastSample().remainingSec)
+                      .arg(m_storage.lastSample().writeMBps, 0, 'f', 2).arg(m_storage.lastSample().outputMBps, 0, 'f', 2));
+            }
+            break;
+        case StorageMonitor::Finalize:
+            autoStop = true;
+            emit storageWarning("磁盘空间即将耗尽，录制已自动结束并保存");
+            trace(QString("Storage: finalizing early, free=%1MB").arg(m_storage.lastSample().freeBytes / (1024 * 1024)));
+            break;
+        default:
+            break;
+        }
+        if (ioStatsTimer.elapsed() > 5000) {
+            AsyncFileWriter::Stats io = m_fileWriter.stats();
+            trace(QString("IO: written=%1MB queued=%2KB rate=%3MB/s stalls=%4 (%5ms) maxWrite=%6ms")
+                  .arg(io.bytesWritten / (1024 * 1024)).arg(io.bytesQueued / 1024).arg(io.writeMBps, 0, 'f', 2)
+                  .arg(io.stallCount).arg(io.stallMs).arg(io.maxWriteMs));
+            for (auto &sink : m_sinks) {
+                MuxerSink::Stats ss = sink->stats();
+                trace(QString("Sink %1: sent=%2 pkts (%3MB) dropped=%4 queued=%5KB").arg(sink->url()).arg(ss.packets)
+                      .arg(ss.bytes / (1024 * 1024)).arg(ss.dropped).arg(ss.queuedBytes / 1024));
+            }
+            if (convertFrames > 0) {
+                trace(QString("Convert: %1 ms/frame (%2)").arg(convertNs / 1000000.0 / convertFrames, 0, 'f', 2)
+                      .arg(fastConvert ? ColorConverter::isaName(m_colorConv.isa()) : "swscale"));
+                convertNs = 0;
+                convertFrames = 0;
+            }
+            if (m_micMonitor.isOpen()) {
+                AudioMonitor::Stats mon = m_micMonitor.stats();
+                trace(QString("Mic monitor: buffer delay (est.) %1 ms (queue %2 ms), underruns %3, dropped %4 ms")
+                      .arg(mon.bufferDelayMs, 0, 'f', 1).arg(mon.queueMs, 0, 'f', 1).arg(mon.underruns).arg(mon.droppedMs));
+                if (!monitorReported) {
+                    monitorReported = true;
+                    emit logMessage(QString("麦克风监听缓冲延迟（估算，不含设备和驱动延迟）: %1 ms").arg(mon.bufferDelayMs, 0, 'f', 1));
+                }
+            }
+#ifdef MSR_X11_DAMAGE
+            if (damageCapture) {
+                X11DamageGrabber::Stats g = x11Grabber.stats();
+                if (g.frames > 0) {
+                    trace(QString("X11 damage: %1% of rows re-read, %2 requests/frame")
+                          .arg(g.rowsTotal > 0 ? 100.0 * g.rowsGrabbed / g.rowsTotal : 0.0, 0, 'f', 1)
+                          .arg((double)g.requests / g.frames, 0, 'f', 2));
+                }
+            }
+#endif
+            ioStatsTimer.restart();
+        }
+
+#ifdef Q_OS_WIN
+        // gdigrab sizes a window capture once at open; reopen it after a resize
+        if (captureWindow && m_vInFmtCtx && windowCheckTimer.elapsed() > 500) {
+            windowCheckTimer.restart();
+            RECT rc;
+            AVCodecParameters *par = m_vInFmtCtx->streams[vInStreamIdx]->codecpar;
+            if (!IsIconic((HWND)captureWindow) && GetClientRect((HWND)captureWindow, &rc) &&
+                rc.right > 0 && rc.bottom > 0 && (rc.right != par->width || rc.bottom != par->height)) {
+                trace(QString("Window resized to %1x%2, reopening capture").arg(rc.right).arg(rc.bottom));
+                avcodec_free_context(&vDecCtx);
+                avformat_close_input(&m_vInFmtCtx);
+                videoAnchor.reset(); // New device timestamps
+                if (!openVideoInput()) autoStop = true;
+            }
+        }
+#endif
+
+        // Between timelapse grabs there is nothing to do but watch for stop
+        QThread::msleep(grabDue ? 1 : 20); 
     }
 
     trace("Exit Loop");
+    // Stopped from inside the loop: let the UI thread run the normal stop path
+    if (autoStop) QMetaObject::invokeMethod(this, "stopRecording", Qt::QueuedConnection);
 
     // Flush Video Encoder (Safe with thread_count=1)
     if (m_vEncCtx) {
+        if (m_videoGraph.isOpen()) {
+            // Frames still buffered in the chain (denoisers, fps) go out before the encoder flush
+            m_videoGraph.push(nullptr);
+            while (AVFrame *filtered = m_videoGraph.pull()) {
+                encodeFrame(filtered, m_clock.nowNs());
+                av_frame_free(&filtered);
+            }
+            m_videoGraph.close();
+        }
         trace("Flushing Video Encoder");
         avcodec_send_frame(m_vEncCtx, nullptr);
         AVPacket encPkt; av_init_packet(&encPkt);
         while (avcodec_receive_packet(m_vEncCtx, &encPkt) == 0) {
+            m_index.addPacket(&encPkt);
+            for (auto &sink : m_sinks) sink->push(&encPkt, m_vEncCtx->time_base, MuxerSink::Video);
             encPkt.stream_index = vOutStream->index;
             av_packet_rescale_ts(&encPkt, m_vEncCtx->time_base, vOutStream->time_base);
             if (headerWritten) av_interleaved_write_frame(m_outFmtCtx, &encPkt);
@@ -735,172 +1737,189 @@ void RecorderController::recordThreadFunc() {
         while (avcodec_receive_packet(m_aEncCtx, &aPkt) == 0) {
             aPkt.stream_index = aOutStream->index;
             av_packet_rescale_ts(&aPkt, m_aEncCtx->time_base, aOutStream->time_base);
+            m_proxy.writeAudio(&aPkt, aOutStream->time_base);
+            for (auto &sink : m_sinks) sink->push(&aPkt, aOutStream->time_base, MuxerSink::Audio);
             if (headerWritten) av_interleaved_write_frame(m_outFmtCtx, &aPkt);
             av_packet_unref(&aPkt);
         }
     }
 
     if (m_outFmtCtx && headerWritten) {
+        if (!markerPts.empty() && m_vEncCtx) {
+            int64_t endPts = lastEncodedPts + av_rescale_q(1, av_inv_q(encodeFps), m_vEncCtx->time_base);
+            addMarkerChapters(m_outFmtCtx, markerPts, endPts, m_vEncCtx->time_base);
+            trace(QString("Chapters: %1").arg(markerPts.size()));
+        }
         trace("Write Trailer");
         av_write_trailer(m_outFmtCtx);
     }
-    
-    trace("Free Video Enc");
-    if (m_vEncCtx) {
-        avcodec_free_context(&m_vEncCtx);
-        m_vEncCtx = nullptr;
-    }
-    trace("Free Audio Enc");
-    if (m_aEncCtx) {
-        avcodec_free_context(&m_aEncCtx);
-        m_aEncCtx = nullptr;
+    // Live outputs get a bounded time to send what is queued; the file is already complete
+    for (auto &sink : m_sinks) {
+        sink->close();
+        MuxerSink::Stats ss = sink->stats();
+        trace(QString("Sink closed: %1, %2 pkts, %3 dropped%4").arg(sink->url()).arg(ss.packets).arg(ss.dropped)
+              .arg(sink->hasFailed() ? " (" + sink->errorString() + ")" : QString()));
     }
-
-    if (m_outFmtCtx) {
-        if (!(m_outFmtCtx->oformat->flags & AVFMT_NOFILE)) {
-            trace("Close PB");
-            avio_closep(&m_outFmtCtx->pb);
-        }
-        trace("Free OutCtx");
-        avformat_free_context(m_outFmtCtx);
-        m_outFmtCtx = nullptr;
+    m_sinks.clear();
+    if (m_proxy.isOpen()) {
+        m_proxy.close();
+        ProxyEncoder::Stats proxyStats = m_proxy.stats();
+        trace(QString("Proxy closed: %1 frames, %2 dropped%3").arg(proxyStats.frames).arg(proxyStats.dropped)
+              .arg(m_proxy.errorString().isEmpty() ? QString() : " (" + m_proxy.errorString() + ")"));
     }
-    
-    // Note: SDL/Qt Closed in stopRecording()
-    
-    trace("Free Video Dec");
-    if (vDecCtx) avcodec_free_context(&vDecCtx);
-    
-    trace("Close Input");
-    if (m_vInFmtCtx) {
-        avformat_close_input(&m_vInFmtCtx);
-        m_vInFmtCtx = nullptr;
+    if (m_pip.isOpen()) {
+        trace(QString("PiP closed: %1 source frames").arg(m_pip.sourceFrames()));
+        m_pip.close();
     }
     
-    trace("Free Sws");
-    if (m_swsCtx) {
-        sws_freeContext(m_swsCtx);
-        m_swsCtx = nullptr;
-    }
-    trace("Free Swr");
-    if (m_swrMicCtx) {
-        swr_free(&m_swrMicCtx);
-        m_swrMicCtx = nullptr;
+    closeWriter();
+    // Sidecar for the player and editor, once the file is complete on disk
+    if (headerWritten) {
+        m_index.setMarkers(markerPts);
+        if (m_index.save(outputPath)) {
+            trace(QString("Index written: %1 frames, %2 keyframes, %3 peaks")
+                  .arg(m_index.framePts().size()).arg(m_index.keyframes().size()).arg(m_index.peaks().size()));
+        } else {
+            trace("Index not written: " + RecordingIndex::pathFor(outputPath));
+        }
     }
-    
+    releaseContexts();
     trace("Free Frames");
     av_frame_free(&rawFrame);
+    av_frame_free(&cropFrame);
     av_frame_free(&yuvFrame);
+    av_frame_free(&prevCanvas);
+    av_buffer_pool_uninit(&canvasPool); // Freed once the last outstanding picture is released
     av_frame_free(&aFrame);
+#ifdef MSR_X11_DAMAGE
+    av_frame_free(&grabFrame); // Data belongs to x11Grabber
+#endif
     
     trace("Worker Cleanup Done");
 }
 
-void RecorderController::sysAudioThreadFunc() {
-    trace("SysAudio Thread Start");
-    m_aSysInFmtCtx = nullptr;
-    m_swrSysCtx = nullptr;
-    m_aSysDecCtx = nullptr;
+void RecorderController::sysAudioThreadFunc(AudioMixer::Source *source, const QString &device) {
+    trace("SysAudio Thread Start: " + source->name());
+    AVFormatContext *inFmtCtx = nullptr;
+    AVCodecContext *decCtx = nullptr;
     
-    // 1. Open Input
+    // 1. Open Input (device empty = the platform's virtual capture device)
     bool opened = false;
     
+    // Sync test: the generated tone's t = 0 is this clock time
+    int64_t syncTestStartNs = -1;
+    if (device == kSyncTestDevice) {
+        syncTestStartNs = m_clock.nowNs();
+        QByteArray graph = SyncAnalyzer::audioGraph(48000, SyncAnalyzer::markerPhase(syncTestStartNs)).toUtf8();
+        inFmtCtx = allocInterruptibleInput(&m_isSysAudioRunning);
+        opened = avformat_open_input(&inFmtCtx, graph.constData(), av_find_input_format("lavfi"), nullptr) == 0;
+        trace(QString("SysAudio: sync test tone %1").arg(opened ? "opened" : "failed"));
+    } else {
 #ifdef Q_OS_WIN
-    AVDictionary *opts = nullptr;
-    av_dict_set(&opts, "loopback", "1", 0);
+        AVDictionary *opts = nullptr;
+        av_dict_set(&opts, "loopback", "1", 0);
 
-    // Log DLL existence and regsvr32 path
-    QString appDir = QCoreApplication::applicationDirPath();
-    QString dllPath = appDir + "/3rd/audio_sniffer.dll";
-    if (!QFile::exists(dllPath)) {
-        dllPath = appDir + "/audio_sniffer.dll";
-    }
+        // Log DLL existence and regsvr32 path
+        QString appDir = QCoreApplication::applicationDirPath();
+        QString dllPath = appDir + "/3rd/audio_sniffer.dll";
+        if (!QFile::exists(dllPath)) {
+            dllPath = appDir + "/audio_sniffer.dll";
+        }
 
-    int retOpen = avformat_open_input(&m_aSysInFmtCtx, "audio=virtual-audio-capturer", av_find_input_format("dshow"), &opts);
-    trace(QString("SysAudio: avformat_open_input ret = %1").arg(retOpen));
-    if (retOpen == 0) {
-        opened = true;
-        emit logMessage("Using Virtual Audio Capturer");
-    } else {
-         emit logMessage("Virtual Audio Capturer failed to open (Code: " + QString::number(retOpen) + ")");
-         // Note: Registration logic moved to checkSystemAudioAvailable().
-         // If we are here, it means checkSystemAudioAvailable wasn't called or failed, or something else is wrong.
-         // We won't try to register inside the thread anymore to avoid blocking/UI issues.
-         trace("SysAudio: Failed to open. Assuming checkSystemAudioAvailable handled registration or user cancelled.");
-    }
+        QString dshowName = device.isEmpty() ? QString("virtual-audio-capturer") : device;
+        inFmtCtx = allocInterruptibleInput(&m_isSysAudioRunning);
+        int retOpen = avformat_open_input(&inFmtCtx, ("audio=" + dshowName).toUtf8().constData(), av_find_input_format("dshow"), &opts);
+        av_dict_free(&opts);
+        trace(QString("SysAudio: avformat_open_input(%1) ret = %2").arg(dshowName).arg(retOpen));
+        if (retOpen == 0) {
+            opened = true;
+            emit logMessage("Using " + dshowName);
+        } else {
+             emit logMessage(dshowName + " failed to open (Code: " + QString::number(retOpen) + ")");
+             // Note: Registration logic moved to checkSystemAudioAvailable().
+             // If we are here, it means checkSystemAudioAvailable wasn't called or failed, or something else is wrong.
+             // We won't try to register inside the thread anymore to avoid blocking/UI issues.
+             trace("SysAudio: Failed to open. Assuming checkSystemAudioAvailable handled registration or user cancelled.");
+        }
 #elif defined(Q_OS_MAC)
-    AVInputFormat *fmt = av_find_input_format("avfoundation");
-    if (avformat_open_input(&m_aSysInFmtCtx, ":BlackHole 16ch", fmt, nullptr) == 0) { 
-        opened = true; 
-        emit logMessage("Connected to BlackHole 16ch");
-    } else if (avformat_open_input(&m_aSysInFmtCtx, ":Soundflower (2ch)", fmt, nullptr) == 0) {
-        opened = true;
-        emit logMessage("Connected to Soundflower (2ch)");
-    } else {
-        emit logMessage("Mac System Audio: Requires 'BlackHole' or 'Soundflower' driver.");
-    }
+        AVInputFormat *fmt = av_find_input_format("avfoundation");
+        QStringList candidates;
+        if (device.isEmpty()) candidates << "BlackHole 16ch" << "Soundflower (2ch)";
+        else candidates << device;
+        for (const QString &name : candidates) {
+            inFmtCtx = allocInterruptibleInput(&m_isSysAudioRunning);
+            if (avformat_open_input(&inFmtCtx, (":" + name).toUtf8().constData(), fmt, nullptr) == 0) {
+                opened = true;
+                emit logMessage("Connected to " + name);
+                break;
+            }
+        }
+        if (!opened) emit logMessage("Mac System Audio: Requires 'BlackHole' or 'Soundflower' driver.");
 #endif
+    }
 
     if (!opened) {
         emit errorOccurred("无法启动系统声音录制 (Virtual Audio Capturer 失败)");
         trace("Err: Virtual Audio Capturer Open Failed");
-        m_isSysAudioRunning = false;
+        source->setActive(false);
         return;
     }
-    avformat_find_stream_info(m_aSysInFmtCtx, nullptr);
+    // lavfi fills in the stream at open; probing would only read ahead of real time
+    if (syncTestStartNs < 0) avformat_find_stream_info(inFmtCtx, nullptr);
+    // dshow/avfoundation wait on their packet queue without checking the interrupt
+    // callback; poll instead so stop never hangs on a silent device
+    inFmtCtx->flags |= AVFMT_FLAG_NONBLOCK;
     
     int streamIdx = -1;
-    for(int i=0; i < static_cast<int>(m_aSysInFmtCtx->nb_streams); i++) {
-        if(m_aSysInFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+    for(int i=0; i < static_cast<int>(inFmtCtx->nb_streams); i++) {
+        if(inFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
             streamIdx = i; break;
         }
     }
     if (streamIdx < 0) {
-        avformat_close_input(&m_aSysInFmtCtx);
-        m_isSysAudioRunning = false;
+        avformat_close_input(&inFmtCtx);
+        source->setActive(false);
         return;
     }
     
     // 2. Decoder
-    AVCodec *dec = avcodec_find_decoder(m_aSysInFmtCtx->streams[streamIdx]->codecpar->codec_id);
-    m_aSysDecCtx = avcodec_alloc_context3(dec);
-    avcodec_parameters_to_context(m_aSysDecCtx, m_aSysInFmtCtx->streams[streamIdx]->codecpar);
-    if (avcodec_open2(m_aSysDecCtx, dec, nullptr) < 0) {
-        avformat_close_input(&m_aSysInFmtCtx);
-        m_isSysAudioRunning = false;
+    AVCodec *dec = avcodec_find_decoder(inFmtCtx->streams[streamIdx]->codecpar->codec_id);
+    decCtx = avcodec_alloc_context3(dec);
+    avcodec_parameters_to_context(decCtx, inFmtCtx->streams[streamIdx]->codecpar);
+    if (avcodec_open2(decCtx, dec, nullptr) < 0) {
+        avcodec_free_context(&decCtx);
+        avformat_close_input(&inFmtCtx);
+        source->setActive(false);
         return;
     }
     
-    // 3. Resampler
-    m_swrSysCtx = swr_alloc_set_opts(nullptr,
-        AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, 44100,
-        m_aSysDecCtx->channel_layout ? m_aSysDecCtx->channel_layout : av_get_default_channel_layout(m_aSysDecCtx->channels),
-        m_aSysDecCtx->sample_fmt, m_aSysDecCtx->sample_rate,
-        0, nullptr);
-    swr_init(m_swrSysCtx);
+    // 3. The mixer source resamples from the device format
+    if (!source->setInputFormat(decCtx->sample_rate, decCtx->channels, decCtx->sample_fmt, decCtx->channel_layout)) {
+        trace("Err: SysAudio resampler init failed");
+        avcodec_free_context(&decCtx);
+        avformat_close_input(&inFmtCtx);
+        source->setActive(false);
+        return;
+    }
     
     AVPacket pkt;
     av_init_packet(&pkt);
     AVFrame *frame = av_frame_alloc();
+    AVRational sysTimeBase = inFmtCtx->streams[streamIdx]->time_base;
+    MediaClock::DeviceAnchor sysAnchor;
+    if (syncTestStartNs >= 0) sysAnchor.offsetNs = syncTestStartNs; // Stamp the tone where it was generated
     
     while (m_isSysAudioRunning) {
         av_init_packet(&pkt); pkt.data = nullptr; pkt.size = 0;
-        if (av_read_frame(m_aSysInFmtCtx, &pkt) >= 0) {
+        if (av_read_frame(inFmtCtx, &pkt) >= 0) {
+            int64_t acquiredNs = m_clock.nowNs();
             if (pkt.stream_index == streamIdx) {
-                if (avcodec_send_packet(m_aSysDecCtx, &pkt) == 0) {
-                    while (avcodec_receive_frame(m_aSysDecCtx, frame) == 0) {
-                         int out_samples = av_rescale_rnd(swr_get_delay(m_swrSysCtx, m_aSysDecCtx->sample_rate) + frame->nb_samples, 44100, m_aSysDecCtx->sample_rate, AV_ROUND_UP);
-                         int out_size = out_samples * 2 * 2; 
-                         
-                         uint8_t *buf = (uint8_t*)av_malloc(out_size);
-                         uint8_t *out[1] = { buf };
-                         
-                         int len = swr_convert(m_swrSysCtx, out, out_samples, (const uint8_t**)frame->data, frame->nb_samples);
-                         if (len > 0) {
-                             m_bufSys.write(buf, len * 2 * 2);
-                             // trace(QString("SysAudio: Wrote %1 bytes").arg(len*4)); 
-                         }
-                         av_free(buf);
+                if (avcodec_send_packet(decCtx, &pkt) == 0) {
+                    while (avcodec_receive_frame(decCtx, frame) == 0) {
+                         // Clock time of the first sample: device pts mapped onto the clock
+                         int64_t frameNs = MediaClock::fromStreamTs(frame->nb_samples, AVRational{1, decCtx->sample_rate});
+                         int64_t tsNs = m_clock.mapDeviceTs(sysAnchor, frame->best_effort_timestamp, sysTimeBase, acquiredNs - frameNs);
+                         source->write(frame->extended_data, frame->nb_samples, qMax<int64_t>(tsNs, 0));
                     }
                 }
             }
@@ -912,8 +1931,7 @@ void RecorderController::sysAudioThreadFunc() {
     }
     
     av_frame_free(&frame);
-    if (m_aSysDecCtx) { avcodec_free_context(&m_aSysDecCtx); m_aSysDecCtx = nullptr; }
-    if (m_swrSysCtx) { swr_free(&m_swrSysCtx); m_swrSysCtx = nullptr; }
-    if (m_aSysInFmtCtx) { avformat_close_input(&m_aSysInFmtCtx); m_aSysInFmtCtx = nullptr; }
-    trace("SysAudio Thread Exit");
+    if (decCtx) avcodec_free_context(&decCtx);
+    if (inFmtCtx) avformat_close_input(&inFmtCtx);
+    trace("SysAudio Thread Exit: " + source->name());
 }
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include "RecordingIndex.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <cmath>
+#include <algorithm>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+
+const quint32 kMagic = 0x4952534D; // "MSRI"
+const quint16 kVersion = 1;
+
+void writeRational(QDataStream &out, AVRational q) {
+    out << (qint32)q.num << (qint32)q.den;
+}
+
+AVRational readRational(QDataStream &in) {
+    qint32 num = 0, den = 1;
+    in >> num >> den;
+    return AVRational{ num, den > 0 ? den : 1 };
+}
+
+} // namespace
+
+QString RecordingIndex::pathFor(const QString &mediaFile) {
+    return mediaFile + ".msrindex";
+}
+
+void RecordingIndex::clear() {
+    m_valid = false;
+    m_timeBase = {1, 90000};
+    m_encoder = EncoderParams();
+    m_keyframes.clear();
+    m_framePts.clear();
+    m_markers.clear();
+    m_peaks.clear();
+    m_peakMax = 0.0f;
+    m_peakFill = 0;
+}
+
+void RecordingIndex::setEncoder(const AVCodecContext *video, const AVCodecContext *audio, bool sceneCut) {
+    if (video) {
+        m_timeBase = video->time_base;
+        m_encoder.videoCodec = avcodec_get_name(video->codec_id);
+        m_encoder.width = video->width;
+        m_encoder.height = video->height;
+        m_encoder.pixFmt = av_get_pix_fmt_name(video->pix_fmt);
+        m_encoder.frameRate = video->framerate;
+        m_encoder.gopSize = video->gop_size;
+        m_encoder.bitRate = video->bit_rate;
+        m_encoder.sceneCut = sceneCut;
+    }
+    if (audio) {
+        m_encoder.audioCodec = avcodec_get_name(audio->codec_id);
+        m_encoder.sampleRate = audio->sample_rate;
+        m_encoder.channels = audio->channels;
+        m_encoder.audioBitRate = audio->bit_rate;
+    }
+}
+
+void RecordingIndex::addFrame(int64_t pts) {
+    m_framePts.append(pts);
+}
+
+void RecordingIndex::addPacket(const AVPacket *pkt) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY) || pkt->pts == AV_NOPTS_VALUE) return;
+    Keyframe key;
+    key.pts = pkt->pts;
+    m_keyframes.append(key);
+}
+
+void RecordingIndex::addAudio(const float *const *planes, int channels, int samples) {
+    for (int i = 0; i < samples; i++) {
+        for (int c = 0; c < channels; c++) m_peakMax = std::max(m_peakMax, std::fabs(planes[c][i]));
+        if (++m_peakFill == kPeakSamples) {
+            m_peaks.append((quint8)std::lround(std::min(m_peakMax, 1.0f) * 255.0f));
+            m_peakMax = 0.0f;
+            m_peakFill = 0;
+        }
+    }
+}
+
+void RecordingIndex::setMarkers(const std::vector<int64_t> &pts) {
+    m_markers.clear();
+    for (int64_t value : pts) m_markers.append(value);
+}
+
+bool RecordingIndex::resolveOffsets(const QString &mediaFile) {
+    // The muxer decides where samples land; its sample table says where they went
+    AVFormatContext *fmtCtx = nullptr;
+    if (avformat_open_input(&fmtCtx, mediaFile.toUtf8().constData(), nullptr, nullptr) < 0) return false;
+    int vIdx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    QVector<int64_t> offsets;
+    if (vIdx >= 0) {
+        AVStream *st = fmtCtx->streams[vIdx];
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        int count = avformat_index_get_entries_count(st);
+        for (int i = 0; i < count; i++) {
+            const AVIndexEntry *entry = avformat_index_get_entry(st, i);
+            if (entry->flags & AVINDEX_KEYFRAME) offsets.append(entry->pos);
+        }
+#else
+        for (int i = 0; i < st->nb_index_entries; i++) {
+            if (st->index_entries[i].flags & AVINDEX_KEYFRAME) offsets.append(st->index_entries[i].pos);
+        }
+#endif
+    }
+    avformat_close_input(&fmtCtx);
+    // Both lists are in decode order; anything but a one-to-one match leaves offsets unknown
+    if (offsets.size() != m_keyframes.size()) return false;
+    for (int i = 0; i < offsets.size(); i++) m_keyframes[i].offset = offsets[i];
+    return true;
+}
+
+bool RecordingIndex::save(const QString &mediaFile) {
+    if (m_framePts.isEmpty()) return false;
+    if (m_peakFill > 0) {
+        m_peaks.append((quint8)std::lround(std::min(m_peakMax, 1.0f) * 255.0f));
+        m_peakMax = 0.0f;
+        m_peakFill = 0;
+    }
+    resolveOffsets(mediaFile);
+
+    QSaveFile file(pathFor(mediaFile));
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << kMagic << kVersion;
+    out << (qint64)QFileInfo(mediaFile).size(); // Ties the sidecar to this version of the file
+    writeRational(out, m_timeBase);
+
+    out << m_encoder.videoCodec << (qint32)m_encoder.width << (qint32)m_encoder.height << m_encoder.pixFmt;
+    writeRational(out, m_encoder.frameRate);
+    out << (qint32)m_encoder.gopSize << (qint64)m_encoder.bitRate << m_encoder.sceneCut;
+    out << m_encoder.audioCodec << (qint32)m_encoder.sampleRate << (qint32)m_encoder.channels
+        << (qint64)m_encoder.audioBitRate;
+
+    out << (quint32)m_keyframes.size();
+    for (const Keyframe &key : m_keyframes) out << (qint64)key.pts << (qint64)key.offset;
+
+    // Frame times as deltas: one frame interval fits 32 bits in any time base we use
+    out << (quint32)m_framePts.size() << (qint64)m_framePts.first();
+    for (int i = 1; i < m_framePts.size(); i++) out << (qint32)(m_framePts[i] - m_framePts[i - 1]);
+
+    out << (quint32)m_markers.size();
+    for (int64_t pts : m_markers) out << (qint64)pts;
+
+    out << (quint32)m_peaks.size();
+    out.writeRawData((const char*)m_peaks.constData(), m_peaks.size());
+
+    if (out.status() != QDataStream::Ok || !file.commit()) return false;
+    m_valid = true;
+    return true;
+}
+
+bool RecordingIndex::load(const QString &mediaFile) {
+    clear();
+    QFile file(pathFor(mediaFile));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint64 fileSize = -1;
+    in >> magic >> version >> fileSize;
+    // A trimmed or re-encoded file under the same name has a different size
+    if (magic != kMagic || version != kVersion || fileSize != QFileInfo(mediaFile).size()) return false;
+    m_timeBase = readRational(in);
+
+    qint32 width = 0, height = 0, gop = 0, sampleRate = 0, channels = 0;
+    qint64 bitRate = 0, audioBitRate = 0;
+    in >> m_encoder.videoCodec >> width >> height >> m_encoder.pixFmt;
+    m_encoder.frameRate = readRational(in);
+    in >> gop >> bitRate >> m_encoder.sceneCut;
+    in >> m_encoder.audioCodec >> sampleRate >> channels >> audioBitRate;
+    m_encoder.width = width;
+    m_encoder.height = height;
+    m_encoder.gopSize = gop;
+    m_encoder.bitRate = bitRate;
+    m_encoder.sampleRate = sampleRate;
+    m_encoder.channels = channels;
+    m_encoder.audioBitRate = audioBitRate;
+
+    // Counts are checked against what is left so a damaged file can't ask for gigabytes
+    auto countOk = [&](quint32 count, qint64 bytesEach) {
+        return in.status() == QDataStream::Ok && (qint64)count * bytesEach <= file.bytesAvailable();
+    };
+    quint32 count = 0;
+    in >> count;
+    if (!countOk(count, 16)) { clear(); return false; }
+    m_keyframes.resize(count);
+    for (Keyframe &key : m_keyframes) {
+        qint64 pts = 0, offset = -1;
+        in >> pts >> offset;
+        key.pts = pts;
+        key.offset = offset;
+    }
+
+    qint64 pts = 0;
+    in >> count >> pts;
+    if (count == 0 || !countOk(count - 1, 4)) { clear(); return false; }
+    m_framePts.resize(count);
+    m_framePts[0] = pts;
+    for (quint32 i = 1; i < count; i++) {
+        qint32 delta = 0;
+        in >> delta;
+        pts += delta;
+        m_framePts[i] = pts;
+    }
+
+    in >> count;
+    if (!countOk(count, 8)) { clear(); return false; }
+    m_markers.resize(count);
+    for (int64_t &marker : m_markers) {
+        qint64 value = 0;
+        in >> value;
+        marker = value;
+    }
+
+    in >> count;
+    if (!countOk(count, 1)) { clear(); return false; }
+    m_peaks.resize(count);
+    in.readRawData((char*)m_peaks.data(), count);
+
+    if (in.status() != QDataStream::Ok) { clear(); return false; }
+    m_valid = true;
+    return true;
+}
+
+double RecordingIndex::peakIntervalMs() const {
+    return m_encoder.sampleRate > 0 ? kPeakSamples * 1000.0 / m_encoder.sampleRate : 0.0;
+}
+
+qint64 RecordingIndex::toMs(int64_t pts) const {
+    return av_rescale_q(pts, m_timeBase, AVRational{1, 1000});
+}
+
+qint64 RecordingIndex::durationMs() const {
+    if (m_framePts.isEmpty()) return 0;
+    // The last frame is shown for one frame interval
+    int64_t frameDuration = m_encoder.frameRate.num > 0 ? av_rescale_q(1, av_inv_q(m_encoder.frameRate), m_timeBase) : 0;
+    return toMs(m_framePts.last() - m_framePts.first() + frameDuration);
+}
+
+QList<qint64> RecordingIndex::markersMs() const {
+    QList<qint64> markers;
+    for (int64_t pts : m_markers) markers.append(toMs(pts));
+    return markers;
+}
+
+int64_t RecordingIndex::keyframePtsAtOrBefore(qint64 ms) const {
+    int64_t target = av_rescale_q(ms, AVRational{1, 1000}, m_timeBase);
+    auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), target,
+                               [](int64_t pts, const Keyframe &key) { return pts < key.pts; });
+    if (it == m_keyframes.begin()) return m_keyframes.isEmpty() ? AV_NOPTS_VALUE : m_keyframes.first().pts;
+    return (it - 1)->pts;
+}
+
+int64_t RecordingIndex::keyframePtsAtOrAfter(qint64 ms) const {
+    int64_t target = av_rescale_q(ms, AVRational{1, 1000}, m_timeBase);
+    auto it = std::lower_bound(m_keyframes.begin(), m_keyframes.end(), target,
+                               [](const Keyframe &key, int64_t pts) { return key.pts < pts; });
+    return it == m_keyframes.end() ? AV_NOPTS_VALUE : it->pts;
+}
+
+qint64 RecordingIndex::keyframeAtOrBefore(qint64 ms) const {
+    int64_t pts = keyframePtsAtOrBefore(ms);
+    return pts == AV_NOPTS_VALUE ? -1 : toMs(pts);
+}
+
+qint64 RecordingIndex::keyframeAtOrAfter(qint64 ms) const {
+    int64_t pts = keyframePtsAtOrAfter(ms);
+    return pts == AV_NOPTS_VALUE ? -1 : toMs(pts);
+}
@@ -9,6 +9,9 @@
 #include <dwmapi.h>
 #pragma comment(lib, "dwmapi.lib")
 #endif
+#ifdef MSR_X11_DAMAGE
+#include "X11DamageGrabber.h"
+#endif
 
 // ================== RecordingToolbar Implementation ==================
 
@@ -163,6 +166,7 @@ SelectionOverlay::SelectionOverlay(QWidget *parent)
       m_showToolbar(false),
       m_isRecording(false),
       m_durationText("00:00"),
+      m_selectedWindow(0),
       m_toolbar(nullptr),
       m_countdownEnabled(true),
       m_countdownSecs(3),
@@ -256,6 +260,7 @@ void SelectionOverlay::stopRecording() {
     m_showToolbar = false;
     m_selection = QRect();
     m_hoveredWindow = QRect();
+    m_selectedWindow = 0;
     m_countdownTimer->stop();
     
     // 恢复鼠标事件
@@ -281,6 +286,7 @@ void SelectionOverlay::showEvent(QShowEvent *event) {
     QWidget::showEvent(event);
     detectWindows();
     m_selection = QRect();
+    m_selectedWindow = 0;
     m_showToolbar = false;
     m_isRecording = false;
     m_isCountingDown = false;
@@ -309,12 +315,12 @@ void SelectionOverlay::hideEvent(QHideEvent *event) {
 void SelectionOverlay::detectWindows() {
     m_windows.clear();
     
+#ifdef Q_OS_WIN
     HWND selfHwnd = nullptr;
     if (QWindow *w = windowHandle()) {
         selfHwnd = (HWND)w->winId();
     }
     
-#ifdef Q_OS_WIN
     struct EnumData {
         QList<SelectionOverlay::WindowInfo> *windows;
         HWND selfHwnd;
@@ -354,6 +360,16 @@ void SelectionOverlay::detectWindows() {
         }
         return TRUE;
     }, reinterpret_cast<LPARAM>(&data));
+#elif defined(MSR_X11_DAMAGE)
+    quintptr self = windowHandle() ? (quintptr)windowHandle()->winId() : 0;
+    for (const X11DamageGrabber::WindowEntry &entry : X11DamageGrabber::listWindows()) {
+        if (entry.id == self || entry.rect.width() <= 50 || entry.rect.height() <= 50) continue;
+        WindowInfo info;
+        info.hwnd = entry.id;
+        info.rect = entry.rect;
+        info.title = entry.title;
+        m_windows.append(info);
+    }
 #endif
 }
 
@@ -371,6 +387,15 @@ QRect SelectionOverlay::getWindowAtPoint(const QPoint &pos) {
     return QGuiApplication::primaryScreen()->geometry();
 }
 
+quintptr SelectionOverlay::getWindowIdAtPoint(const QPoint &pos) const {
+    for (const WindowInfo &info : m_windows) {
+        if (info.rect.contains(pos)) {
+            return info.hwnd;
+        }
+    }
+    return 0; // Whole screen
+}
+
 void SelectionOverlay::animateCountdownNumber() {
     m_scaleAnim->stop();
     m_scaleAnim->setDuration(300);
@@ -574,6 +599,7 @@ void SelectionOverlay::mousePressEvent(QMouseEvent *event) {
         // 预框选状态下左键确认
         if (!m_showToolbar) {
             m_selection = m_hoveredWindow;
+            m_selectedWindow = getWindowIdAtPoint(pos);
             if (!m_selection.isNull()) {
                 m_showToolbar = true;
                 
@@ -38,11 +38,11 @@ static QIcon createIcon(const QIcon &source, const QColor &color) {
 }
 
 SettingsDialog::SettingsDialog(QWidget *parent) : QDialog(parent), m_isDragging(false),
-    m_hotkeyShowWindow(nullptr), m_hotkeyStartRecord(nullptr) {
+    m_hotkeyShowWindow(nullptr), m_hotkeyStartRecord(nullptr), m_hotkeyAddMarker(nullptr) {
     setObjectName("SettingsDialog");
     setWindowFlags(Qt::FramelessWindowHint | Qt::Dialog | Qt::Window);
     setAttribute(Qt::WA_TranslucentBackground);
-    setFixedSize(470, 500); // 增加高度以容纳快捷键设置
+    setFixedSize(470, 920); // 增加高度以容纳快捷键设置
     
     QSettings s("KSO", "MScreenRecord");
     QString theme = s.value("theme", "dark").toString().toLower().trimmed();
@@ -171,6 +171,101 @@ SettingsDialog::SettingsDialog(QWidget *parent) : QDialog(parent), m_isDragging(
     bitrateLayout->addStretch();
     mainLayout->addLayout(bitrateLayout);
 
+    // 视频编码
+    QHBoxLayout *codecLayout = new QHBoxLayout();
+    m_comboVideoCodec = new QComboBox(container);
+    m_comboVideoCodec->addItem("H.264 (兼容性最好)", "h264");
+    m_comboVideoCodec->addItem("HEVC / H.265 (文件更小，CPU 占用更高)", "hevc");
+    m_comboVideoCodec->addItem("AV1 (文件最小，CPU 占用最高)", "av1");
+    codecLayout->addWidget(new QLabel("视频编码:", container));
+    codecLayout->addWidget(m_comboVideoCodec);
+    codecLayout->addStretch();
+    mainLayout->addLayout(codecLayout);
+
+    // 屏幕内容模式 (4:4:4)
+    m_chkScreenContent = new QCheckBox("屏幕内容模式 (4:4:4，文字更清晰，CPU 占用更高)", container);
+    mainLayout->addWidget(m_chkScreenContent);
+
+    // 跟随窗口
+    m_chkFollowWindow = new QCheckBox("选中窗口时跟随窗口移动和缩放", container);
+    mainLayout->addWidget(m_chkFollowWindow);
+
+    // 跟随鼠标视窗
+    QHBoxLayout *viewportLayout = new QHBoxLayout();
+    m_chkViewport = new QCheckBox("只录制鼠标周围区域:", container);
+    m_comboViewport = new QComboBox(container);
+    m_comboViewport->addItems({"1280x720", "1920x1080", "960x540"});
+    viewportLayout->addWidget(m_chkViewport);
+    viewportLayout->addWidget(m_comboViewport);
+    viewportLayout->addStretch();
+    mainLayout->addLayout(viewportLayout);
+    connect(m_chkViewport, &QCheckBox::toggled, m_comboViewport, &QComboBox::setEnabled);
+
+    // 延时摄影
+    QHBoxLayout *timelapseLayout = new QHBoxLayout();
+    m_chkTimelapse = new QCheckBox("延时摄影 (不录音)，每", container);
+    m_spinTimelapseSecs = new QSpinBox(container);
+    m_spinTimelapseSecs->setRange(1, 10);
+    m_spinTimelapseSecs->setSuffix(" 秒一帧");
+    timelapseLayout->addWidget(m_chkTimelapse);
+    timelapseLayout->addWidget(m_spinTimelapseSecs);
+    timelapseLayout->addStretch();
+    mainLayout->addLayout(timelapseLayout);
+
+    // 麦克风监听
+    m_chkMicMonitor = new QCheckBox("录制时监听麦克风 (建议佩戴耳机)", container);
+    mainLayout->addWidget(m_chkMicMonitor);
+
+    // 预览代理文件
+    m_chkProxyFile = new QCheckBox("同时生成低分辨率预览文件 (加快大分辨率录像的预览和拖动)", container);
+    mainLayout->addWidget(m_chkProxyFile);
+
+    // 场景切换关键帧
+    m_chkSceneCut = new QCheckBox("画面切换时插入关键帧 (方便定位和剪切，文件略大)", container);
+    mainLayout->addWidget(m_chkSceneCut);
+
+    // 画中画
+    QHBoxLayout *pipLayout = new QHBoxLayout();
+    m_chkPip = new QCheckBox("画中画:", container);
+    m_editPipSource = new QLineEdit(container);
+    m_editPipSource->setPlaceholderText("dshow:video=摄像头名称");
+    m_comboPipCorner = new QComboBox(container);
+    m_comboPipCorner->addItems({"右下", "左下", "右上", "左上"}); // PipCompositor::Corner order
+    pipLayout->addWidget(m_chkPip);
+    pipLayout->addWidget(m_editPipSource, 1);
+    pipLayout->addWidget(m_comboPipCorner);
+    mainLayout->addLayout(pipLayout);
+    connect(m_chkPip, &QCheckBox::toggled, m_editPipSource, &QLineEdit::setEnabled);
+    connect(m_chkPip, &QCheckBox::toggled, m_comboPipCorner, &QComboBox::setEnabled);
+
+    // 视频滤镜
+    QHBoxLayout *filterLayout = new QHBoxLayout();
+    m_editVideoFilter = new QLineEdit(container);
+    m_editVideoFilter->setPlaceholderText("hqdn3d,scale=1280:-2，留空不处理");
+    filterLayout->addWidget(new QLabel("视频滤镜:", container));
+    filterLayout->addWidget(m_editVideoFilter, 1);
+    mainLayout->addLayout(filterLayout);
+
+    // 同时推流
+    QHBoxLayout *streamLayout = new QHBoxLayout();
+    m_editStreamUrl = new QLineEdit(container);
+    m_editStreamUrl->setPlaceholderText("rtmp://... 或 srt://...，留空不推流");
+    streamLayout->addWidget(new QLabel("同时推流:", container));
+    streamLayout->addWidget(m_editStreamUrl, 1);
+    mainLayout->addLayout(streamLayout);
+
+    // 本机实时预览 (HLS)
+    QHBoxLayout *hlsLayout = new QHBoxLayout();
+    m_chkHlsPreview = new QCheckBox("录制时提供本机实时预览 (HLS)，每段", container);
+    m_spinHlsSegmentSec = new QSpinBox(container);
+    m_spinHlsSegmentSec->setRange(1, 10);
+    m_spinHlsSegmentSec->setSuffix(" 秒");
+    hlsLayout->addWidget(m_chkHlsPreview);
+    hlsLayout->addWidget(m_spinHlsSegmentSec);
+    hlsLayout->addStretch();
+    mainLayout->addLayout(hlsLayout);
+    connect(m_chkHlsPreview, &QCheckBox::toggled, m_spinHlsSegmentSec, &QSpinBox::setEnabled);
+
     // 主题
     QHBoxLayout *themeLayout = new QHBoxLayout();
     m_comboTheme = new QComboBox(container);
@@ -209,11 +304,22 @@ SettingsDialog::SettingsDialog(QWidget *parent) : QDialog(parent), m_isDragging(
     hotkeyLayout2->addWidget(m_hotkeyStartRecord);
     hotkeyLayout2->addStretch();
     mainLayout->addLayout(hotkeyLayout2);
+
+    QHBoxLayout *hotkeyLayout3 = new QHBoxLayout();
+    m_hotkeyAddMarker = new HotkeyEdit(container);
+    m_hotkeyAddMarker->setFixedWidth(180);
+    m_hotkeyAddMarker->setThemeColors(borderColor, textColor, bgColor);
+    hotkeyLayout3->addWidget(new QLabel("录制中添加标记:", container));
+    hotkeyLayout3->addWidget(m_hotkeyAddMarker);
+    hotkeyLayout3->addStretch();
+    mainLayout->addLayout(hotkeyLayout3);
     
     connect(m_hotkeyShowWindow, &HotkeyEdit::keySequenceChanged, 
             this, &SettingsDialog::onShowWindowHotkeyChanged);
     connect(m_hotkeyStartRecord, &HotkeyEdit::keySequenceChanged, 
             this, &SettingsDialog::onStartRecordHotkeyChanged);
+    connect(m_hotkeyAddMarker, &HotkeyEdit::keySequenceChanged,
+            this, &SettingsDialog::onAddMarkerHotkeyChanged);
 
     // 倒计时设置
     QHBoxLayout *countLayout = new QHBoxLayout();
@@ -354,6 +460,29 @@ void SettingsDialog::loadSettings() {
     m_editPath->setText(settings.value("savePath", QStandardPaths::writableLocation(QStandardPaths::MoviesLocation)).toString());
     m_spinFps->setValue(settings.value("fps", 30).toInt());
     m_comboBitrate->setCurrentIndex(settings.value("bitrateLevel", 1).toInt());
+    m_chkScreenContent->setChecked(settings.value("screenContent444", false).toBool());
+    int codecIdx = m_comboVideoCodec->findData(settings.value("videoCodec", "h264").toString());
+    m_comboVideoCodec->setCurrentIndex(codecIdx >= 0 ? codecIdx : 0);
+    m_chkFollowWindow->setChecked(settings.value("followWindow", true).toBool());
+    m_chkViewport->setChecked(settings.value("viewportMode", false).toBool());
+    m_comboViewport->setEnabled(m_chkViewport->isChecked());
+    int viewportIdx = m_comboViewport->findText(settings.value("viewportSize", "1280x720").toString());
+    if (viewportIdx >= 0) m_comboViewport->setCurrentIndex(viewportIdx);
+    m_chkTimelapse->setChecked(settings.value("timelapseMode", false).toBool());
+    m_chkMicMonitor->setChecked(settings.value("micMonitor", false).toBool());
+    m_chkProxyFile->setChecked(settings.value("proxyFile", true).toBool());
+    m_chkSceneCut->setChecked(settings.value("sceneCutKeyframes", false).toBool());
+    m_editStreamUrl->setText(settings.value("streamUrl").toString());
+    m_chkPip->setChecked(settings.value("pipEnabled", false).toBool());
+    m_editPipSource->setText(settings.value("pipSource").toString());
+    m_comboPipCorner->setCurrentIndex(qBound(0, settings.value("pipCorner", 0).toInt(), 3));
+    m_editPipSource->setEnabled(m_chkPip->isChecked());
+    m_comboPipCorner->setEnabled(m_chkPip->isChecked());
+    m_editVideoFilter->setText(settings.value("videoFilter").toString());
+    m_chkHlsPreview->setChecked(settings.value("hlsPreview", false).toBool());
+    m_spinHlsSegmentSec->setValue(settings.value("hlsSegmentSec", 2).toInt());
+    m_spinHlsSegmentSec->setEnabled(m_chkHlsPreview->isChecked());
+    m_spinTimelapseSecs->setValue(settings.value("timelapseInterval", 2).toInt());
     m_chkMinimizeToTray->setChecked(settings.value("minimizeToTray", true).toBool());
     
     m_chkCountdown->setChecked(settings.value("countdownEnabled", true).toBool());
@@ -366,6 +495,7 @@ void SettingsDialog::loadSettings() {
     // 加载快捷键设置
     QString showWindowKey = settings.value("hotkeyShowWindow", "Ctrl+Alt+S").toString();
     QString startRecordKey = settings.value("hotkeyStartRecord", "Ctrl+Alt+O").toString();
+    QString addMarkerKey = settings.value("hotkeyAddMarker", "Ctrl+Alt+M").toString();
     
     if (!showWindowKey.isEmpty()) {
         m_hotkeyShowWindow->setKeySequence(QKeySequence(showWindowKey));
@@ -373,6 +503,9 @@ void SettingsDialog::loadSettings() {
     if (!startRecordKey.isEmpty()) {
         m_hotkeyStartRecord->setKeySequence(QKeySequence(startRecordKey));
     }
+    if (!addMarkerKey.isEmpty()) {
+        m_hotkeyAddMarker->setKeySequence(QKeySequence(addMarkerKey));
+    }
 }
 
 void SettingsDialog::saveSettings() {
@@ -380,6 +513,23 @@ void SettingsDialog::saveSettings() {
     settings.setValue("savePath", m_editPath->text());
     settings.setValue("fps", m_spinFps->value());
     settings.setValue("bitrateLevel", m_comboBitrate->currentIndex());
+    settings.setValue("screenContent444", m_chkScreenContent->isChecked());
+    settings.setValue("videoCodec", m_comboVideoCodec->currentData().toString());
+    settings.setValue("followWindow", m_chkFollowWindow->isChecked());
+    settings.setValue("viewportMode", m_chkViewport->isChecked());
+    settings.setValue("viewportSize", m_comboViewport->currentText());
+    settings.setValue("timelapseMode", m_chkTimelapse->isChecked());
+    settings.setValue("micMonitor", m_chkMicMonitor->isChecked());
+    settings.setValue("proxyFile", m_chkProxyFile->isChecked());
+    settings.setValue("sceneCutKeyframes", m_chkSceneCut->isChecked());
+    settings.setValue("streamUrl", m_editStreamUrl->text().trimmed());
+    settings.setValue("pipEnabled", m_chkPip->isChecked());
+    settings.setValue("pipSource", m_editPipSource->text().trimmed());
+    settings.setValue("pipCorner", m_comboPipCorner->currentIndex());
+    settings.setValue("videoFilter", m_editVideoFilter->text().trimmed());
+    settings.setValue("hlsPreview", m_chkHlsPreview->isChecked());
+    settings.setValue("hlsSegmentSec", m_spinHlsSegmentSec->value());
+    settings.setValue("timelapseInterval", m_spinTimelapseSecs->value());
     settings.setValue("minimizeToTray", m_chkMinimizeToTray->isChecked());
     settings.setValue("theme", m_comboTheme->currentData().toString());
     
@@ -389,6 +539,7 @@ void SettingsDialog::saveSettings() {
     // 保存快捷键设置
     settings.setValue("hotkeyShowWindow", m_hotkeyShowWindow->keySequence().toString());
     settings.setValue("hotkeyStartRecord", m_hotkeyStartRecord->keySequence().toString());
+    settings.setValue("hotkeyAddMarker", m_hotkeyAddMarker->keySequence().toString());
     
     emit hotkeyChanged();
 }
@@ -418,6 +569,11 @@ QKeySequence SettingsDialog::getStartRecordHotkey() {
     return QKeySequence(settings.value("hotkeyStartRecord", "Ctrl+Alt+R").toString());
 }
 
+QKeySequence SettingsDialog::getAddMarkerHotkey() {
+    QSettings settings("KSO", "MScreenRecord");
+    return QKeySequence(settings.value("hotkeyAddMarker", "Ctrl+Alt+M").toString());
+}
+
 void SettingsDialog::onShowWindowHotkeyChanged(const QKeySequence &seq) {
     if (!seq.isEmpty()) {
         checkHotkeyConflict(seq, m_hotkeyShowWindow);
@@ -430,15 +586,22 @@ void SettingsDialog::onStartRecordHotkeyChanged(const QKeySequence &seq) {
     }
 }
 
+void SettingsDialog::onAddMarkerHotkeyChanged(const QKeySequence &seq) {
+    if (!seq.isEmpty()) {
+        checkHotkeyConflict(seq, m_hotkeyAddMarker);
+    }
+}
+
 bool SettingsDialog::checkHotkeyConflict(const QKeySequence &seq, HotkeyEdit *sourceEdit) {
     if (seq.isEmpty()) return true;
     
-    // 检查是否与另一个快捷键冲突
-    HotkeyEdit *otherEdit = (sourceEdit == m_hotkeyShowWindow) ? m_hotkeyStartRecord : m_hotkeyShowWindow;
-    if (otherEdit && otherEdit->keySequence() == seq) {
-        ToastTip::warning(this, QString("快捷键 \"%1\" 已被其他功能使用").arg(seq.toString(QKeySequence::NativeText)));
-        sourceEdit->clear();
-        return false;
+    // 检查是否与其他快捷键冲突
+    for (HotkeyEdit *otherEdit : { m_hotkeyShowWindow, m_hotkeyStartRecord, m_hotkeyAddMarker }) {
+        if (otherEdit && otherEdit != sourceEdit && otherEdit->keySequence() == seq) {
+            ToastTip::warning(this, QString("快捷键 \"%1\" 已被其他功能使用").arg(seq.toString(QKeySequence::NativeText)));
+            sourceEdit->clear();
+            return false;
+        }
     }
     
     // 检查系统级别冲突
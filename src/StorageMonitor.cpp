@@ -0,0 +1,79 @@
+#include "StorageMonitor.h"
+#include <QStorageInfo>
+#include <QFileInfo>
+
+void StorageMonitor::start(const QString &outputPath) {
+    m_path = QFileInfo(outputPath).absolutePath();
+    m_clock.start();
+    m_lastSampleMs = -1;
+    m_lastProduced = 0;
+    m_lastQueued = 0;
+    m_queueGrowth = 0;
+    m_lastReduceMs = -1;
+    m_warned = false;
+    m_last = Sample();
+
+    QStorageInfo volume(m_path);
+    if (volume.isValid()) m_last.freeBytes = volume.bytesAvailable();
+}
+
+qint64 StorageMonitor::reserveBytes() const {
+    // 32 MB headroom plus roughly 8 KB of sample tables per recorded second
+    qint64 elapsedSec = m_clock.isValid() ? m_clock.elapsed() / 1000 : 0;
+    return 32LL * 1024 * 1024 + elapsedSec * 8 * 1024;
+}
+
+StorageMonitor::Action StorageMonitor::update(const AsyncFileWriter::Stats &io) {
+    qint64 now = m_clock.elapsed();
+    if (m_lastSampleMs >= 0 && now - m_lastSampleMs < SAMPLE_INTERVAL_MS) return None;
+
+    qint64 produced = io.bytesWritten + io.bytesQueued;
+    if (m_lastSampleMs < 0) {
+        m_lastSampleMs = now;
+        m_lastProduced = produced;
+        m_lastQueued = io.bytesQueued;
+        return None;
+    }
+
+    // Live output rate, smoothed so keyframes and bursts don't swing the estimate
+    double dtSec = (now - m_lastSampleMs) / 1000.0;
+    double instMBps = (produced - m_lastProduced) / (1024.0 * 1024.0) / dtSec;
+    m_last.outputMBps = (m_last.outputMBps <= 0.0) ? instMBps : m_last.outputMBps * 0.8 + instMBps * 0.2;
+    m_last.writeMBps = io.writeMBps;
+
+    QStorageInfo volume(m_path);
+    m_last.freeBytes = volume.isValid() ? volume.bytesAvailable() : -1;
+
+    // Queued bytes are not on disk yet but will be
+    qint64 usable = (m_last.freeBytes >= 0) ? m_last.freeBytes - io.bytesQueued - reserveBytes() : -1;
+    if (usable >= 0 && m_last.outputMBps > 0.0) {
+        m_last.remainingSec = (qint64)(usable / (m_last.outputMBps * 1024.0 * 1024.0));
+    } else {
+        m_last.remainingSec = (usable < 0 && m_last.freeBytes >= 0) ? 0 : -1;
+    }
+
+    // A write queue that keeps growing means the volume can't sustain the bitrate
+    if (io.bytesQueued > m_lastQueued && io.bytesQueued > 8LL * 1024 * 1024) m_queueGrowth++;
+    else m_queueGrowth = 0;
+
+    m_lastSampleMs = now;
+    m_lastProduced = produced;
+    m_lastQueued = io.bytesQueued;
+
+    if (m_last.freeBytes >= 0 && usable <= 0) return Finalize;
+
+    bool cooldownOver = (m_lastReduceMs < 0 || now - m_lastReduceMs > REDUCE_COOLDOWN_MS);
+    bool lowSpace = (m_last.remainingSec >= 0 && m_last.remainingSec < REDUCE_REMAINING_SEC);
+    bool slowVolume = (m_queueGrowth >= 5);
+    if ((lowSpace || slowVolume) && cooldownOver) {
+        m_lastReduceMs = now;
+        m_queueGrowth = 0;
+        return ReduceBitrate;
+    }
+
+    if (!m_warned && m_last.remainingSec >= 0 && m_last.remainingSec < WARN_REMAINING_SEC) {
+        m_warned = true;
+        return Warn;
+    }
+    return None;
+}
@@ -0,0 +1,235 @@
+#include "SyncAnalyzer.h"
+#include <QStringList>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+// Luma is measured on a thumbnail; the pattern is a uniform black or white frame
+const int kThumbW = 32;
+const int kThumbH = 18;
+const int kFlashLuma = 128;     // Gray8 full range: black ~0, white ~255
+const float kBeepLevel = 0.1f;  // Tone peaks at 0.5; AAC pre-echo stays well below this
+
+bool openDecoder(AVFormatContext *fmtCtx, int streamIdx, AVCodecContext **decCtx) {
+    const AVCodec *dec = avcodec_find_decoder(fmtCtx->streams[streamIdx]->codecpar->codec_id);
+    if (!dec) return false;
+    *decCtx = avcodec_alloc_context3(dec);
+    avcodec_parameters_to_context(*decCtx, fmtCtx->streams[streamIdx]->codecpar);
+    if (avcodec_open2(*decCtx, dec, nullptr) < 0) {
+        avcodec_free_context(decCtx);
+        return false;
+    }
+    return true;
+}
+
+double frameTimeSec(const AVFrame *frame, AVRational tb) {
+    int64_t ts = frame->best_effort_timestamp;
+    return ts == AV_NOPTS_VALUE ? -1.0 : ts * av_q2d(tb);
+}
+
+} // namespace
+
+QString SyncAnalyzer::videoGraph(int width, int height, int fps, double phaseSec) {
+    // Frames sit on a 1/fps grid; half a frame of slack keeps the frame exactly on a
+    // marker from falling out of the window through rounding
+    QString enable = QString("lt(mod(t+%1,%2),%3)")
+            .arg(phaseSec + 0.5 / fps, 0, 'f', 9)
+            .arg(kMarkerPeriodMs / 1000.0, 0, 'f', 3)
+            .arg(kMarkerWidthMs / 1000.0, 0, 'f', 3);
+    return QString("color=c=black:s=%1x%2:r=%3,format=yuv420p,drawbox=c=white:t=fill:enable='%4',realtime")
+            .arg(width).arg(height).arg(fps).arg(enable);
+}
+
+QString SyncAnalyzer::audioGraph(int sampleRate, double phaseSec) {
+    // Sample-accurate tone bursts, delivered in 10 ms blocks at the real-time pace
+    QString expr = QString("if(lt(mod(t+%1,%2),%3),0.5*sin(2*PI*1000*t),0)")
+            .arg(phaseSec, 0, 'f', 9)
+            .arg(kMarkerPeriodMs / 1000.0, 0, 'f', 3)
+            .arg(kMarkerWidthMs / 1000.0, 0, 'f', 3);
+    return QString("aevalsrc=exprs='%1':s=%2:c=stereo:n=%3,arealtime")
+            .arg(expr).arg(sampleRate).arg(sampleRate / 100);
+}
+
+double SyncAnalyzer::markerPhase(int64_t clockNs) {
+    const int64_t periodNs = (int64_t)kMarkerPeriodMs * 1000000LL;
+    return (clockNs % periodNs) / 1e9;
+}
+
+SyncAnalyzer::Report SyncAnalyzer::analyze(const QString &file) {
+    Report report;
+    AVFormatContext *fmtCtx = nullptr;
+    if (avformat_open_input(&fmtCtx, file.toUtf8().constData(), nullptr, nullptr) < 0) {
+        report.error = "cannot open " + file;
+        return report;
+    }
+    avformat_find_stream_info(fmtCtx, nullptr);
+    int vIdx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    int aIdx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    AVCodecContext *vDec = nullptr;
+    AVCodecContext *aDec = nullptr;
+    if (vIdx < 0 || aIdx < 0 || !openDecoder(fmtCtx, vIdx, &vDec) || !openDecoder(fmtCtx, aIdx, &aDec)) {
+        report.error = "file needs a decodable video and audio stream";
+        avcodec_free_context(&vDec);
+        avformat_close_input(&fmtCtx);
+        return report;
+    }
+    AVRational vTb = fmtCtx->streams[vIdx]->time_base;
+    AVRational aTb = fmtCtx->streams[aIdx]->time_base;
+    if (fmtCtx->duration != AV_NOPTS_VALUE) report.durationSec = fmtCtx->duration / (double)AV_TIME_BASE;
+
+    // Audio is folded to mono float at its own rate, so sample times stay exact
+    uint64_t inLayout = aDec->channel_layout ? aDec->channel_layout : av_get_default_channel_layout(aDec->channels);
+    SwrContext *swr = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_FLT, aDec->sample_rate,
+                                         inLayout, aDec->sample_fmt, aDec->sample_rate, 0, nullptr);
+    if (!swr || swr_init(swr) < 0) {
+        report.error = "audio conversion failed";
+        swr_free(&swr);
+        avcodec_free_context(&vDec);
+        avcodec_free_context(&aDec);
+        avformat_close_input(&fmtCtx);
+        return report;
+    }
+
+    SwsContext *sws = nullptr;
+    alignas(32) uint8_t thumb[kThumbW * kThumbH];
+    std::vector<float> mono;
+    QVector<double> flashes;
+    QVector<double> beeps;
+    bool lit = false;
+    double lastLoudSec = -1e9;
+    const double quietSec = kMarkerPeriodMs / 1000.0 * 0.3; // Silence that separates two beeps
+
+    AVFrame *frame = av_frame_alloc();
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    auto drain = [&](AVCodecContext *dec, bool video) {
+        while (avcodec_receive_frame(dec, frame) == 0) {
+            if (video) {
+                double t = frameTimeSec(frame, vTb);
+                sws = sws_getCachedContext(sws, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                           kThumbW, kThumbH, AV_PIX_FMT_GRAY8, SWS_AREA, nullptr, nullptr, nullptr);
+                if (sws && t >= 0.0) {
+                    uint8_t *dst[4] = { thumb, nullptr, nullptr, nullptr };
+                    int lines[4] = { kThumbW, 0, 0, 0 };
+                    sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst, lines);
+                    int sum = 0;
+                    for (int i = 0; i < kThumbW * kThumbH; i++) sum += thumb[i];
+                    bool nowLit = sum / (kThumbW * kThumbH) >= kFlashLuma;
+                    if (nowLit && !lit) flashes.append(t);
+                    lit = nowLit;
+                }
+            } else {
+                double t = frameTimeSec(frame, aTb);
+                mono.resize(frame->nb_samples + 256);
+                uint8_t *out = (uint8_t*)mono.data();
+                int n = swr_convert(swr, &out, (int)mono.size(), (const uint8_t**)frame->extended_data, frame->nb_samples);
+                for (int i = 0; i < n && t >= 0.0; i++) {
+                    if (std::fabs(mono[i]) < kBeepLevel) continue;
+                    double sampleSec = t + (double)i / aDec->sample_rate;
+                    if (sampleSec - lastLoudSec > quietSec) beeps.append(sampleSec);
+                    lastLoudSec = sampleSec;
+                }
+            }
+        }
+    };
+    while (av_read_frame(fmtCtx, &pkt) >= 0) {
+        if (pkt.stream_index == vIdx && avcodec_send_packet(vDec, &pkt) == 0) drain(vDec, true);
+        else if (pkt.stream_index == aIdx && avcodec_send_packet(aDec, &pkt) == 0) drain(aDec, false);
+        av_packet_unref(&pkt);
+    }
+    avcodec_send_packet(vDec, nullptr);
+    drain(vDec, true);
+    avcodec_send_packet(aDec, nullptr);
+    drain(aDec, false);
+
+    av_frame_free(&frame);
+    sws_freeContext(sws);
+    swr_free(&swr);
+    avcodec_free_context(&vDec);
+    avcodec_free_context(&aDec);
+    avformat_close_input(&fmtCtx);
+
+    // Pair each flash with the nearest beep within half a period
+    report.flashes = flashes.size();
+    report.beeps = beeps.size();
+    const double halfPeriod = kMarkerPeriodMs / 2000.0;
+    int b = 0;
+    for (double f : flashes) {
+        while (b + 1 < beeps.size() && std::fabs(beeps[b + 1] - f) <= std::fabs(beeps[b] - f)) b++;
+        if (b < beeps.size() && std::fabs(beeps[b] - f) < halfPeriod) {
+            Marker m;
+            m.timeSec = f;
+            m.offsetMs = (beeps[b] - f) * 1000.0;
+            report.markers.append(m);
+        }
+    }
+    report.paired = report.markers.size();
+    if (report.paired < 2) {
+        report.error = QString("only %1 markers paired (%2 flashes, %3 beeps)")
+                .arg(report.paired).arg(report.flashes).arg(report.beeps);
+        return report;
+    }
+
+    // Mean / spread, and drift as the least-squares slope of offset over time
+    double sumT = 0, sumO = 0, sumTT = 0, sumTO = 0, sumOO = 0;
+    report.minOffsetMs = report.maxOffsetMs = report.markers.first().offsetMs;
+    for (const Marker &m : report.markers) {
+        sumT += m.timeSec; sumO += m.offsetMs;
+        sumTT += m.timeSec * m.timeSec; sumTO += m.timeSec * m.offsetMs; sumOO += m.offsetMs * m.offsetMs;
+        report.minOffsetMs = qMin(report.minOffsetMs, m.offsetMs);
+        report.maxOffsetMs = qMax(report.maxOffsetMs, m.offsetMs);
+    }
+    double n = report.paired;
+    report.meanOffsetMs = sumO / n;
+    report.stdDevMs = std::sqrt(qMax(0.0, sumOO / n - report.meanOffsetMs * report.meanOffsetMs));
+    double denom = n * sumTT - sumT * sumT;
+    if (denom > 0.0) report.driftMsPerMin = (n * sumTO - sumT * sumO) / denom * 60.0;
+    report.ok = true;
+    return report;
+}
+
+bool SyncAnalyzer::Report::passed() const {
+    // A flash without its beep (or the reverse) means dropped or misplaced media; the
+    // marker cut off at either end of the file is the only one allowed to be unpaired
+    return ok && flashes - paired <= 2 && beeps - paired <= 2
+            && minOffsetMs >= -kMaxLeadMs && maxOffsetMs <= kMaxLagMs;
+}
+
+QString SyncAnalyzer::Report::summary() const {
+    if (!ok) return "A/V sync: " + error;
+    QStringList lines;
+    lines << QString("A/V sync: %1 markers over %2 s (%3 flashes, %4 beeps)")
+             .arg(paired).arg(durationSec, 0, 'f', 1).arg(flashes).arg(beeps);
+    lines << QString("  offset (audio - video): mean %1 ms, min %2 ms, max %3 ms, stddev %4 ms")
+             .arg(meanOffsetMs, 0, 'f', 1).arg(minOffsetMs, 0, 'f', 1)
+             .arg(maxOffsetMs, 0, 'f', 1).arg(stdDevMs, 0, 'f', 1);
+    lines << QString("  drift: %1 ms/min").arg(driftMsPerMin, 0, 'f', 2);
+    // One line per minute so a soak run shows how the offset moves
+    int minute = -1;
+    double sum = 0.0;
+    int count = 0;
+    for (int i = 0; i <= markers.size(); i++) {
+        int m = i < markers.size() ? (int)(markers[i].timeSec / 60.0) : -2;
+        if (m != minute && count > 0) {
+            lines << QString("  minute %1: %2 ms (%3 markers)").arg(minute).arg(sum / count, 0, 'f', 1).arg(count);
+            sum = 0.0;
+            count = 0;
+        }
+        if (i == markers.size()) break;
+        minute = m;
+        sum += markers[i].offsetMs;
+        count++;
+    }
+    lines << QString("  result: %1 (window -%2 / +%3 ms)").arg(passed() ? "PASS" : "FAIL").arg(kMaxLeadMs).arg(kMaxLagMs);
+    return lines.join('\n');
+}
@@ -0,0 +1,100 @@
+#include "VideoEncoderPreset.h"
+#include <QThread>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+VideoEncoderPreset::Codec VideoEncoderPreset::codecFromName(const QString &name) {
+    QString n = name.trimmed().toLower();
+    if (n == "hevc" || n == "h265" || n == "x265") return HEVC;
+    if (n == "av1") return AV1;
+    return H264;
+}
+
+QString VideoEncoderPreset::codecName(Codec codec) {
+    switch (codec) {
+    case HEVC: return "hevc";
+    case AV1: return "av1";
+    default: return "h264";
+    }
+}
+
+const AVCodec *VideoEncoderPreset::findEncoder(Codec codec) {
+    switch (codec) {
+    case HEVC:
+        return avcodec_find_encoder_by_name("libx265");
+    case AV1:
+        // SVT-AV1 is several times faster than libaom at the same size for real-time use
+        if (const AVCodec *enc = avcodec_find_encoder_by_name("libsvtav1")) return enc;
+        return avcodec_find_encoder_by_name("libaom-av1");
+    default:
+        if (const AVCodec *enc = avcodec_find_encoder_by_name("libx264")) return enc;
+        return avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+}
+
+bool VideoEncoderPreset::supportsFormat(const AVCodec *enc, AVPixelFormat fmt) {
+    if (!enc || !enc->pix_fmts) return false;
+    for (const AVPixelFormat *p = enc->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == fmt) return true;
+    }
+    return false;
+}
+
+int64_t VideoEncoderPreset::defaultBitRate(Codec codec) {
+    switch (codec) {
+    case HEVC: return 2000000;
+    case AV1: return 1500000;
+    default: return 3000000;
+    }
+}
+
+bool VideoEncoderPreset::canChangeBitRate(const AVCodec *enc) {
+    return enc && QString(enc->name) == "libx264";
+}
+
+void VideoEncoderPreset::apply(AVCodecContext *ctx, const AVCodec *enc, bool sceneCut) {
+    QString name = enc ? enc->name : "";
+    bool is444 = ctx->pix_fmt == AV_PIX_FMT_YUV444P;
+    if (name == "libx264") {
+        // Encoder default preset, as recordings have always used
+        if (is444) av_opt_set(ctx->priv_data, "profile", "high444", 0);
+        // Marker frames are sent as I frames; make them IDR so the chapter start is a clean seek point
+        av_opt_set(ctx->priv_data, "forced-idr", "1", 0);
+        // x264 detects scene cuts by default, so "off" has to disable it explicitly; "on"
+        // pairs the default threshold with the short keyint_min the caller sets
+        av_opt_set(ctx->priv_data, "x264-params", sceneCut ? "scenecut=40" : "scenecut=0", 0);
+    } else if (name == "libx265") {
+        // x265 runs its own frame / WPP thread pool whatever thread_count says; superfast is
+        // the slowest preset that keeps up with a live capture on ordinary desktops
+        av_opt_set(ctx->priv_data, "preset", "superfast", 0);
+        if (is444) av_opt_set(ctx->priv_data, "profile", "main444-8", 0);
+        av_opt_set(ctx->priv_data, "forced-idr", "1", 0);
+        av_opt_set(ctx->priv_data, "x265-params",
+                   sceneCut ? "log-level=error:scenecut=40" : "log-level=error:scenecut=0", 0);
+    } else if (name == "libsvtav1") {
+        // Preset 10 is the fastest that keeps screen content tools; scm=1 turns them on
+        // (palette, intra block copy) instead of guessing per clip
+        av_opt_set(ctx->priv_data, "preset", "10", 0);
+        av_opt_set(ctx->priv_data, "svtav1-params", sceneCut ? "scm=1:scd=1" : "scm=1:scd=0", 0);
+        // Older wrappers default to constant QP and have no svtav1-params
+        av_opt_set(ctx->priv_data, "rc", "1", 0);
+        av_opt_set(ctx->priv_data, "sc_detection", sceneCut ? "1" : "0", 0);
+    } else if (name == "libaom-av1") {
+        av_opt_set(ctx->priv_data, "usage", "realtime", 0);
+        av_opt_set(ctx->priv_data, "cpu-used", "8", 0);
+        av_opt_set(ctx->priv_data, "tune-content", "screen", 0);
+        av_opt_set(ctx->priv_data, "row-mt", "1", 0);
+        av_opt_set(ctx->priv_data, "tiles", "2x2", 0);
+        // Tile / row threads work inside one frame, so there are no delayed frames to flush
+        ctx->thread_count = qBound(1, QThread::idealThreadCount(), 8);
+    }
+}
+
+unsigned int VideoEncoderPreset::codecTagFor(const AVOutputFormat *fmt, AVCodecID id) {
+    if (!fmt || id != AV_CODEC_ID_HEVC) return 0;
+    QString name = fmt->name;
+    if (name.contains("mp4") || name.contains("mov") || name == "hls") return MKTAG('h', 'v', 'c', '1');
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "VideoFilterGraph.h"
+#include <QThread>
+
+extern "C" {
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+VideoFilterGraph::VideoFilterGraph() {}
+
+VideoFilterGraph::~VideoFilterGraph() {
+    close();
+}
+
+void VideoFilterGraph::close() {
+    avfilter_graph_free(&m_graph);
+    m_src = nullptr;
+    m_sink = nullptr;
+    m_lastPts = INT64_MIN;
+}
+
+bool VideoFilterGraph::init(const QString &filters, int width, int height, AVPixelFormat fmt, AVRational timeBase,
+                            AVRational frameRate, const std::vector<AVPixelFormat> &outFormats, int threads) {
+    close();
+    m_error.clear();
+    m_filters = filters.trimmed();
+    m_timeBase = timeBase;
+    if (m_filters.isEmpty()) { m_error = "empty filter description"; return false; }
+
+    m_graph = avfilter_graph_alloc();
+    if (!m_graph) { m_error = "alloc graph failed"; return false; }
+    m_graph->nb_threads = threads > 0 ? threads : QThread::idealThreadCount();
+    m_graph->thread_type = AVFILTER_THREAD_SLICE;
+
+    QString srcArgs = QString("video_size=%1x%2:pix_fmt=%3:time_base=%4/%5:pixel_aspect=1/1")
+            .arg(width).arg(height).arg((int)fmt).arg(timeBase.num).arg(timeBase.den);
+    if (frameRate.num > 0) srcArgs += QString(":frame_rate=%1/%2").arg(frameRate.num).arg(frameRate.den);
+    int ret = avfilter_graph_create_filter(&m_src, avfilter_get_by_name("buffer"), "in",
+                                           srcArgs.toUtf8().constData(), nullptr, m_graph);
+    if (ret >= 0) ret = avfilter_graph_create_filter(&m_sink, avfilter_get_by_name("buffersink"), "out",
+                                                     nullptr, nullptr, m_graph);
+    if (ret < 0) { m_error = "create buffer filters failed"; close(); return false; }
+    // Whatever the chain does, the encoder gets a format it can take
+    std::vector<AVPixelFormat> formats = outFormats;
+    formats.push_back(AV_PIX_FMT_NONE);
+    av_opt_set_int_list(m_sink, "pix_fmts", formats.data(), AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = m_src;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = m_sink;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+    ret = avfilter_graph_parse_ptr(m_graph, m_filters.toUtf8().constData(), &inputs, &outputs, nullptr);
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret >= 0) ret = avfilter_graph_config(m_graph, nullptr);
+    if (ret < 0) {
+        char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+        av_strerror(ret, err, sizeof(err));
+        m_error = QString("%1 (%2)").arg(m_filters, err);
+        close();
+        return false;
+    }
+    // Encoders want even sizes for 4:2:0
+    if (outWidth() < 2 || outHeight() < 2 ||
+        (outFormat() == AV_PIX_FMT_YUV420P && (outWidth() % 2 || outHeight() % 2))) {
+        m_error = QString("%1: 输出尺寸 %2x%3 无法编码").arg(m_filters).arg(outWidth()).arg(outHeight());
+        close();
+        return false;
+    }
+    return true;
+}
+
+int VideoFilterGraph::outWidth() const {
+    return m_sink ? av_buffersink_get_w(m_sink) : 0;
+}
+
+int VideoFilterGraph::outHeight() const {
+    return m_sink ? av_buffersink_get_h(m_sink) : 0;
+}
+
+AVPixelFormat VideoFilterGraph::outFormat() const {
+    return m_sink ? (AVPixelFormat)av_buffersink_get_format(m_sink) : AV_PIX_FMT_NONE;
+}
+
+AVRational VideoFilterGraph::outFrameRate() const {
+    AVRational rate = m_sink ? av_buffersink_get_frame_rate(m_sink) : AVRational{0, 1};
+    return rate.num > 0 && rate.den > 0 ? rate : AVRational{0, 1};
+}
+
+bool VideoFilterGraph::push(const AVFrame *frame) {
+    if (!m_src) return false;
+    // KEEP_REF: the graph takes its own reference (no copy), the caller keeps its frame
+    return av_buffersrc_add_frame_flags(m_src, const_cast<AVFrame*>(frame), frame ? AV_BUFFERSRC_FLAG_KEEP_REF : 0) >= 0;
+}
+
+AVFrame *VideoFilterGraph::pull() {
+    if (!m_sink) return nullptr;
+    AVFrame *frame = av_frame_alloc();
+    if (av_buffersink_get_frame(m_sink, frame) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    if (frame->pts != AV_NOPTS_VALUE) frame->pts = av_rescale_q(frame->pts, av_buffersink_get_time_base(m_sink), m_timeBase);
+    // fps / setpts filters may round two frames onto one tick
+    if (frame->pts == AV_NOPTS_VALUE || (m_lastPts != INT64_MIN && frame->pts <= m_lastPts)) {
+        frame->pts = m_lastPts == INT64_MIN ? 0 : m_lastPts + 1;
+    }
+    m_lastPts = frame->pts;
+    return frame;
+}
@@ -1,7 +1,13 @@
 #include "VideoUtils.h"
+#include "RecordingIndex.h"
+#include "VideoEncoderPreset.h"
 #include <QDebug>
 #include <QTime>
 #include <QThread>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCryptographicHash>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -12,6 +18,37 @@ VideoUtils::VideoUtils(QObject *parent) : QObject(parent) {
     avformat_network_init();
 }
 
+QString VideoUtils::proxyPathFor(const QString &file) {
+    QFileInfo info(file);
+    QByteArray key = QCryptographicHash::hash(info.absoluteFilePath().toUtf8(), QCryptographicHash::Md5).toHex().left(12);
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/proxy";
+    return QDir(dir).filePath(info.completeBaseName() + "_" + QString::fromLatin1(key) + ".mp4");
+}
+
+QString VideoUtils::previewPathFor(const QString &file) {
+    // Proxies only appear under their final name once complete; one older than the
+    // recording belongs to an earlier file of the same name
+    QFileInfo proxy(proxyPathFor(file));
+    QFileInfo master(file);
+    if (proxy.exists() && proxy.size() > 0 && proxy.lastModified() >= master.lastModified().addSecs(-60)) {
+        return proxy.filePath();
+    }
+    return file;
+}
+
+QList<qint64> VideoUtils::readMarkers(const QString &file) {
+    QList<qint64> markers;
+    AVFormatContext *fmtCtx = nullptr;
+    // Chapters come from the header parse; no stream probing needed
+    if (avformat_open_input(&fmtCtx, file.toUtf8().constData(), nullptr, nullptr) < 0) return markers;
+    for (unsigned i = 0; i < fmtCtx->nb_chapters; i++) {
+        const AVChapter *chapter = fmtCtx->chapters[i];
+        markers.append(av_rescale_q(chapter->start, chapter->time_base, {1, 1000}));
+    }
+    avformat_close_input(&fmtCtx);
+    return markers;
+}
+
 void VideoUtils::cropVideo(const QString &inputFile, const QString &outputFile, const QRect &rect) {
     emit processingError("Native cropping not yet implemented");
 }
@@ -87,7 +124,7 @@ void VideoUtils::trimVideo(const QString &inputFile, const QString &outputFile,
             stream_mapping[i] = stream_index++;
             AVStream *out_stream = avformat_new_stream(ofmt_ctx, nullptr);
             avcodec_parameters_copy(out_stream->codecpar, in_codecpar);
-            out_stream->codecpar->codec_tag = 0;
+            out_stream->codecpar->codec_tag = VideoEncoderPreset::codecTagFor(ofmt_ctx->oformat, in_codecpar->codec_id);
         }
 
         if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
@@ -195,7 +232,9 @@ void VideoUtils::trimVideoMs(const QString &inputFile, const QString &outputFile
              }
         }
         
-        if ((ret = avformat_find_stream_info(ifmt_ctx, 0)) < 0) {
+        // With the recording's sidecar the keyframe to cut at is known without probing
+        RecordingIndex index;
+        if (!index.load(inputFile) && (ret = avformat_find_stream_info(ifmt_ctx, 0)) < 0) {
              avformat_close_input(&ifmt_ctx);
              emit processingError("无法获取输入文件信息");
              return;
@@ -242,7 +281,7 @@ void VideoUtils::trimVideoMs(const QString &inputFile, const QString &outputFile
                 return;
             }
             avcodec_parameters_copy(out_stream->codecpar, in_codecpar);
-            out_stream->codecpar->codec_tag = 0;
+            out_stream->codecpar->codec_tag = VideoEncoderPreset::codecTagFor(ofmt_ctx->oformat, in_codecpar->codec_id);
             // 复制时间基
             out_stream->time_base = in_stream->time_base;
         }
@@ -280,6 +319,13 @@ void VideoUtils::trimVideoMs(const QString &inputFile, const QString &outputFile
         if (videoStreamIdx >= 0) {
             AVStream *video_stream = ifmt_ctx->streams[videoStreamIdx];
             int64_t seek_target = av_rescale_q(startMs, {1, 1000}, video_stream->time_base);
+            int64_t keyPts = index.isValid() ? index.keyframePtsAtOrAfter(startMs) : AV_NOPTS_VALUE;
+            if (keyPts != AV_NOPTS_VALUE) {
+                // Land exactly on the first keyframe of the cut instead of reading up to it
+                seek_target = av_rescale_q(keyPts, index.timeBase(), video_stream->time_base);
+                if (video_stream->start_time != AV_NOPTS_VALUE) seek_target += video_stream->start_time;
+                qDebug() << "[VideoUtils] Index keyframe at" << index.keyframeAtOrAfter(startMs) << "ms";
+            }
             ret = av_seek_frame(ifmt_ctx, videoStreamIdx, seek_target, AVSEEK_FLAG_BACKWARD);
             qDebug() << "[VideoUtils] Seek to" << startMs << "ms, target pts=" << seek_target << ", ret=" << ret;
         } else {
@@ -0,0 +1,436 @@
+#include "X11DamageGrabber.h"
+#include <algorithm>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+extern "C" {
+#include <libavutil/time.h>
+#include <libavutil/pixfmt.h>
+}
+
+namespace {
+
+// Clean gaps up to this many rows are read along with their neighbours:
+// one larger XShmGetImage is cheaper than an extra round trip.
+const int kMergeGap = 16;
+
+// Xlib's default handler exits the process; errors while grabbing (e.g. the screen
+// was resized under us) are turned into a failed grab instead. The handler is
+// process-wide, but only the record thread talks to this display connection.
+bool g_xError = false;
+int trapXError(Display *, XErrorEvent *) {
+    g_xError = true;
+    return 0;
+}
+
+} // namespace
+
+struct X11DamageGrabber::X11State {
+    Display *dpy = nullptr;
+    Window root = 0;
+    Visual *visual = nullptr;
+    int depth = 0;
+    XShmSegmentInfo shm;
+    bool shmAttached = false;
+    XImage *image = nullptr;     // Persistent image of the whole capture area
+    Damage damage = 0;
+    XserverRegion parts = 0;     // Damage collected since the previous grab
+    quintptr window = 0;         // Followed window (0 = fixed region)
+    int screenW = 0, screenH = 0;
+    int x = 0, y = 0, w = 0, h = 0;
+    int stride = 0;
+    bool drawCursor = true;
+    bool fullRefresh = true;
+    int cursorFirst = 0;         // Rows the cursor was blended into last frame
+    int cursorLast = 0;
+    int64_t frameUs = 0;
+    int64_t nextFrameUs = 0;
+    std::vector<uint8_t> rows;   // Per row: changed in the current grab
+
+    X11State() {
+        shm.shmseg = 0;
+        shm.shmid = -1;
+        shm.shmaddr = nullptr;
+        shm.readOnly = False;
+    }
+};
+
+X11DamageGrabber::X11DamageGrabber() {}
+
+X11DamageGrabber::~X11DamageGrabber() {
+    close();
+}
+
+bool X11DamageGrabber::open(const QRect &region, int fps, bool drawCursor) {
+    if (!openDisplay(fps, drawCursor)) return false;
+
+    QRect screenRect(0, 0, d->screenW, d->screenH);
+    QRect area = region.isNull() ? screenRect : region.intersected(screenRect);
+    if (!allocImage(QRect(area.x(), area.y(), area.width() & ~1, area.height() & ~1))) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool X11DamageGrabber::openWindow(quintptr window, int fps, bool drawCursor) {
+    if (!openDisplay(fps, drawCursor)) return false;
+
+    d->window = window;
+    QRect area;
+    if (!windowArea(area)) { m_error = "window is not viewable"; close(); return false; }
+    if (!allocImage(area)) { close(); return false; }
+    return true;
+}
+
+bool X11DamageGrabber::openDisplay(int fps, bool drawCursor) {
+    close();
+    m_error.clear();
+    m_stats = Stats();
+    d.reset(new X11State);
+
+    d->dpy = XOpenDisplay(nullptr);
+    if (!d->dpy) { m_error = "XOpenDisplay failed"; close(); return false; }
+
+    int eventBase = 0, errorBase = 0;
+    if (!XShmQueryExtension(d->dpy)) { m_error = "MIT-SHM not available"; close(); return false; }
+    if (!XDamageQueryExtension(d->dpy, &eventBase, &errorBase)) { m_error = "DAMAGE not available"; close(); return false; }
+    if (!XFixesQueryExtension(d->dpy, &eventBase, &errorBase)) { m_error = "XFIXES not available"; close(); return false; }
+
+    int screen = DefaultScreen(d->dpy);
+    d->root = RootWindow(d->dpy, screen);
+    d->visual = DefaultVisual(d->dpy, screen);
+    d->depth = DefaultDepth(d->dpy, screen);
+    d->screenW = DisplayWidth(d->dpy, screen);
+    d->screenH = DisplayHeight(d->dpy, screen);
+
+    d->damage = XDamageCreate(d->dpy, d->root, XDamageReportNonEmpty);
+    d->parts = XFixesCreateRegion(d->dpy, nullptr, 0);
+    d->drawCursor = drawCursor;
+    d->frameUs = 1000000 / qMax(1, fps);
+    return true;
+}
+
+bool X11DamageGrabber::allocImage(const QRect &area) {
+    if (area.width() < 2 || area.height() < 2) { m_error = "capture region is empty"; return false; }
+    d->x = area.x();
+    d->y = area.y();
+    d->w = area.width();
+    d->h = area.height();
+
+    d->image = XShmCreateImage(d->dpy, d->visual, d->depth, ZPixmap, nullptr, &d->shm, d->w, d->h);
+    if (!d->image) { m_error = "XShmCreateImage failed"; freeImage(); return false; }
+    if (d->image->bits_per_pixel != 32 || d->image->byte_order != LSBFirst ||
+        d->image->red_mask != 0xff0000 || d->image->blue_mask != 0xff) {
+        m_error = QString("unsupported visual (%1 bpp)").arg(d->image->bits_per_pixel);
+        freeImage();
+        return false;
+    }
+    d->stride = d->image->bytes_per_line;
+
+    d->shm.shmid = shmget(IPC_PRIVATE, (size_t)d->stride * d->h, IPC_CREAT | 0600);
+    if (d->shm.shmid < 0) { m_error = "shmget failed"; freeImage(); return false; }
+    void *addr = shmat(d->shm.shmid, nullptr, 0);
+    if (addr == (void*)-1) { m_error = "shmat failed"; freeImage(); return false; }
+    d->shm.shmaddr = d->image->data = (char*)addr;
+
+    g_xError = false;
+    XErrorHandler oldHandler = XSetErrorHandler(trapXError);
+    Bool attached = XShmAttach(d->dpy, &d->shm);
+    XSync(d->dpy, False);
+    XSetErrorHandler(oldHandler);
+    if (!attached || g_xError) { m_error = "XShmAttach failed (remote display?)"; freeImage(); return false; }
+    d->shmAttached = true;
+    // Both sides are attached; the segment now goes away with the last detach, even on a crash
+    shmctl(d->shm.shmid, IPC_RMID, nullptr);
+
+    d->rows.assign(d->h, 0);
+    d->cursorFirst = d->cursorLast = 0;
+    d->fullRefresh = true;
+    return true;
+}
+
+void X11DamageGrabber::freeImage() {
+    if (d->shmAttached) {
+        XShmDetach(d->dpy, &d->shm);
+        XSync(d->dpy, False);
+        d->shmAttached = false;
+    } else if (d->shm.shmid >= 0) {
+        shmctl(d->shm.shmid, IPC_RMID, nullptr);
+    }
+    if (d->image) {
+        d->image->data = nullptr; // Owned by the segment
+        XDestroyImage(d->image);
+        d->image = nullptr;
+    }
+    if (d->shm.shmaddr) shmdt(d->shm.shmaddr);
+    d->shm.shmaddr = nullptr;
+    d->shm.shmid = -1;
+    d->w = d->h = 0;
+}
+
+void X11DamageGrabber::close() {
+    if (!d) return;
+    if (d->dpy) {
+        freeImage();
+        if (d->parts) XFixesDestroyRegion(d->dpy, d->parts);
+        if (d->damage) XDamageDestroy(d->dpy, d->damage);
+        XCloseDisplay(d->dpy);
+    }
+    d.reset();
+}
+
+bool X11DamageGrabber::windowArea(QRect &area) const {
+    XWindowAttributes attrs;
+    Window child = 0;
+    int rootX = 0, rootY = 0;
+    g_xError = false;
+    XErrorHandler oldHandler = XSetErrorHandler(trapXError);
+    bool ok = XGetWindowAttributes(d->dpy, (Window)d->window, &attrs) &&
+              XTranslateCoordinates(d->dpy, (Window)d->window, d->root, 0, 0, &rootX, &rootY, &child);
+    XSetErrorHandler(oldHandler);
+    if (!ok || g_xError || attrs.map_state != IsViewable) return false;
+
+    // Keep the window's size while it hangs off a screen edge: slide the area back inside
+    int w = qMin(attrs.width, d->screenW) & ~1;
+    int h = qMin(attrs.height, d->screenH) & ~1;
+    area = QRect(qBound(0, rootX, d->screenW - w), qBound(0, rootY, d->screenH - h), w, h);
+    return w >= 2 && h >= 2;
+}
+
+bool X11DamageGrabber::followWindow() {
+    QRect area;
+    // Unmapped or destroyed: keep grabbing the last area rather than stopping the recording
+    if (!windowArea(area)) return d->image != nullptr;
+
+    if (!d->image || area.width() != d->w || area.height() != d->h) {
+        // Resized: new persistent image; the recorder scales the new size into the encoder
+        freeImage();
+        return allocImage(area);
+    }
+    if (area.x() != d->x || area.y() != d->y) {
+        d->x = area.x();
+        d->y = area.y();
+        d->fullRefresh = true;
+    }
+    return true;
+}
+
+std::vector<X11DamageGrabber::WindowEntry> X11DamageGrabber::listWindows() {
+    std::vector<WindowEntry> windows;
+    Display *dpy = XOpenDisplay(nullptr);
+    if (!dpy) return windows;
+
+    Window root = DefaultRootWindow(dpy);
+    Atom clientList = XInternAtom(dpy, "_NET_CLIENT_LIST_STACKING", True);
+    Atom netName = XInternAtom(dpy, "_NET_WM_NAME", True);
+    Atom utf8 = XInternAtom(dpy, "UTF8_STRING", True);
+    Atom type = 0;
+    int format = 0;
+    unsigned long count = 0, after = 0;
+    unsigned char *data = nullptr;
+    if (clientList != None &&
+        XGetWindowProperty(dpy, root, clientList, 0, 4096, False, XA_WINDOW, &type, &format, &count, &after, &data) == Success && data) {
+        const Window *clients = (const Window*)data;
+        g_xError = false;
+        XErrorHandler oldHandler = XSetErrorHandler(trapXError);
+        // The list is bottom-to-top; callers take the first window under the cursor
+        for (long i = (long)count - 1; i >= 0; i--) {
+            XWindowAttributes attrs;
+            Window child = 0;
+            int rootX = 0, rootY = 0;
+            if (!XGetWindowAttributes(dpy, clients[i], &attrs) || attrs.map_state != IsViewable) continue;
+            if (!XTranslateCoordinates(dpy, clients[i], root, 0, 0, &rootX, &rootY, &child)) continue;
+
+            WindowEntry entry;
+            entry.id = (quintptr)clients[i];
+            entry.rect = QRect(rootX, rootY, attrs.width, attrs.height);
+            unsigned char *name = nullptr;
+            unsigned long nameLen = 0;
+            if (netName != None && XGetWindowProperty(dpy, clients[i], netName, 0, 1024, False, utf8, &type, &format,
+                                                      &nameLen, &after, &name) == Success && name) {
+                entry.title = QString::fromUtf8((const char*)name, (int)nameLen);
+                XFree(name);
+            } else {
+                char *legacy = nullptr;
+                if (XFetchName(dpy, clients[i], &legacy) && legacy) {
+                    entry.title = QString::fromLocal8Bit(legacy);
+                    XFree(legacy);
+                }
+            }
+            windows.push_back(entry);
+        }
+        XSync(dpy, False);
+        XSetErrorHandler(oldHandler);
+        XFree(data);
+    }
+    XCloseDisplay(dpy);
+    return windows;
+}
+
+bool X11DamageGrabber::isOpen() const {
+    return d != nullptr;
+}
+
+int X11DamageGrabber::width() const {
+    return d ? d->w : 0;
+}
+
+int X11DamageGrabber::height() const {
+    return d ? d->h : 0;
+}
+
+QRect X11DamageGrabber::region() const {
+    return d ? QRect(d->x, d->y, d->w, d->h) : QRect();
+}
+
+QPoint X11DamageGrabber::cursorPos() const {
+    if (!d || !d->dpy) return QPoint();
+    Window rootRet, childRet;
+    int rootX = 0, rootY = 0, winX, winY;
+    unsigned int mask;
+    XQueryPointer(d->dpy, d->root, &rootRet, &childRet, &rootX, &rootY, &winX, &winY, &mask);
+    return QPoint(rootX, rootY);
+}
+
+bool X11DamageGrabber::grab(AVFrame *frame, std::vector<RowSpan> &dirtyRows) {
+    if (!d) return false;
+
+    // One frame per tick like x11grab; after a stall, resume from now instead of bursting
+    int64_t now = av_gettime_relative();
+    if (d->nextFrameUs == 0) d->nextFrameUs = now;
+    if (now < d->nextFrameUs) av_usleep((unsigned)(d->nextFrameUs - now));
+    else if (now - d->nextFrameUs > d->frameUs) d->nextFrameUs = now;
+    d->nextFrameUs += d->frameUs;
+
+    if (d->window && !followWindow()) return false;
+
+    // Notify events only say "the region is non-empty"; the region itself is fetched below
+    while (XPending(d->dpy)) {
+        XEvent ev;
+        XNextEvent(d->dpy, &ev);
+    }
+    std::fill(d->rows.begin(), d->rows.end(), 0);
+    XDamageSubtract(d->dpy, d->damage, None, d->parts);
+    if (d->fullRefresh) {
+        markRows(0, d->h);
+        d->fullRefresh = false;
+    } else {
+        int count = 0;
+        XRectangle *rects = XFixesFetchRegion(d->dpy, d->parts, &count);
+        for (int i = 0; i < count; i++) {
+            int left = rects[i].x - d->x;
+            if (left + rects[i].width <= 0 || left >= d->w) continue;
+            int top = rects[i].y - d->y;
+            markRows(top, top + rects[i].height);
+        }
+        if (rects) XFree(rects);
+        // The cursor is not part of the damage; re-read the rows it was drawn over
+        markRows(d->cursorFirst, d->cursorLast);
+    }
+
+    bool ok = true;
+    int r = 0;
+    while (r < d->h && ok) {
+        if (!d->rows[r]) { r++; continue; }
+        int first = r;
+        int last = r + 1;
+        while (true) {
+            while (last < d->h && d->rows[last]) last++;
+            int next = last;
+            while (next < d->h && next - last < kMergeGap && !d->rows[next]) next++;
+            if (next >= d->h || !d->rows[next]) break;
+            last = next;
+        }
+        markRows(first, last); // Bridged gaps are re-read too
+        ok = grabRows(first, last);
+        r = last;
+    }
+    if (!ok) {
+        d->fullRefresh = true;
+        return false;
+    }
+
+    d->cursorFirst = d->cursorLast = 0;
+    if (d->drawCursor) drawCursor();
+
+    dirtyRows.clear();
+    for (r = 0; r < d->h; ) {
+        if (!d->rows[r]) { r++; continue; }
+        int first = r;
+        while (r < d->h && d->rows[r]) r++;
+        dirtyRows.push_back({ first, r });
+    }
+
+    frame->data[0] = (uint8_t*)d->image->data;
+    frame->linesize[0] = d->stride;
+    frame->width = d->w;
+    frame->height = d->h;
+    frame->format = AV_PIX_FMT_BGR0;
+
+    m_stats.frames++;
+    m_stats.rowsTotal += d->h;
+    return true;
+}
+
+void X11DamageGrabber::markRows(int first, int last) {
+    first = qMax(first, 0);
+    last = qMin(last, d->h);
+    for (int r = first; r < last; r++) d->rows[r] = 1;
+}
+
+bool X11DamageGrabber::grabRows(int first, int last) {
+    // A full-width band has the same stride as the persistent image, so the server
+    // can write it straight into place at the band's offset in the segment
+    XImage *band = XShmCreateImage(d->dpy, d->visual, d->depth, ZPixmap,
+                                   d->image->data + (size_t)first * d->stride, &d->shm, d->w, last - first);
+    if (!band) return false;
+
+    g_xError = false;
+    XErrorHandler oldHandler = XSetErrorHandler(trapXError);
+    Bool ok = XShmGetImage(d->dpy, d->root, band, d->x, d->y + first, AllPlanes);
+    XSetErrorHandler(oldHandler);
+    band->data = nullptr;
+    XDestroyImage(band);
+
+    m_stats.requests++;
+    m_stats.rowsGrabbed += last - first;
+    return ok && !g_xError;
+}
+
+void X11DamageGrabber::drawCursor() {
+    XFixesCursorImage *cursor = XFixesGetCursorImage(d->dpy);
+    if (!cursor) return;
+
+    int cx = cursor->x - cursor->xhot - d->x;
+    int cy = cursor->y - cursor->yhot - d->y;
+    int x0 = qMax(cx, 0), x1 = qMin(cx + (int)cursor->width, d->w);
+    int y0 = qMax(cy, 0), y1 = qMin(cy + (int)cursor->height, d->h);
+    if (x0 < x1 && y0 < y1) {
+        for (int y = y0; y < y1; y++) {
+            uint8_t *dst = (uint8_t*)d->image->data + (size_t)y * d->stride + x0 * 4;
+            // XFixes hands out premultiplied ARGB in unsigned longs
+            const unsigned long *src = cursor->pixels + (size_t)(y - cy) * cursor->width + (x0 - cx);
+            for (int x = x0; x < x1; x++, dst += 4, src++) {
+                uint32_t p = (uint32_t)*src;
+                int a = p >> 24;
+                if (a == 0) continue;
+                int inv = 255 - a;
+                dst[0] = (uint8_t)qMin(255, (int)(p & 0xff) + (dst[0] * inv + 127) / 255);
+                dst[1] = (uint8_t)qMin(255, (int)((p >> 8) & 0xff) + (dst[1] * inv + 127) / 255);
+                dst[2] = (uint8_t)qMin(255, (int)((p >> 16) & 0xff) + (dst[2] * inv + 127) / 255);
+            }
+        }
+        d->cursorFirst = y0;
+        d->cursorLast = y1;
+        markRows(y0, y1);
+    }
+    XFree(cursor);
+}
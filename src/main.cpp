@@ -9,7 +9,10 @@
 #include <QStandardPaths>
 #include <QLocalServer>
 #include <QLocalSocket>
+#include <QTimer>
 #include "LogManager.h"
+#include "RecorderController.h"
+#include "SyncAnalyzer.h"
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -39,6 +42,66 @@ void myMessageOutput(QtMsgType type, const QMessageLogContext &context, const QS
     }
 }
 
+// A/V sync harness, no UI:
+//   --sync-test [seconds]   record the synthetic flash / beep pattern (default 60 s) and analyze it
+//   --sync-analyze <file>   analyze an existing sync-test recording
+// Exit code 0 = inside the sync window, 1 = outside or unreadable
+static int runSyncHarness(const QStringList &args)
+{
+#ifdef Q_OS_WIN
+    // GUI-subsystem binary: report to the console it was started from
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+#endif
+    QTextStream out(stdout);
+    int analyzeArg = args.indexOf("--sync-analyze");
+    if (analyzeArg > 0) {
+        SyncAnalyzer::Report report = SyncAnalyzer::analyze(args.value(analyzeArg + 1));
+        out << report.summary() << endl;
+        return report.passed() ? 0 : 1;
+    }
+
+    bool hasSeconds = false;
+    int seconds = args.value(args.indexOf("--sync-test") + 1).toInt(&hasSeconds);
+    seconds = hasSeconds ? qMax(10, seconds) : 60;
+    const int warmupMs = 2000; // Sources settle before the start trigger
+
+    RecorderController recorder;
+    recorder.setSyncTest(true);
+    recorder.setAudioConfig(true, 1.0, false, 1.0);
+    recorder.setFps(30);
+    int exitCode = 1;
+    QObject::connect(&recorder, &RecorderController::errorOccurred, [&](const QString &msg) {
+        out << "error: " << msg << endl;
+    });
+    QObject::connect(&recorder, &RecorderController::recordingFinished, [&](const QString &path) {
+        out << "recorded " << path << endl;
+        SyncAnalyzer::Report report = SyncAnalyzer::analyze(path);
+        out << report.summary() << endl;
+        exitCode = report.passed() ? 0 : 1;
+    });
+    // recordingFinished (if anything was recorded) is emitted right after this
+    QObject::connect(&recorder, &RecorderController::stateChanged, [&](RecorderController::State state) {
+        if (state == RecorderController::Stopped) QCoreApplication::quit();
+    });
+    // Soak runs: a progress line every minute
+    QTimer progress;
+    QObject::connect(&progress, &QTimer::timeout, [&]() {
+        out << "recording " << recorder.getDuration() / 1000 << " / " << seconds << " s" << endl;
+    });
+    progress.start(60000);
+
+    out << "sync test: " << seconds << " s" << endl;
+    recorder.armRecording();
+    if (recorder.state() != RecorderController::Armed) return 1;
+    QTimer::singleShot(warmupMs, &recorder, &RecorderController::startRecording);
+    QTimer::singleShot(warmupMs + seconds * 1000, &recorder, &RecorderController::stopRecording);
+    QCoreApplication::exec();
+    return exitCode;
+}
+
 int main(int argc, char *argv[])
 {
     // 1. 设置应用信息
@@ -78,6 +141,11 @@ int main(int argc, char *argv[])
         }
         // QT_DEBUG_PLUGINS 太冗余，先关闭。若需调试，再手动改为"1"
         qputenv("QT_DEBUG_PLUGINS", "0");
+
+        QStringList args = a.arguments();
+        if (args.contains("--sync-test") || args.contains("--sync-analyze")) {
+            return runSyncHarness(args);
+        }
         
         // --- Single Instance Logic (QLocalServer) ---
         const QString serverName = "MScreenRecord_Server";